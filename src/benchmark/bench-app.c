@@ -0,0 +1,35 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+/* Trivial application for launch-benchmark: reports the time
+ * main() was entered and exits. Built both as a shared object
+ * for boosted launches and as a PIE for the execve() baseline.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+__attribute__((visibility("default")))
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    struct timespec ts = { 0, 0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    printf("main %llu\n", (unsigned long long)ts.tv_sec * 1000000u + ts.tv_nsec / 1000u);
+    fflush(stdout);
+
+    return 0;
+}
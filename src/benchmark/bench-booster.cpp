@@ -0,0 +1,66 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "booster.h"
+#include "daemon.h"
+
+/*!
+ * \class BenchBooster.
+ * \brief Booster that preloads nothing.
+ *
+ * Used by launch-benchmark to measure the cost of the launcher
+ * itself: daemon loop, invoker protocol and booster respawn.
+ */
+class BenchBooster : public Booster
+{
+public:
+
+    //! Constructor.
+    BenchBooster() {};
+
+    //! Destructor.
+    virtual ~BenchBooster() {};
+
+    //! \reimp
+    virtual const string & boosterType() const
+    {
+        return m_boosterType;
+    }
+
+protected:
+
+    //! \reimp
+    virtual bool preload()
+    {
+        return true;
+    }
+
+private:
+
+    //! Disable copy-constructor
+    BenchBooster(const BenchBooster & r);
+
+    //! Disable assignment operator
+    BenchBooster & operator= (const BenchBooster & r);
+
+    static const string m_boosterType;
+};
+
+const string BenchBooster::m_boosterType = "bench";
+
+int main(int argc, char **argv)
+{
+    BenchBooster *booster = new BenchBooster;
+
+    Daemon d(argc, argv);
+    d.run(booster);
+}
@@ -0,0 +1,508 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+/* Launch storm benchmark.
+ *
+ * Starts a launcher daemon with the bench booster in a private
+ * XDG_RUNTIME_DIR, fires sequential and concurrent launches through
+ * the invoker and the same launches with plain execve() as a baseline.
+ * For every launch two latencies are measured from the moment the
+ * launch was started: time to main() of the application (reported
+ * by the application on stdout) and time to exit status (invoker or
+ * application process exit).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define BOOSTER_TYPE "bench"
+
+// How long to wait for the daemon socket to appear
+static const unsigned int STARTUP_TIMEOUT = 10000;
+
+// How long to wait for a single launch to finish
+static const unsigned int LAUNCH_TIMEOUT = 30000;
+
+typedef struct Launch {
+    pid_t    pid;
+    int      fd;
+    uint64_t start;
+    uint64_t main;
+    uint64_t exit;
+    int      status;
+    char     buf[64];
+    size_t   len;
+} Launch;
+
+typedef struct Result {
+    const char *name;
+    int         count;
+    int         failed;
+    uint64_t    wall;
+    uint64_t   *to_main;
+    uint64_t   *to_exit;
+} Result;
+
+static const char *g_invoker = NULL;
+static const char *g_booster = NULL;
+static const char *g_app     = NULL;
+static const char *g_app_pie = NULL;
+static bool        g_verbose = false;
+
+static uint64_t timestamp_usec(void)
+{
+    struct timespec ts = { 0, 0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void usage(int status)
+{
+    printf("\n"
+           "Usage: launch-benchmark [options] [-- launcher options]\n"
+           "\n"
+           "Measure launch latency of the launcher against plain execve().\n"
+           "\n"
+           "Options:\n"
+           "  -i, --invoker PATH     Invoker binary.\n"
+           "  -b, --booster PATH     Bench booster binary.\n"
+           "  -a, --app PATH         Test application built as a shared object.\n"
+           "  -e, --app-pie PATH     Test application built as a PIE, used for\n"
+           "                         the execve() baseline.\n"
+           "  -n, --count N          Launches per run (default 100).\n"
+           "  -c, --concurrency N    Parallel launches in concurrent runs (default 8).\n"
+           "  -v, --verbose          Show launcher and invoker output.\n"
+           "  -h, --help             Print this help.\n"
+           "\n"
+           "Options after -- are passed to the launcher, e.g. -- --pool-min=4\n"
+           "\n");
+    exit(status);
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void)sb;
+    (void)type;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+static int redirect_output(void)
+{
+    if (g_verbose)
+        return 0;
+
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd == -1)
+        return -1;
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    return 0;
+}
+
+// Starts the launcher daemon and waits until its socket exists
+static pid_t start_daemon(const char *runtime_dir, char **daemon_args, int daemon_argc)
+{
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        char **argv = calloc(daemon_argc + 2, sizeof *argv);
+        argv[0] = (char *)g_booster;
+        for (int i = 0; i < daemon_argc; ++i)
+            argv[i + 1] = daemon_args[i];
+        if (!g_verbose) {
+            int fd = open("/dev/null", O_WRONLY);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execv(g_booster, argv);
+        perror(g_booster);
+        _exit(EXIT_FAILURE);
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/mapplauncherd/_default/%s/socket", runtime_dir, BOOSTER_TYPE);
+
+    uint64_t started = timestamp_usec();
+    while (timestamp_usec() - started < STARTUP_TIMEOUT * 1000u) {
+        int status = 0;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            fprintf(stderr, "launcher exited during startup\n");
+            return -1;
+        }
+
+        /* Connecting would be seen by a booster as a broken
+         * launch request, check that the socket exists instead.
+         */
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+            return pid;
+        usleep(10000);
+    }
+
+    fprintf(stderr, "launcher socket %s did not appear\n", path);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static bool daemon_exited(pid_t pid)
+{
+    int status = 0;
+    if (waitpid(pid, &status, WNOHANG) != pid)
+        return false;
+    if (WIFSIGNALED(status))
+        fprintf(stderr, "launcher was killed by signal %d\n", WTERMSIG(status));
+    else
+        fprintf(stderr, "launcher exited with status %d\n", WEXITSTATUS(status));
+    return true;
+}
+
+static void stop_daemon(pid_t pid)
+{
+    if (pid <= 0)
+        return;
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+static bool start_launch(Launch *launch, bool boosted)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe2");
+        return false;
+    }
+
+    memset(launch, 0, sizeof *launch);
+    launch->start = timestamp_usec();
+    launch->status = -1;
+    launch->pid = fork();
+
+    if (launch->pid == -1) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (launch->pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        redirect_output();
+        if (boosted) {
+            char *argv[] = { (char *)g_invoker, "--type=" BOOSTER_TYPE, "--respawn=0",
+                             (char *)g_app, NULL };
+            execv(g_invoker, argv);
+        } else {
+            char *argv[] = { (char *)g_app_pie, NULL };
+            execv(g_app_pie, argv);
+        }
+        _exit(127);
+    }
+
+    close(fds[1]);
+    launch->fd = fds[0];
+    return true;
+}
+
+static void read_launch_output(Launch *launch)
+{
+    char buf[256];
+    ssize_t rc = read(launch->fd, buf, sizeof buf);
+
+    if (rc == -1 && (errno == EINTR || errno == EAGAIN))
+        return;
+
+    if (rc <= 0) {
+        close(launch->fd);
+        launch->fd = -1;
+        return;
+    }
+
+    for (ssize_t i = 0; i < rc && !launch->main; ++i) {
+        if (buf[i] != '\n') {
+            if (launch->len < sizeof launch->buf - 1)
+                launch->buf[launch->len++] = buf[i];
+            continue;
+        }
+        launch->buf[launch->len] = 0;
+        unsigned long long usec = 0;
+        if (sscanf(launch->buf, "main %llu", &usec) == 1)
+            launch->main = usec;
+        launch->len = 0;
+    }
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank percentile of a sorted array
+static double percentile_ms(const uint64_t *values, int count, int pct)
+{
+    if (count <= 0)
+        return 0.0;
+    int rank = (pct * count + 99) / 100;
+    if (rank < 1)
+        rank = 1;
+    return values[rank - 1] / 1000.0;
+}
+
+// Runs count launches with at most concurrency of them in flight
+static void run(Result *result, const char *name, bool boosted, int count, int concurrency)
+{
+    Launch *launches = calloc(concurrency, sizeof *launches);
+    bool *active = calloc(concurrency, sizeof *active);
+    struct pollfd *pfds = calloc(concurrency, sizeof *pfds);
+
+    memset(result, 0, sizeof *result);
+    result->name = name;
+    result->to_main = calloc(count, sizeof *result->to_main);
+    result->to_exit = calloc(count, sizeof *result->to_exit);
+
+    int started = 0;
+    int finished = 0;
+    int running = 0;
+    uint64_t begin = timestamp_usec();
+
+    while (finished < count) {
+        // Keep the pipeline full
+        for (int i = 0; i < concurrency && started < count; ++i) {
+            if (active[i])
+                continue;
+            ++started;
+            if (!start_launch(&launches[i], boosted)) {
+                ++finished;
+                ++result->failed;
+                continue;
+            }
+            active[i] = true;
+            ++running;
+        }
+
+        if (!running)
+            continue;
+
+        // Collect application output
+        int npfds = 0;
+        for (int i = 0; i < concurrency; ++i) {
+            if (active[i] && launches[i].fd != -1) {
+                pfds[npfds].fd = launches[i].fd;
+                pfds[npfds].events = POLLIN;
+                pfds[npfds].revents = 0;
+                ++npfds;
+            }
+        }
+        if (npfds && poll(pfds, npfds, 5) > 0) {
+            for (int k = 0; k < npfds; ++k) {
+                if (!pfds[k].revents)
+                    continue;
+                for (int i = 0; i < concurrency; ++i) {
+                    if (active[i] && launches[i].fd == pfds[k].fd) {
+                        read_launch_output(&launches[i]);
+                        break;
+                    }
+                }
+            }
+        } else if (!npfds) {
+            usleep(200);
+        }
+
+        // Collect exit statuses, the launcher is a child too and reaped only when stopped
+        for (int i = 0; i < concurrency; ++i) {
+            int status = 0;
+            if (!active[i] || launches[i].pid == -1 ||
+                waitpid(launches[i].pid, &status, WNOHANG) != launches[i].pid)
+                continue;
+            launches[i].exit = timestamp_usec();
+            launches[i].status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            launches[i].pid = -1;
+        }
+
+        // Finish launches that have exited and closed their output
+        uint64_t now = timestamp_usec();
+        for (int i = 0; i < concurrency; ++i) {
+            Launch *launch = &launches[i];
+            if (!active[i])
+                continue;
+
+            if (launch->pid != -1 && now - launch->start > LAUNCH_TIMEOUT * 1000u) {
+                fprintf(stderr, "%s: launch timed out\n", name);
+                kill(launch->pid, SIGKILL);
+                continue;
+            }
+
+            if (launch->pid != -1 || launch->fd != -1)
+                continue;
+
+            if (launch->status == 0 && launch->main >= launch->start) {
+                result->to_main[result->count] = launch->main - launch->start;
+                result->to_exit[result->count] = launch->exit - launch->start;
+                ++result->count;
+            } else {
+                ++result->failed;
+                if (g_verbose)
+                    fprintf(stderr, "%s: launch failed, status %d\n", name, launch->status);
+            }
+            active[i] = false;
+            --running;
+            ++finished;
+        }
+    }
+
+    result->wall = timestamp_usec() - begin;
+
+    qsort(result->to_main, result->count, sizeof *result->to_main, compare_u64);
+    qsort(result->to_exit, result->count, sizeof *result->to_exit, compare_u64);
+
+    free(pfds);
+    free(active);
+    free(launches);
+}
+
+static void report(const Result *result)
+{
+    double rate = result->wall ? result->count * 1e6 / result->wall : 0.0;
+
+    printf("%-22s %6d %5d %10.1f   %7.2f %7.2f %7.2f   %7.2f %7.2f %7.2f\n",
+           result->name, result->count, result->failed, rate,
+           percentile_ms(result->to_main, result->count, 50),
+           percentile_ms(result->to_main, result->count, 95),
+           percentile_ms(result->to_main, result->count, 99),
+           percentile_ms(result->to_exit, result->count, 50),
+           percentile_ms(result->to_exit, result->count, 95),
+           percentile_ms(result->to_exit, result->count, 99));
+}
+
+static void release(Result *result)
+{
+    free(result->to_main);
+    free(result->to_exit);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = 100;
+    int concurrency = 8;
+
+    static const struct option longopts[] = {
+        { "invoker",     required_argument, NULL, 'i' },
+        { "booster",     required_argument, NULL, 'b' },
+        { "app",         required_argument, NULL, 'a' },
+        { "app-pie",     required_argument, NULL, 'e' },
+        { "count",       required_argument, NULL, 'n' },
+        { "concurrency", required_argument, NULL, 'c' },
+        { "verbose",     no_argument,       NULL, 'v' },
+        { "help",        no_argument,       NULL, 'h' },
+        { 0, 0, 0, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "i:b:a:e:n:c:vh", longopts, NULL)) != -1) {
+        switch (opt) {
+        case 'i': g_invoker = optarg; break;
+        case 'b': g_booster = optarg; break;
+        case 'a': g_app = optarg; break;
+        case 'e': g_app_pie = optarg; break;
+        case 'n': count = atoi(optarg); break;
+        case 'c': concurrency = atoi(optarg); break;
+        case 'v': g_verbose = true; break;
+        case 'h': usage(EXIT_SUCCESS); break;
+        default:  usage(EXIT_FAILURE); break;
+        }
+    }
+
+    if (!g_invoker || !g_booster || !g_app || !g_app_pie || count < 1 || concurrency < 1) {
+        fprintf(stderr, "launch-benchmark: missing or invalid arguments\n");
+        usage(EXIT_FAILURE);
+    }
+
+    // Private runtime directory, so that the benchmark does not
+    // interfere with a launcher running in the session
+    char runtime_dir[] = "/tmp/launch-benchmark-XXXXXX";
+    if (!mkdtemp(runtime_dir)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    setenv("XDG_RUNTIME_DIR", runtime_dir, 1);
+
+    pid_t daemon_pid = start_daemon(runtime_dir, argv + optind, argc - optind);
+    if (daemon_pid == -1) {
+        nftw(runtime_dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        return EXIT_FAILURE;
+    }
+
+    // Warm up page cache and the first booster
+    Result results[4];
+    run(&results[0], "warmup", true, 1, 1);
+    release(&results[0]);
+    run(&results[0], "warmup", false, 1, 1);
+    release(&results[0]);
+
+    run(&results[0], "boosted sequential", true, count, 1);
+    run(&results[1], "boosted concurrent", true, count, concurrency);
+
+    // Boosted results are meaningless if the launcher went away on the way
+    if (daemon_exited(daemon_pid)) {
+        release(&results[0]);
+        release(&results[1]);
+        nftw(runtime_dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        return EXIT_FAILURE;
+    }
+
+    run(&results[2], "execve sequential", false, count, 1);
+    run(&results[3], "execve concurrent", false, count, concurrency);
+
+    stop_daemon(daemon_pid);
+    nftw(runtime_dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    printf("\n%d launches per run, concurrency %d\n\n", count, concurrency);
+    printf("%-22s %6s %5s %10s   %-23s   %-23s\n",
+           "", "", "", "", "time to main (ms)", "time to exit (ms)");
+    printf("%-22s %6s %5s %10s   %7s %7s %7s   %7s %7s %7s\n",
+           "run", "ok", "fail", "launch/s", "p50", "p95", "p99", "p50", "p95", "p99");
+
+    int failed = 0;
+    for (int i = 0; i < 4; ++i) {
+        report(&results[i]);
+        failed += results[i].failed;
+        release(&results[i]);
+    }
+    printf("\n");
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
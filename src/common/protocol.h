@@ -20,38 +20,79 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-const uint32_t INVOKER_MSG_MAGIC                          = 0xb0070000;
-const uint32_t INVOKER_MSG_MAGIC_VERSION_MASK             = 0x0000ff00;
-const uint32_t INVOKER_MSG_MAGIC_VERSION                  = 0x00000300;
-const uint32_t INVOKER_MSG_MAGIC_OPTION_MASK              = 0x000000ff;
-const uint32_t INVOKER_MSG_MAGIC_OPTION_WAIT              = 0x00000001;
-const uint32_t INVOKER_MSG_MAGIC_OPTION_DLOPEN_GLOBAL     = 0x00000002;
-const uint32_t INVOKER_MSG_MAGIC_OPTION_DLOPEN_DEEP       = 0x00000004;
-const uint32_t INVOKER_MSG_MAGIC_OPTION_SINGLE_INSTANCE   = 0x00000008;
+static const uint32_t INVOKER_MSG_MAGIC                          = 0xb0070000;
+static const uint32_t INVOKER_MSG_MAGIC_VERSION_MASK             = 0x0000ff00;
+static const uint32_t INVOKER_MSG_MAGIC_VERSION                  = 0x00000400;
+/* Version 0x300: every field is written separately, I/O descriptors
+ * are sent with a separate sendmsg() after INVOKER_MSG_IO.
+ * Version 0x400: magic is followed by payload length and the whole
+ * request, descriptors are attached to the same sendmsg().
+ */
+static const uint32_t INVOKER_MSG_MAGIC_VERSION_UNFRAMED         = 0x00000300;
+static const uint32_t INVOKER_MSG_MAGIC_OPTION_MASK              = 0x000000ff;
+static const uint32_t INVOKER_MSG_MAGIC_OPTION_WAIT              = 0x00000001;
+static const uint32_t INVOKER_MSG_MAGIC_OPTION_DLOPEN_GLOBAL     = 0x00000002;
+static const uint32_t INVOKER_MSG_MAGIC_OPTION_DLOPEN_DEEP       = 0x00000004;
+static const uint32_t INVOKER_MSG_MAGIC_OPTION_SINGLE_INSTANCE   = 0x00000008;
 /* 0x00000010 was INVOKER_MSG_MAGIC_OPTION_SPLASH_SCREEN */
-const uint32_t INVOKER_MSG_MAGIC_OPTION_OOM_ADJ_DISABLE   = 0x00000020;
+static const uint32_t INVOKER_MSG_MAGIC_OPTION_OOM_ADJ_DISABLE   = 0x00000020;
 /* 0x00000040 was INVOKER_MSG_MAGIC_OPTION_LANDSCAPE_SPLASH_SCREEN */
+/* Sent by the launch client library: the peer is a long-lived process
+ * that launched the application in-process, it must never be signalled.
+ */
+static const uint32_t INVOKER_MSG_MAGIC_OPTION_CLIENT_LIBRARY    = 0x00000080;
 
 
-const uint32_t INVOKER_MSG_MASK               = 0xffff0000;
-
-const uint32_t INVOKER_MSG_NAME               = 0x5a5e0000;
-const uint32_t INVOKER_MSG_EXEC               = 0xe8ec0000;
-const uint32_t INVOKER_MSG_ARGS               = 0xa4650000;
-const uint32_t INVOKER_MSG_ENV                = 0xe5710000;
-const uint32_t INVOKER_MSG_PRIO               = 0xa1ce0000;
-const uint32_t INVOKER_MSG_DELAY              = 0xb2de0012;
-const uint32_t INVOKER_MSG_IDS                = 0xb2df4000;
-const uint32_t INVOKER_MSG_IO                 = 0x10fd0000;
-const uint32_t INVOKER_MSG_END                = 0xdead0000;
-const uint32_t INVOKER_MSG_PID                = 0x1d1d0000;
-const uint32_t INVOKER_MSG_SPLASH             = 0x5b1a0000;
-const uint32_t INVOKER_MSG_LANDSCAPE_SPLASH   = 0x5b120000;
-const uint32_t INVOKER_MSG_EXIT               = 0xe4170000;
-const uint32_t INVOKER_MSG_ACK                = 0x600d0000;
+static const uint32_t INVOKER_MSG_MASK               = 0xffff0000;
+
+static const uint32_t INVOKER_MSG_NAME               = 0x5a5e0000;
+static const uint32_t INVOKER_MSG_EXEC               = 0xe8ec0000;
+static const uint32_t INVOKER_MSG_ARGS               = 0xa4650000;
+static const uint32_t INVOKER_MSG_ENV                = 0xe5710000;
+static const uint32_t INVOKER_MSG_PRIO               = 0xa1ce0000;
+static const uint32_t INVOKER_MSG_DELAY              = 0xb2de0012;
+static const uint32_t INVOKER_MSG_IDS                = 0xb2df4000;
+static const uint32_t INVOKER_MSG_IO                 = 0x10fd0000;
+static const uint32_t INVOKER_MSG_END                = 0xdead0000;
+static const uint32_t INVOKER_MSG_PID                = 0x1d1d0000;
+static const uint32_t INVOKER_MSG_SPLASH             = 0x5b1a0000;
+static const uint32_t INVOKER_MSG_LANDSCAPE_SPLASH   = 0x5b120000;
+static const uint32_t INVOKER_MSG_EXIT               = 0xe4170000;
+static const uint32_t INVOKER_MSG_ACK                = 0x600d0000;
+/* Launch id, invoker start and connect times. Each value is
+ * 64 bits sent as low and high words, times are CLOCK_MONOTONIC
+ * microseconds.
+ */
+static const uint32_t INVOKER_MSG_TRACE              = 0x7ace0000;
+
+/* Variables that differ from the environment baseline published by
+ * the launcher in <socket>.env: digest of that file (low and high
+ * word), variable count and the variables.
+ */
+static const uint32_t INVOKER_MSG_ENV_DELTA          = 0xe5720000;
+/* Reply to a delta with an unknown digest instead of ACK: the invoker
+ * sends a new frame with the full environment (INVOKER_MSG_ENV).
+ */
+static const uint32_t INVOKER_MSG_ENV_RESEND         = 0xe5730000;
+
+// Upper limit for framed request payload length
+static const uint32_t INVOKER_MSG_FRAME_MAX          = 0x00400000;
+
+// Digest of the environment baseline file, 64-bit FNV-1a
+static inline uint64_t invoker_env_digest(const char *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
 // not used (Harmattan security stuff)
-// const uint32_t INVOKER_MSG_BAD_CREDS          = 0x60035800;
+// static const uint32_t INVOKER_MSG_BAD_CREDS          = 0x60035800;
 
 #endif // PROTOCOL_H
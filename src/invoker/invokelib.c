@@ -21,22 +21,33 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "report.h"
+#include "protocol.h"
 #include "invokelib.h"
 
-static void invoke_send_or_die(int fd, const void *data, size_t size)
+static void invoke_die_write_failure(void)
 {
-    if (write(fd, data, size) != (ssize_t)size) {
-        const char m[] = "*** socket write failure, terminating\n";
-        if (write(STDERR_FILENO, m, sizeof m - 1) == -1) {
-            // dontcare
-        }
-        _exit(EXIT_FAILURE);
+    const char m[] = "*** socket write failure, terminating\n";
+    if (write(STDERR_FILENO, m, sizeof m - 1) == -1) {
+        // dontcare
     }
+    _exit(EXIT_FAILURE);
+}
+
+static void invoke_send_or_die(int fd, const void *data, size_t size)
+{
+    if (write(fd, data, size) != (ssize_t)size)
+        invoke_die_write_failure();
 }
 
 void invoke_send_msg(int fd, uint32_t msg)
@@ -71,6 +82,35 @@ bool invoke_recv_msg(int fd, uint32_t *msg)
     }
 }
 
+bool invoke_recv_msgs(int fd, uint32_t *msgs, int count)
+{
+    char *pos = (char *)msgs;
+    size_t todo = count * sizeof *msgs;
+
+    while (todo > 0) {
+        ssize_t numRead = read(fd, pos, todo);
+        if (numRead == -1 && errno == EINTR)
+            continue;
+        if (numRead <= 0) {
+            // Callers tell timeouts apart by errno, keep it over logging
+            int saved_errno = numRead == -1 ? errno : ECONNRESET;
+            if (numRead == -1)
+                debug("%s: Error reading message: %m\n", __FUNCTION__);
+            else
+                debug("%s: Error: unexpected end-of-file \n", __FUNCTION__);
+            memset(msgs, 0, count * sizeof *msgs);
+            errno = saved_errno;
+            return false;
+        }
+        pos += numRead;
+        todo -= numRead;
+    }
+
+    for (int i = 0; i < count; ++i)
+        debug("%s: %08x\n", __FUNCTION__, msgs[i]);
+    return true;
+}
+
 void invoke_send_str(int fd, const char *str)
 {
     if (!str)
@@ -85,3 +125,308 @@ void invoke_send_str(int fd, const char *str)
     /* Send the string. */
     invoke_send_or_die(fd, str, size);
 }
+
+static void invoke_frame_append(invoke_frame_t *frame, const void *data, size_t size)
+{
+    if (frame->failed)
+        return;
+
+    if (frame->used + size > frame->size) {
+        size_t want = frame->size ? frame->size : 4096;
+        while (want < frame->used + size)
+            want *= 2;
+        char *data = realloc(frame->data, want);
+        if (!data) {
+            /* Reported when the frame is sent */
+            frame->failed = true;
+            return;
+        }
+        frame->data = data;
+        frame->size = want;
+    }
+    memcpy(frame->data + frame->used, data, size);
+    frame->used += size;
+}
+
+void invoke_frame_init(invoke_frame_t *frame, uint32_t magic)
+{
+    frame->data = NULL;
+    frame->used = 0;
+    frame->size = 0;
+    frame->failed = false;
+
+    /* Payload length gets filled in by invoke_frame_send() */
+    uint32_t length = 0;
+    debug("%s: %08x\n", __FUNCTION__, magic);
+    invoke_frame_append(frame, &magic, sizeof magic);
+    invoke_frame_append(frame, &length, sizeof length);
+}
+
+void invoke_frame_msg(invoke_frame_t *frame, uint32_t msg)
+{
+    debug("%s: %08x\n", __FUNCTION__, msg);
+    invoke_frame_append(frame, &msg, sizeof msg);
+}
+
+void invoke_frame_str(invoke_frame_t *frame, const char *str)
+{
+    if (!str)
+        str = "";
+    uint32_t size = strlen(str) + 1;
+
+    debug("%s: '%s'\n", __FUNCTION__, str);
+    invoke_frame_append(frame, &size, sizeof size);
+    invoke_frame_append(frame, str, size);
+}
+
+bool invoke_frame_send(int fd, invoke_frame_t *frame, const int *fds, int count)
+{
+    if (frame->failed) {
+        error("Out of memory while building launch request\n");
+        return false;
+    }
+
+    const size_t header = 2 * sizeof(uint32_t);
+    uint32_t length = frame->used - header;
+    memcpy(frame->data + sizeof(uint32_t), &length, sizeof length);
+
+    struct iovec iov;
+    iov.iov_base = frame->data;
+    iov.iov_len = frame->used;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    /* The descriptors travel with the first byte of the frame */
+    char buf[CMSG_SPACE(sizeof(int) * 3)];
+    if (count > 0 && count <= 3) {
+        msg.msg_control = buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    }
+
+    debug("%s: %zu bytes\n", __FUNCTION__, frame->used);
+
+    size_t done = 0;
+    while (done < frame->used) {
+        ssize_t rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0) {
+            int saved_errno = rc == -1 ? errno : EIO;
+            error("socket write failure: %m\n");
+            errno = saved_errno;
+            return false;
+        }
+
+        /* Large requests may need several calls */
+        done += rc;
+        iov.iov_base = frame->data + done;
+        iov.iov_len = frame->used - done;
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+    }
+    return true;
+}
+
+void invoke_frame_free(invoke_frame_t *frame)
+{
+    free(frame->data);
+    frame->data = NULL;
+    frame->used = 0;
+    frame->size = 0;
+    frame->failed = false;
+}
+
+static void invoke_frame_u64(invoke_frame_t *frame, uint64_t value)
+{
+    invoke_frame_msg(frame, (uint32_t)value);
+    invoke_frame_msg(frame, (uint32_t)(value >> 32));
+}
+
+void invoke_frame_env(invoke_frame_t *frame, char **envp)
+{
+    uint32_t n_vars;
+
+    // Count environment variables.
+    for (n_vars = 0; envp[n_vars] != NULL; n_vars++) ;
+
+    invoke_frame_msg(frame, INVOKER_MSG_ENV);
+    invoke_frame_msg(frame, n_vars);
+
+    for (uint32_t i = 0; i < n_vars; i++)
+        invoke_frame_str(frame, envp[i]);
+}
+
+// Environment baseline: NUL terminated NAME=VALUE strings
+typedef struct
+{
+    char     *data;
+    char    **vars;
+    size_t    count;
+    uint64_t  digest;
+} env_baseline_t;
+
+static int env_compare(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void invoke_free_env_baseline(env_baseline_t *base)
+{
+    free(base->vars);
+    free(base->data);
+}
+
+// Reads the environment baseline of the connected booster
+static bool invoke_load_env_baseline(env_baseline_t *base, const char *path)
+{
+    memset(base, 0, sizeof *base);
+
+    if (!path || !*path)
+        return false;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= INVOKER_MSG_FRAME_MAX) {
+        size = st.st_size;
+        base->data = malloc(size);
+        if (base->data && read(fd, base->data, size) != (ssize_t)size)
+            size = 0;
+    }
+    close(fd);
+
+    if (!base->data || size == 0 || base->data[size - 1] != '\0')
+        goto FAIL;
+
+    for (size_t i = 0; i < size; i++)
+        if (base->data[i] == '\0')
+            base->count++;
+
+    if (!(base->vars = malloc(base->count * sizeof *base->vars)))
+        goto FAIL;
+
+    for (size_t i = 0, n = 0; n < base->count; n++) {
+        base->vars[n] = base->data + i;
+        i += strlen(base->data + i) + 1;
+    }
+
+    qsort(base->vars, base->count, sizeof *base->vars, env_compare);
+    base->digest = invoker_env_digest(base->data, size);
+    return true;
+
+FAIL:
+    warning("ignoring environment baseline %s\n", path);
+    invoke_free_env_baseline(base);
+    return false;
+}
+
+void invoke_frame_env_delta(invoke_frame_t *frame, char **envp, const char *baseline_path)
+{
+    env_baseline_t base;
+    if (!invoke_load_env_baseline(&base, baseline_path)) {
+        invoke_frame_env(frame, envp);
+        return;
+    }
+
+    invoke_frame_msg(frame, INVOKER_MSG_ENV_DELTA);
+    invoke_frame_u64(frame, base.digest);
+
+    // Variable count is filled in after the variables
+    size_t count_offset = frame->used;
+    uint32_t n_vars = 0;
+    invoke_frame_msg(frame, n_vars);
+
+    for (int i = 0; envp[i] != NULL; i++) {
+        if (!bsearch(&envp[i], base.vars, base.count, sizeof *base.vars, env_compare)) {
+            invoke_frame_str(frame, envp[i]);
+            n_vars++;
+        }
+    }
+    if (!frame->failed)
+        memcpy(frame->data + count_offset, &n_vars, sizeof n_vars);
+
+    info("environment delta: %u variables\n", n_vars);
+    invoke_free_env_baseline(&base);
+}
+
+bool invoke_socket_path(char *path, size_t size, const char *app_type, const char *app_name)
+{
+    /* Sanity check args */
+    if (!app_type || !*app_type || strchr(app_type, '/'))
+        return false;
+    if (app_name && strchr(app_name, '/'))
+        return false;
+
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (!runtimeDir || !*runtimeDir) {
+        error("XDG_RUNTIME_DIR is not defined.\n");
+        return false;
+    }
+
+    int length;
+    if (app_name)
+        length = snprintf(path, size, "%s/mapplauncherd/_%s/%s/socket",
+                          runtimeDir, app_name, app_type);
+    else
+        length = snprintf(path, size, "%s/mapplauncherd/%s",
+                          runtimeDir, app_type);
+
+    if (length <= 0 || (size_t)length >= size) {
+        if (app_name)
+            error("Invalid booster type: %s / application: %s\n",
+                  app_type, app_name);
+        else
+            error("Invalid booster type: %s\n", app_type);
+        return false;
+    }
+    return true;
+}
+
+int invoke_connect_any(const char *types, const char *app_name,
+                       invoke_connect_cb connect_cb, void *user_data, bool *tried_session)
+{
+    static const char delim[] = ", \t";
+
+    *tried_session = false;
+
+    char *list = strdup(types);
+    if (!list)
+        return -1;
+
+    int fd = -1;
+    char *save = NULL;
+    for (char *type = strtok_r(list, delim, &save); type; type = strtok_r(NULL, delim, &save)) {
+        if (!strcmp(type, BOOSTER_SESSION)) {
+            *tried_session = true;
+            fd = connect_cb(type, NULL, user_data);
+            break;
+        }
+    }
+
+    if (!*tried_session) {
+        bool tried_generic = false;
+        strcpy(list, types);
+        for (char *type = strtok_r(list, delim, &save); type && fd == -1; type = strtok_r(NULL, delim, &save)) {
+            if (!strcmp(type, BOOSTER_GENERIC))
+                tried_generic = true;
+            fd = connect_cb(type, app_name, user_data);
+        }
+        if (fd == -1 && !tried_generic)
+            fd = connect_cb(BOOSTER_GENERIC, app_name, user_data);
+    }
+
+    free(list);
+    return fd;
+}
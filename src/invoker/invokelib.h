@@ -22,13 +22,76 @@
 #ifndef INVOKELIB_H
 #define INVOKELIB_H
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+
+#define BOOSTER_SESSION "silica-session"
+#define BOOSTER_GENERIC "generic"
+
+/* Placeholder value used for regular boosters (that are not
+ * sandboxed application boosters).
+ */
+#define UNDEFINED_APPLICATION "default"
+
+// Delay before a new booster is started. This will
+// be sent to the launcher daemon.
+static const unsigned int RESPAWN_DELAY     = 1;
+static const unsigned int MIN_RESPAWN_DELAY = 0;
+static const unsigned int MAX_RESPAWN_DELAY = 10;
 
 void invoke_send_msg(int fd, uint32_t msg);
 bool invoke_recv_msg(int fd, uint32_t *msg);
+bool invoke_recv_msgs(int fd, uint32_t *msgs, int count);
 
 void invoke_send_str(int fd, const char *str);
 
+/* Launch request that is collected in memory and then
+ * sent to the booster with a single sendmsg() call.
+ *
+ * Layout: magic, payload length, action records. The
+ * records use the same encoding as the unframed protocol.
+ */
+typedef struct invoke_frame_t
+{
+    char   *data;
+    size_t  used;
+    size_t  size;
+    bool    failed;
+} invoke_frame_t;
+
+void invoke_frame_init(invoke_frame_t *frame, uint32_t magic);
+void invoke_frame_msg(invoke_frame_t *frame, uint32_t msg);
+void invoke_frame_str(invoke_frame_t *frame, const char *str);
+bool invoke_frame_send(int fd, invoke_frame_t *frame, const int *fds, int count);
+void invoke_frame_free(invoke_frame_t *frame);
+
+/* Environment of the launched process, either all of envp or the
+ * variables that differ from the baseline the booster published
+ * at baseline_path.
+ */
+void invoke_frame_env(invoke_frame_t *frame, char **envp);
+void invoke_frame_env_delta(invoke_frame_t *frame, char **envp, const char *baseline_path);
+
+/* Socket path of a booster type, application specific if app_name
+ * is not NULL. Returns false if the path can't be built.
+ */
+bool invoke_socket_path(char *path, size_t size, const char *app_type, const char *app_name);
+
+/* Connects to the first available booster of a comma separated list
+ * of types, returns the descriptor connect_cb returned or -1.
+ *
+ * The session booster is never application specific and mutually
+ * exclusive with all other choices: if listed, it is the only one
+ * tried and *tried_session is set. Otherwise the types are tried in
+ * order for app_name, falling back to the generic booster of the same
+ * application, so that the application vs UNDEFINED_APPLICATION
+ * boundary is never crossed.
+ */
+typedef int (*invoke_connect_cb)(const char *app_type, const char *app_name, void *user_data);
+int invoke_connect_any(const char *types, const char *app_name,
+                       invoke_connect_cb connect_cb, void *user_data, bool *tried_session);
+
 // Existence of the test mode control file is checked
 // to enable test mode.
 #define TEST_MODE_CONTROL_FILE   "/root/.itm"
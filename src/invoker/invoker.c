@@ -26,7 +26,6 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <signal.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -49,95 +48,19 @@
 #include "invokelib.h"
 #include "search.h"
 
-#define BOOSTER_SESSION "silica-session"
-#define BOOSTER_GENERIC "generic"
-
-/* Placeholder value used for regular boosters (that are not
- * sandboxed application boosters).
- */
-#define UNDEFINED_APPLICATION "default"
-
 /* Setting VERBOSE_SIGNALS to non-zero value logs receiving of
  * async-signals - which is useful only when actively debugging
  * booster / invoker interoperation.
  */
 #define VERBOSE_SIGNALS 0
 
-// Utility functions
-static char *strip(char *str)
-{
-    if (str) {
-        char *dst = str;
-        char *src = str;
-        while (*src && isspace(*src))
-            ++src;
-        for (;;) {
-            while (*src && !isspace(*src))
-                *dst++ = *src++;
-            while (*src && isspace(*src))
-                ++src;
-            if (!*src)
-                break;
-            *dst++ = ' ';
-        }
-        *dst = 0;
-    }
-    return str;
-}
-
-static char *slice(const char *pos, const char **ppos, const char *delim)
-{
-    char *tok = NULL;
-    if (pos) {
-        const char *beg = pos;
-        while (*pos && !strchr(delim, *pos))
-            ++pos;
-        tok = strndup(beg, pos - beg);
-        if (*pos)
-            ++pos;
-    }
-    if (ppos)
-        *ppos = pos;
-    return tok;
-}
-
-static char **split(const char *str, const char *delim)
-{
-    char **arr = NULL;
-    if (str) {
-        /* Upper limit for token count is number of delimeters + one */
-        int n = 1;
-        for (const char *pos = str; *pos; ++pos)
-            if (strchr(delim, *pos))
-                ++n;
-
-        /* Upper limit for required array size is token count + one */
-        arr = calloc(n + 1, sizeof *arr);
-
-        /* Fill in the array */
-        int i = 0;
-        while (*str) {
-            char *tok = slice(str, &str, delim);
-            if (*strip(tok))
-                arr[i++] = tok;
-            else
-                free(tok);
-        }
-        arr[i] = NULL;
-    }
-    return arr;
-}
-
 // Delay before exit.
 static const unsigned int EXIT_DELAY     = 0;
 static const unsigned int MIN_EXIT_DELAY = 1;
 static const unsigned int MAX_EXIT_DELAY = 86400;
 
-// Delay before a new booster is started. This will
-// be sent to the launcher daemon.
-static const unsigned int RESPAWN_DELAY     = 1;
-static const unsigned int MIN_RESPAWN_DELAY = 0;
-static const unsigned int MAX_RESPAWN_DELAY = 10;
+// Upper limit (ms) for waiting on a booster that is not ready.
+static const unsigned int MAX_WAIT = 60000;
 
 static const unsigned char EXIT_STATUS_APPLICATION_NOT_FOUND = 0x7f;
 
@@ -147,6 +70,13 @@ extern char ** environ;
 // pid of the invoked process
 static pid_t g_invoked_pid = -1;
 
+// Launch timeline: invoker start and connect times
+static uint64_t g_start_usec = 0;
+static uint64_t g_connect_usec = 0;
+
+// Environment baseline published next to the booster socket
+static char g_env_path[PATH_MAX] = "";
+
 static void sigs_restore(void);
 static void sigs_init(void);
 
@@ -222,6 +152,14 @@ static unsigned timestamp(void)
             (unsigned)(ts.tv_nsec / (1000 * 1000u)));
 }
 
+// CLOCK_MONOTONIC time in microseconds, same time base as in boosters
+static uint64_t timestamp_usec(void)
+{
+    struct timespec ts = { 0, 0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
 static bool shutdown_socket(int socket_fd)
 {
     bool disconnected = false;
@@ -330,66 +268,66 @@ EXIT:
     return;
 }
 
-// Receive ACK
-static bool invoke_recv_ack(int fd)
+/* Returns time (ms) until a booster listening at socket_path is expected
+ * to accept launches preloaded, as published by the launcher next to
+ * the socket. 0 if it is ready or nothing is known.
+ */
+static unsigned invoker_ready_in(const char *socket_path)
 {
-    uint32_t action;
-
-    invoke_recv_msg(fd, &action);
-
-    if (action != INVOKER_MSG_ACK)
-    {
-        die(1, "Received wrong ack (%08x)\n", action);
+    char path[PATH_MAX];
+    int length = snprintf(path, sizeof path, "%s.ready", socket_path);
+    if (length <= 0 || length >= (int)sizeof path)
+        return 0;
+
+    FILE *file = fopen(path, "re");
+    if (!file)
+        return 0;
+
+    char state[16];
+    unsigned value = 0;
+    unsigned left = 0;
+    if (fscanf(file, "%15s %u", state, &value) == 2) {
+        if (!strcmp(state, "preloading")) {
+            // Time stamp in the clock shared with the launcher
+            int diff = (int)(value - timestamp());
+            left = diff > 0 ? (unsigned)diff : 0;
+        } else if (!strcmp(state, "idle")) {
+            // No booster on the way, time preloading takes
+            left = value;
+        }
     }
-
-    return true;
+    fclose(file);
+    return left;
 }
 
-// Inits a socket connection for the given application type
-static int invoker_init(const char *app_type, const char *app_name)
+/* Inits a socket connection for the given application type. With
+ * max_wait >= 0 a booster that is not expected to be ready within
+ * max_wait ms is skipped.
+ */
+static int invoker_init(const char *app_type, const char *app_name, int max_wait)
 {
     info("try type=%s app=%s ...", app_type, app_name);
 
     bool connected = false;
     int fd = -1;
 
-    /* Sanity check args */
-    if (!app_type || strchr(app_type, '/'))
-        goto EXIT;
-    if (app_name && strchr(app_name, '/'))
-        goto EXIT;
-
-    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
-    if (!runtimeDir || !*runtimeDir) {
-        error("XDG_RUNTIME_DIR is not defined.\n");
+    struct sockaddr_un sun = {
+        .sun_family = AF_UNIX,
+    };
+    if (!invoke_socket_path(sun.sun_path, sizeof sun.sun_path, app_type, app_name))
         goto EXIT;
-    }
 
     if ((fd = socket(PF_UNIX, SOCK_STREAM, 0)) == -1) {
         error("Failed to create socket: %m\n");
         goto EXIT;
     }
 
-    struct sockaddr_un sun = {
-        .sun_family = AF_UNIX,
-    };
-    int maxSize = sizeof(sun.sun_path);
-    int length;
-
-    if (app_name)
-        length = snprintf(sun.sun_path, maxSize, "%s/mapplauncherd/_%s/%s/socket",
-                          runtimeDir, app_name, app_type);
-    else
-        length = snprintf(sun.sun_path, maxSize, "%s/mapplauncherd/%s",
-                          runtimeDir, app_type);
-
-    if (length <= 0 || length >= maxSize) {
-        if (app_name)
-            error("Invalid booster type: %s / application: %s\n",
-                  app_type, app_name);
-        else
-            error("Invalid booster type: %s\n", app_type);
-        goto EXIT;
+    if (max_wait >= 0) {
+        unsigned left = invoker_ready_in(sun.sun_path);
+        if (left > (unsigned)max_wait) {
+            info("booster %s is ready in %u ms, not waiting\n", sun.sun_path, left);
+            goto EXIT;
+        }
     }
 
     if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
@@ -398,7 +336,9 @@ static int invoker_init(const char *app_type, const char *app_name)
         goto EXIT;
     }
 
+    g_connect_usec = timestamp_usec();
     info("connected to: %s\n", sun.sun_path);
+    snprintf(g_env_path, sizeof g_env_path, "%s.env", sun.sun_path);
     connected = true;
 
 EXIT:
@@ -407,26 +347,6 @@ EXIT:
     return fd;
 }
 
-// Receives pid of the invoked process.
-// Invoker doesn't know it, because the launcher daemon
-// is the one who forks.
-static uint32_t invoker_recv_pid(int fd)
-{
-    // Receive action.
-    uint32_t action;
-    invoke_recv_msg(fd, &action);
-    if (action != INVOKER_MSG_PID)
-        die(1, "Received a bad message id (%08x)\n", action);
-
-    // Receive pid.
-    uint32_t pid = 0;
-    invoke_recv_msg(fd, &pid);
-    if (pid == 0)
-        die(1, "Received a zero pid \n");
-
-    return pid;
-}
-
 // Receives exit status of the invoked process
 static bool invoker_recv_exit(int fd, int* status)
 {
@@ -451,123 +371,152 @@ static bool invoker_recv_exit(int fd, int* status)
     return res;
 }
 
-// Sends magic number / protocol version
-static void invoker_send_magic(int fd, uint32_t options)
+// Starts launch request with magic number / protocol version
+static void invoker_pack_magic(invoke_frame_t *frame, uint32_t options)
 {
-    // Send magic.
-    invoke_send_msg(fd, INVOKER_MSG_MAGIC | INVOKER_MSG_MAGIC_VERSION | options);
+    invoke_frame_init(frame, INVOKER_MSG_MAGIC | INVOKER_MSG_MAGIC_VERSION | options);
 }
 
-// Sends the process name to be invoked.
-static void invoker_send_name(int fd, const char *name)
+// Adds the process name to be invoked.
+static void invoker_pack_name(invoke_frame_t *frame, const char *name)
 {
-    invoke_send_msg(fd, INVOKER_MSG_NAME);
-    invoke_send_str(fd, name);
+    invoke_frame_msg(frame, INVOKER_MSG_NAME);
+    invoke_frame_str(frame, name);
 }
 
-static void invoker_send_exec(int fd, char *exec)
+static void invoker_pack_exec(invoke_frame_t *frame, char *exec)
 {
-    invoke_send_msg(fd, INVOKER_MSG_EXEC);
-    invoke_send_str(fd, exec);
+    invoke_frame_msg(frame, INVOKER_MSG_EXEC);
+    invoke_frame_str(frame, exec);
 }
 
-static void invoker_send_args(int fd, int argc, char **argv)
+static void invoker_pack_args(invoke_frame_t *frame, int argc, char **argv)
 {
     int i;
 
-    invoke_send_msg(fd, INVOKER_MSG_ARGS);
-    invoke_send_msg(fd, argc);
+    invoke_frame_msg(frame, INVOKER_MSG_ARGS);
+    invoke_frame_msg(frame, argc);
     for (i = 0; i < argc; i++)
     {
         info("param %d %s \n", i, argv[i]);
-        invoke_send_str(fd, argv[i]);
+        invoke_frame_str(frame, argv[i]);
     }
 }
 
-static void invoker_send_prio(int fd, int prio)
+static void invoker_pack_prio(invoke_frame_t *frame, int prio)
 {
-    invoke_send_msg(fd, INVOKER_MSG_PRIO);
-    invoke_send_msg(fd, prio);
+    invoke_frame_msg(frame, INVOKER_MSG_PRIO);
+    invoke_frame_msg(frame, prio);
 }
 
-// Sends booster respawn delay
-static void invoker_send_delay(int fd, int delay)
+// Adds booster respawn delay
+static void invoker_pack_delay(invoke_frame_t *frame, int delay)
 {
-    invoke_send_msg(fd, INVOKER_MSG_DELAY);
-    invoke_send_msg(fd, delay);
+    invoke_frame_msg(frame, INVOKER_MSG_DELAY);
+    invoke_frame_msg(frame, delay);
 }
 
-// Sends UID and GID
-static void invoker_send_ids(int fd, int uid, int gid)
+static void invoker_pack_u64(invoke_frame_t *frame, uint64_t value)
 {
-    invoke_send_msg(fd, INVOKER_MSG_IDS);
-    invoke_send_msg(fd, uid);
-    invoke_send_msg(fd, gid);
+    invoke_frame_msg(frame, (uint32_t)value);
+    invoke_frame_msg(frame, (uint32_t)(value >> 32));
 }
 
-// Sends the environment variables
-static void invoker_send_env(int fd)
+// Adds launch id and timestamps for the launch timeline
+static void invoker_pack_trace(invoke_frame_t *frame)
 {
-    int i, n_vars;
+    uint64_t launch_id = ((uint64_t)getpid() << 32) ^ g_start_usec;
+    info("launch id %016llx\n", (unsigned long long)launch_id);
 
-    // Count environment variables.
-    for (n_vars = 0; environ[n_vars] != NULL; n_vars++) ;
+    invoke_frame_msg(frame, INVOKER_MSG_TRACE);
+    invoker_pack_u64(frame, launch_id);
+    invoker_pack_u64(frame, g_start_usec);
+    invoker_pack_u64(frame, g_connect_usec);
+}
 
-    invoke_send_msg(fd, INVOKER_MSG_ENV);
-    invoke_send_msg(fd, n_vars);
+// Adds UID and GID
+static void invoker_pack_ids(invoke_frame_t *frame, int uid, int gid)
+{
+    invoke_frame_msg(frame, INVOKER_MSG_IDS);
+    invoke_frame_msg(frame, uid);
+    invoke_frame_msg(frame, gid);
+}
 
-    for (i = 0; i < n_vars; i++)
-    {
-        invoke_send_str(fd, environ[i]);
-    }
+// Adds the environment variables
+static void invoker_pack_env(invoke_frame_t *frame)
+{
+    invoke_frame_env(frame, environ);
+}
 
-    return;
+// Adds the variables that differ from the environment baseline, or
+// all of them if the booster has not published a baseline
+static void invoker_pack_env_delta(invoke_frame_t *frame)
+{
+    invoke_frame_env_delta(frame, environ, g_env_path);
 }
 
-// Sends I/O descriptors
-static void invoker_send_io(int fd)
+// Announces I/O descriptors, they are attached to the frame when sent
+static void invoker_pack_io(invoke_frame_t *frame)
 {
-    struct msghdr msg;
-    struct cmsghdr *cmsg = NULL;
-    int io[3] = { 0, 1, 2 };
-    char buf[CMSG_SPACE(sizeof(io))];
-    struct iovec iov;
-    int dummy;
+    invoke_frame_msg(frame, INVOKER_MSG_IO);
+}
 
-    memset(&msg, 0, sizeof(struct msghdr));
+// Adds the END message and sends the whole request, optionally with I/O descriptors
+static void invoker_send_frame(int fd, invoke_frame_t *frame, bool with_io)
+{
+    static const int io[3] = { 0, 1, 2 };
 
-    iov.iov_base = &dummy;
-    iov.iov_len = 1;
+    invoke_frame_msg(frame, INVOKER_MSG_END);
 
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control = buf;
-    msg.msg_controllen = sizeof(buf);
+    if (frame->used - 2 * sizeof(uint32_t) > INVOKER_MSG_FRAME_MAX)
+        die(1, "Launch request is too large (%zu bytes)\n", frame->used);
 
-    cmsg = CMSG_FIRSTHDR(&msg);
-    cmsg->cmsg_len = CMSG_LEN(sizeof(io));
-    cmsg->cmsg_level = SOL_SOCKET;
-    cmsg->cmsg_type = SCM_RIGHTS;
+    bool sent = invoke_frame_send(fd, frame, io, with_io ? 3 : 0);
+    invoke_frame_free(frame);
+    if (!sent)
+        die(1, "Sending launch request failed\n");
+}
 
-    memcpy(CMSG_DATA(cmsg), io, sizeof(io));
+// Receives ACK. A booster that doesn't know the environment
+// baseline the delta was made against asks for all variables first.
+static void invoker_recv_ack(int fd, uint32_t options)
+{
+    uint32_t action = 0;
 
-    msg.msg_controllen = cmsg->cmsg_len;
+    invoke_recv_msg(fd, &action);
 
-    invoke_send_msg(fd, INVOKER_MSG_IO);
-    if (sendmsg(fd, &msg, 0) < 0)
+    if (action == INVOKER_MSG_ENV_RESEND)
     {
-        warning("sendmsg failed in invoker_send_io: %s \n", strerror(errno));
+        info("sending the full environment\n");
+
+        invoke_frame_t frame;
+        invoker_pack_magic(&frame, options);
+        invoker_pack_env(&frame);
+        invoker_send_frame(fd, &frame, false);
+
+        invoke_recv_msg(fd, &action);
     }
 
-    return;
+    if (action != INVOKER_MSG_ACK)
+        die(1, "Received wrong ack (%08x)\n", action);
 }
 
-// Sends the END message
-static void invoker_send_end(int fd)
+// Receives ACK followed by pid of the invoked process.
+// Invoker doesn't know the pid, because the launcher daemon
+// is the one who forks.
+static uint32_t invoker_recv_ack_pid(int fd, uint32_t options)
 {
-    invoke_send_msg(fd, INVOKER_MSG_END);
-    invoke_recv_ack(fd);
+    uint32_t msgs[2] = { 0, 0 };
 
+    invoker_recv_ack(fd, options);
+    invoke_recv_msgs(fd, msgs, 2);
+
+    if (msgs[0] != INVOKER_MSG_PID)
+        die(1, "Received a bad message id (%08x)\n", msgs[0]);
+    if (msgs[1] == 0)
+        die(1, "Received a zero pid \n");
+
+    return msgs[1];
 }
 
 // Prints the usage and exits with given status
@@ -595,8 +544,13 @@ static void usage(int status)
            "  -A, --auto-application Get application booster name from binary\n"
            "  -d, --delay SECS       After invoking sleep for SECS seconds\n"
            "                         (default %d).\n"
-           "  -r, --respawn SECS     After invoking respawn new booster after SECS seconds\n"
-           "                         (default %d, max %d).\n"
+           "  -r, --respawn SECS     After invoking let the new booster wait up to SECS\n"
+           "                         seconds for the system to calm down before\n"
+           "                         preloading (default %d, max %d).\n"
+           "  -W, --max-wait MS      Launch without boosting if no booster is expected\n"
+           "                         to be ready within MS milliseconds (max %u).\n"
+           "                         Not used with application boosters. By default\n"
+           "                         launches wait for a booster.\n"
            "  -w, --wait-term        Wait for launched process to terminate (default).\n"
            "  -n, --no-wait          Do not wait for launched process to terminate.\n"
            "  -G, --global-syms      Places symbols in the application binary and its\n"
@@ -617,7 +571,8 @@ static void usage(int status)
            "\n"
            "Example: %s --type=pisces /usr/bin/helloworld\n"
            "\n",
-           PROG_NAME_INVOKER, EXIT_DELAY, RESPAWN_DELAY, MAX_RESPAWN_DELAY, PROG_NAME_INVOKER);
+           PROG_NAME_INVOKER, EXIT_DELAY, RESPAWN_DELAY, MAX_RESPAWN_DELAY, MAX_WAIT,
+           PROG_NAME_INVOKER);
 
     exit(status);
 }
@@ -646,13 +601,12 @@ static unsigned int get_delay(char *delay_arg, char *param_name,
     return delay;
 }
 
-static int wait_for_launched_process_to_exit(int socket_fd)
+static int wait_for_launched_process_to_exit(int socket_fd, pid_t invoked_pid)
 {
     int exit_status = EXIT_FAILURE;
     int exit_signal = 0;
 
-    // coverity[tainted_string_return_content]
-    g_invoked_pid = invoker_recv_pid(socket_fd);
+    g_invoked_pid = invoked_pid;
     info("Booster's pid is %d \n ", g_invoked_pid);
 
     // Setup signal handlers
@@ -743,6 +697,7 @@ typedef struct InvokeArgs {
     const char   *desktop_file;
     char         *sandboxing_id;
     unsigned int  exit_delay;
+    int           max_wait;
 } InvokeArgs;
 
 #define INVOKE_ARGS_INIT {\
@@ -758,6 +713,7 @@ typedef struct InvokeArgs {
     .desktop_file  = NULL,\
     .sandboxing_id = NULL,\
     .exit_delay    = EXIT_DELAY,\
+    .max_wait      = -1,\
 }
 
 // "normal" invoke through a socket connection
@@ -774,21 +730,27 @@ static int invoke_remote(int socket_fd, const InvokeArgs *args)
     }
 
     // Connection with launcher process is established,
-    // send the data.
-    invoker_send_magic(socket_fd, args->magic_options);
-    invoker_send_name(socket_fd, args->prog_name);
-    invoker_send_exec(socket_fd, args->prog_argv[0]);
-    invoker_send_args(socket_fd, args->prog_argc, args->prog_argv);
-    invoker_send_prio(socket_fd, prog_prio);
-    invoker_send_delay(socket_fd, args->respawn_delay);
-    invoker_send_ids(socket_fd, getuid(), getgid());
-    invoker_send_io(socket_fd);
-    invoker_send_env(socket_fd);
-    invoker_send_end(socket_fd);
+    // collect the data and send it in one go.
+    invoke_frame_t frame;
+    invoker_pack_magic(&frame, args->magic_options);
+    invoker_pack_name(&frame, args->prog_name);
+    invoker_pack_trace(&frame);
+    invoker_pack_exec(&frame, args->prog_argv[0]);
+    invoker_pack_args(&frame, args->prog_argc, args->prog_argv);
+    invoker_pack_prio(&frame, prog_prio);
+    invoker_pack_delay(&frame, args->respawn_delay);
+    invoker_pack_ids(&frame, getuid(), getgid());
+    invoker_pack_io(&frame);
+    invoker_pack_env_delta(&frame);
+    invoker_send_frame(socket_fd, &frame, true);
 
     if (args->wait_term) {
-        exit_status = wait_for_launched_process_to_exit(socket_fd),
+        // coverity[tainted_string_return_content]
+        pid_t invoked_pid = invoker_recv_ack_pid(socket_fd, args->magic_options);
+        exit_status = wait_for_launched_process_to_exit(socket_fd, invoked_pid),
             socket_fd = -1;
+    } else {
+        invoker_recv_ack(socket_fd, args->magic_options);
     }
 
     if (socket_fd != -1)
@@ -827,6 +789,18 @@ static void invoke_fallback(const InvokeArgs *args)
     exit(EXIT_FAILURE);
 }
 
+// Connects to one booster type for invoke_connect_any()
+static int invoker_try(const char *app_type, const char *app_name, void *user_data)
+{
+    const InvokeArgs *args = user_data;
+
+    /* Not waiting for a booster is an option only if the application
+     * may be started without boosting, see invoke()
+     */
+    int max_wait = app_name && !strcmp(app_name, UNDEFINED_APPLICATION) ? args->max_wait : -1;
+    return invoker_init(app_type, app_name, max_wait);
+}
+
 // Invokes the given application
 static int invoke(InvokeArgs *args)
 {
@@ -839,39 +813,8 @@ static int invoke(InvokeArgs *args)
     /* The app can be launched with a comma delimited list of
      * booster types to attempt.
      */
-    char **types = split(args->app_type, ",");
-
-    int fd = -1;
-
-    /* Session booster is a special case:
-     * - is never going to be application specific
-     * - can use and still uses legacy socket path
-     * - mutually exclusive with all other choises
-     * - no fallbacks should be utilized
-     */
-
     bool tried_session = false;
-    for (size_t i = 0; !tried_session && types[i]; ++i) {
-        if (strcmp(types[i], BOOSTER_SESSION))
-            continue;
-        tried_session = true;
-        fd = invoker_init(types[i], NULL);
-    }
-
-    /* Application aware boosters
-     * - have fallback strategy, but it
-     * - must not cross application vs UNDEFINED_APPLICATION boundary
-     */
-    if (fd == -1 && !tried_session) {
-        bool tried_generic = false;
-        for (size_t i = 0; fd == -1 && types[i]; ++i) {
-            if (!strcmp(types[i], BOOSTER_GENERIC))
-                tried_generic = true;
-            fd = invoker_init(types[i], args->app_name);
-        }
-        if (fd == -1 && !tried_generic)
-            fd = invoker_init(BOOSTER_GENERIC, args->app_name);
-    }
+    int fd = invoke_connect_any(args->app_type, args->app_name, invoker_try, args, &tried_session);
 
     if (fd != -1) {
         /* "normal" invoke through a socket connetion */
@@ -893,15 +836,13 @@ static int invoke(InvokeArgs *args)
         status = EXIT_SUCCESS;
     }
 
-    for (int i = 0; types[i]; ++i)
-        free(types[i]);
-    free(types);
-
     return status;
 }
 
 int main(int argc, char *argv[])
 {
+    g_start_usec = timestamp_usec();
+
     InvokeArgs args = INVOKE_ARGS_INIT;
     bool auto_application = false;
     // Called with a different name (old way of using invoker) ?
@@ -928,6 +869,7 @@ int main(int argc, char *argv[])
         {"auto-application", no_argument,       NULL, 'A'},
         {"delay",            required_argument, NULL, 'd'},
         {"respawn",          required_argument, NULL, 'r'},
+        {"max-wait",         required_argument, NULL, 'W'},
         {"splash",           required_argument, NULL, 'S'}, // Legacy, ignored
         {"splash-landscape", required_argument, NULL, 'L'}, // Legacy, ignored
         {"desktop-file",     required_argument, NULL, 'F'},
@@ -940,7 +882,7 @@ int main(int argc, char *argv[])
     // The use of + for POSIXLY_CORRECT behavior is a GNU extension, but avoids polluting
     // the environment
     int opt;
-    while ((opt = getopt_long(argc, argv, "+hvcwnGDsoTd:t:a:Ar:S:L:F:I:", longopts, NULL)) != -1)
+    while ((opt = getopt_long(argc, argv, "+hvcwnGDsoTd:t:a:Ar:W:S:L:F:I:", longopts, NULL)) != -1)
     {
         switch(opt)
         {
@@ -999,6 +941,10 @@ int main(int argc, char *argv[])
                                       MIN_RESPAWN_DELAY, MAX_RESPAWN_DELAY);
             break;
 
+        case 'W':
+            args.max_wait = get_delay(optarg, "max wait", 0, MAX_WAIT);
+            break;
+
         case 's':
             args.magic_options |= INVOKER_MSG_MAGIC_OPTION_SINGLE_INSTANCE;
             break;
@@ -0,0 +1,388 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "report.h"
+#include "protocol.h"
+#include "invokelib.h"
+#include "launchclient.h"
+
+// Seconds to wait for the booster to acknowledge a request
+static const int HANDSHAKE_TIMEOUT = 10;
+
+extern char **environ;
+
+struct launch_request_t
+{
+    int             fd;
+    pid_t           pid;
+    launch_exit_cb  exit_cb;
+    void           *user_data;
+    bool            finished;
+    int             status;
+};
+
+// Booster connection with the paths derived from its socket
+typedef struct
+{
+    int   fd;
+    char  env_path[PATH_MAX];
+} launch_connection_t;
+
+// CLOCK_MONOTONIC time in microseconds, same time base as in boosters
+static uint64_t timestamp_usec(void)
+{
+    struct timespec ts = { 0, 0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void launch_init_report(void)
+{
+    /* Log to stderr of the hosting process, syslog would
+     * replace the identity the process has opened it with.
+     */
+    static bool initialized = false;
+    if (!initialized) {
+        report_set_output(report_console);
+        initialized = true;
+    }
+}
+
+// Connects to the socket of the given booster type for invoke_connect_any()
+static int launch_connect(const char *app_type, const char *app_name, void *user_data)
+{
+    launch_connection_t *conn = user_data;
+
+    info("try type=%s app=%s ...", app_type, app_name ? app_name : "");
+
+    struct sockaddr_un sun = {
+        .sun_family = AF_UNIX,
+    };
+    if (!invoke_socket_path(sun.sun_path, sizeof sun.sun_path, app_type, app_name))
+        return -1;
+
+    // Never leak the socket to other children of the hosting process
+    int fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        error("Failed to create socket: %m\n");
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+        if (errno != ENOENT)
+            warning("connect(\"%s\") failed: %m\n", sun.sun_path);
+        close(fd);
+        return -1;
+    }
+
+    info("connected to: %s\n", sun.sun_path);
+    conn->fd = fd;
+    snprintf(conn->env_path, sizeof conn->env_path, "%s.env", sun.sun_path);
+    return fd;
+}
+
+static void launch_pack_u64(invoke_frame_t *frame, uint64_t value)
+{
+    invoke_frame_msg(frame, (uint32_t)value);
+    invoke_frame_msg(frame, (uint32_t)(value >> 32));
+}
+
+static uint32_t launch_magic_options(const launch_args_t *args)
+{
+    uint32_t options = INVOKER_MSG_MAGIC_OPTION_CLIENT_LIBRARY;
+    if (args->options & LAUNCH_OPTION_WAIT)
+        options |= INVOKER_MSG_MAGIC_OPTION_WAIT;
+    if (args->options & LAUNCH_OPTION_GLOBAL_SYMS)
+        options |= INVOKER_MSG_MAGIC_OPTION_DLOPEN_GLOBAL;
+    if (args->options & LAUNCH_OPTION_DEEP_SYMS)
+        options |= INVOKER_MSG_MAGIC_OPTION_DLOPEN_DEEP;
+    if (args->options & LAUNCH_OPTION_SINGLE_INSTANCE)
+        options |= INVOKER_MSG_MAGIC_OPTION_SINGLE_INSTANCE;
+    if (args->options & LAUNCH_OPTION_KEEP_OOM_SCORE)
+        options |= INVOKER_MSG_MAGIC_OPTION_OOM_ADJ_DISABLE;
+    return options;
+}
+
+// Sends the launch request in one go
+static bool launch_send_request(const launch_connection_t *conn, const launch_args_t *args,
+                                uint32_t options, uint64_t start_usec, uint64_t connect_usec)
+{
+    // Get process priority
+    errno = 0;
+    int prio = getpriority(PRIO_PROCESS, 0);
+    if (errno && prio < 0)
+        prio = 0;
+
+    uint64_t launch_id = ((uint64_t)getpid() << 32) ^ start_usec;
+    info("launch id %016llx\n", (unsigned long long)launch_id);
+
+    invoke_frame_t frame;
+    invoke_frame_init(&frame, INVOKER_MSG_MAGIC | INVOKER_MSG_MAGIC_VERSION | options);
+
+    invoke_frame_msg(&frame, INVOKER_MSG_NAME);
+    invoke_frame_str(&frame, args->name ? args->name : args->argv[0]);
+
+    invoke_frame_msg(&frame, INVOKER_MSG_TRACE);
+    launch_pack_u64(&frame, launch_id);
+    launch_pack_u64(&frame, start_usec);
+    launch_pack_u64(&frame, connect_usec);
+
+    invoke_frame_msg(&frame, INVOKER_MSG_EXEC);
+    invoke_frame_str(&frame, args->argv[0]);
+
+    invoke_frame_msg(&frame, INVOKER_MSG_ARGS);
+    invoke_frame_msg(&frame, args->argc);
+    for (int i = 0; i < args->argc; i++)
+        invoke_frame_str(&frame, args->argv[i]);
+
+    invoke_frame_msg(&frame, INVOKER_MSG_PRIO);
+    invoke_frame_msg(&frame, prio);
+
+    invoke_frame_msg(&frame, INVOKER_MSG_DELAY);
+    invoke_frame_msg(&frame, args->respawn_delay);
+
+    invoke_frame_msg(&frame, INVOKER_MSG_IDS);
+    invoke_frame_msg(&frame, getuid());
+    invoke_frame_msg(&frame, getgid());
+
+    invoke_frame_msg(&frame, INVOKER_MSG_IO);
+    invoke_frame_env_delta(&frame, args->envp ? args->envp : environ, conn->env_path);
+    invoke_frame_msg(&frame, INVOKER_MSG_END);
+
+    bool sent = false;
+    if (frame.used - 2 * sizeof(uint32_t) > INVOKER_MSG_FRAME_MAX) {
+        error("Launch request is too large (%zu bytes)\n", frame.used);
+        errno = EMSGSIZE;
+    } else {
+        sent = invoke_frame_send(conn->fd, &frame, args->stdio, 3);
+    }
+    invoke_frame_free(&frame);
+    return sent;
+}
+
+// Receives ACK, sending the full environment first if the booster asks for it
+static bool launch_recv_ack(const launch_connection_t *conn, const launch_args_t *args,
+                            uint32_t options)
+{
+    uint32_t action = 0;
+
+    if (!invoke_recv_msgs(conn->fd, &action, 1))
+        return false;
+
+    if (action == INVOKER_MSG_ENV_RESEND) {
+        info("sending the full environment\n");
+
+        invoke_frame_t frame;
+        invoke_frame_init(&frame, INVOKER_MSG_MAGIC | INVOKER_MSG_MAGIC_VERSION | options);
+        invoke_frame_env(&frame, args->envp ? args->envp : environ);
+        invoke_frame_msg(&frame, INVOKER_MSG_END);
+        bool sent = invoke_frame_send(conn->fd, &frame, NULL, 0);
+        invoke_frame_free(&frame);
+
+        if (!sent || !invoke_recv_msgs(conn->fd, &action, 1))
+            return false;
+    }
+
+    if (action != INVOKER_MSG_ACK) {
+        error("Received wrong ack (%08x)\n", action);
+        errno = EPROTO;
+        return false;
+    }
+    return true;
+}
+
+static void launch_set_timeout(int fd, int seconds)
+{
+    struct timeval tv = { seconds, 0 };
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) == -1)
+        warning("can't set socket timeout: %m\n");
+}
+
+void launch_args_init(launch_args_t *args)
+{
+    memset(args, 0, sizeof *args);
+    args->options = LAUNCH_OPTION_WAIT;
+    args->respawn_delay = RESPAWN_DELAY;
+    for (int i = 0; i < 3; i++)
+        args->stdio[i] = i;
+}
+
+int launch_invoke(const launch_args_t *args, launch_request_t **request)
+{
+    uint64_t start_usec = timestamp_usec();
+
+    launch_init_report();
+
+    if (request)
+        *request = NULL;
+
+    if (!args->type || !args->argv || args->argc < 1 || !args->argv[0] || args->argv[0][0] != '/')
+        return -EINVAL;
+    if (args->respawn_delay > MAX_RESPAWN_DELAY)
+        return -EINVAL;
+
+    /* Dropping the request would close the connection, and the launcher
+     * terminates an application it is waiting for once that happens.
+     */
+    if ((args->options & LAUNCH_OPTION_WAIT) && !request)
+        return -EINVAL;
+
+    const char *app_name = args->application ? args->application : UNDEFINED_APPLICATION;
+    uint32_t options = launch_magic_options(args);
+
+    launch_request_t *req = NULL;
+    if (options & INVOKER_MSG_MAGIC_OPTION_WAIT) {
+        if (!(req = calloc(1, sizeof *req)))
+            return -ENOMEM;
+        req->fd = -1;
+        req->pid = -1;
+        req->exit_cb = args->exit_cb;
+        req->user_data = args->user_data;
+        req->status = EXIT_FAILURE;
+    }
+
+    launch_connection_t conn = { -1, "" };
+    bool tried_session = false;
+    if (invoke_connect_any(args->type, app_name, launch_connect, &conn, &tried_session) == -1) {
+        warning("Launch of %s failed, no booster is available.\n", args->argv[0]);
+        free(req);
+        return -ENOENT;
+    }
+
+    // Failing calls set errno, saved before anything logs
+    int saved_errno = 0;
+    launch_set_timeout(conn.fd, HANDSHAKE_TIMEOUT);
+
+    if (!launch_send_request(&conn, args, options, start_usec, timestamp_usec())) {
+        saved_errno = errno;
+        goto FAIL;
+    }
+    if (!launch_recv_ack(&conn, args, options)) {
+        saved_errno = errno;
+        goto FAIL;
+    }
+
+    if (!req) {
+        close(conn.fd);
+        return 0;
+    }
+
+    // Booster follows the ACK with the pid of the application
+    uint32_t msgs[2] = { 0, 0 };
+    if (!invoke_recv_msgs(conn.fd, msgs, 2) || msgs[0] != INVOKER_MSG_PID || msgs[1] == 0) {
+        saved_errno = msgs[0] ? EPROTO : errno;
+        error("Received a bad pid message (%08x %08x)\n", msgs[0], msgs[1]);
+        goto FAIL;
+    }
+
+    // Exit status may take its time
+    launch_set_timeout(conn.fd, 0);
+
+    req->fd = conn.fd;
+    req->pid = msgs[1];
+    info("application %s launched (pid=%d)\n", args->argv[0], (int)req->pid);
+
+    *request = req;
+    return 0;
+
+FAIL:
+    close(conn.fd);
+    free(req);
+    return saved_errno == EAGAIN || saved_errno == EWOULDBLOCK ? -ETIMEDOUT : -EIO;
+}
+
+int launch_request_fd(const launch_request_t *request)
+{
+    return request->fd;
+}
+
+pid_t launch_request_pid(const launch_request_t *request)
+{
+    return request->pid;
+}
+
+bool launch_request_dispatch(launch_request_t *request)
+{
+    if (request->finished)
+        return true;
+
+    char peek;
+    if (recv(request->fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT) == -1 &&
+        (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return false;
+
+    uint32_t msgs[2] = { 0, 0 };
+    if (invoke_recv_msgs(request->fd, msgs, 2) && msgs[0] == INVOKER_MSG_EXIT) {
+        request->status = msgs[1];
+    } else {
+        // Connection to the application was lost
+        warning("application (pid=%d) exit status not received\n", (int)request->pid);
+        request->status = EXIT_FAILURE;
+    }
+
+    /* The launcher waits for EOF after sending the exit
+     * status, closing our end completes the disconnect.
+     */
+    close(request->fd);
+    request->fd = -1;
+    request->finished = true;
+
+    info("application (pid=%d) exit(%d)\n", (int)request->pid, request->status);
+
+    if (request->exit_cb)
+        request->exit_cb(request, request->status, request->user_data);
+    return true;
+}
+
+int launch_request_wait(launch_request_t *request)
+{
+    while (!request->finished) {
+        struct pollfd pfd = {
+            .fd = request->fd,
+            .events = POLLIN,
+            .revents = 0,
+        };
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR && errno != EAGAIN) {
+            warning("socket poll failed: %m\n");
+            break;
+        }
+        if (pfd.revents)
+            launch_request_dispatch(request);
+    }
+    return request->status;
+}
+
+void launch_request_free(launch_request_t *request)
+{
+    if (!request)
+        return;
+    if (request->fd != -1)
+        close(request->fd);
+    free(request);
+}
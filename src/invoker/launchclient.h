@@ -0,0 +1,111 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef LAUNCHCLIENT_H
+#define LAUNCHCLIENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LAUNCH_EXPORT __attribute__((visibility("default")))
+
+/* Launch client library
+ *
+ * Sends launch requests to boosters from within the calling process,
+ * with the semantics of pisces-invoker but without an invoker process
+ * per launch. Meant for long-lived processes such as the home screen
+ * and the autostart manager.
+ *
+ * Unlike pisces-invoker the library does not search PATH: argv[0]
+ * must be the absolute path of the application. It does not start
+ * the application unboosted either, launch_invoke() fails with
+ * -ENOENT when none of the boosters is available and the caller
+ * decides whether to execute the application directly.
+ */
+
+// Launch options, see the invoker options of the same name
+#define LAUNCH_OPTION_WAIT             (1u << 0)
+#define LAUNCH_OPTION_GLOBAL_SYMS      (1u << 1)
+#define LAUNCH_OPTION_DEEP_SYMS        (1u << 2)
+#define LAUNCH_OPTION_SINGLE_INSTANCE  (1u << 3)
+#define LAUNCH_OPTION_KEEP_OOM_SCORE   (1u << 5)
+
+typedef struct launch_request_t launch_request_t;
+
+// Called once the application of a waited launch has exited
+typedef void (*launch_exit_cb)(launch_request_t *request, int status, void *user_data);
+
+typedef struct launch_args_t
+{
+    // Comma separated list of booster types to try in order
+    const char     *type;
+    // Application booster name, NULL for the shared boosters
+    const char     *application;
+    // Process name, NULL for argv[0]
+    const char     *name;
+    int             argc;
+    char          **argv;
+    // Environment of the application, NULL for the caller's
+    char          **envp;
+    // LAUNCH_OPTION_* flags
+    uint32_t        options;
+    // Seconds the next booster may wait for the system to calm down
+    unsigned int    respawn_delay;
+    // Descriptors given to the application as stdin, stdout and stderr
+    int             stdio[3];
+    // Exit status notification, used with LAUNCH_OPTION_WAIT
+    launch_exit_cb  exit_cb;
+    void           *user_data;
+} launch_args_t;
+
+// Fills in the defaults: wait for exit, caller's environment and stdio
+LAUNCH_EXPORT void launch_args_init(launch_args_t *args);
+
+/* Sends a launch request to the first available booster of args->type.
+ *
+ * Returns 0 on success or a negative errno value. With LAUNCH_OPTION_WAIT
+ * a request is stored to *request, which must not be NULL then, and stays
+ * alive until the application exits; otherwise *request is set to NULL if
+ * request is not NULL.
+ */
+LAUNCH_EXPORT int launch_invoke(const launch_args_t *args, launch_request_t **request);
+
+// Descriptor that becomes readable when the application exits
+LAUNCH_EXPORT int launch_request_fd(const launch_request_t *request);
+
+// Pid of the launched application
+LAUNCH_EXPORT pid_t launch_request_pid(const launch_request_t *request);
+
+/* Handles input from launch_request_fd() without blocking: calls the
+ * exit callback and returns true once the application has exited,
+ * false if it is still running.
+ */
+LAUNCH_EXPORT bool launch_request_dispatch(launch_request_t *request);
+
+// Blocks until the application exits, returns its exit status
+LAUNCH_EXPORT int launch_request_wait(launch_request_t *request);
+
+/* Releases the request. If the application is still running the launcher
+ * sees the connection close and terminates the application.
+ */
+LAUNCH_EXPORT void launch_request_free(launch_request_t *request);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // LAUNCHCLIENT_H
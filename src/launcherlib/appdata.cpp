@@ -37,7 +37,8 @@ AppData::AppData() :
     m_entry(NULL),
     m_ioDescriptors(),
     m_gid(0),
-    m_uid(0)
+    m_uid(0),
+    m_trace()
 {}
 
 void AppData::setOptions(uint32_t newOptions)
@@ -70,6 +71,11 @@ bool AppData::disableOutOfMemAdj() const
     return (m_options & INVOKER_MSG_MAGIC_OPTION_OOM_ADJ_DISABLE) != 0;
 }
 
+bool AppData::fromClientLibrary() const
+{
+    return (m_options & INVOKER_MSG_MAGIC_OPTION_CLIENT_LIBRARY) != 0;
+}
+
 void AppData::setArgc(int newArgc)
 {
     (void)newArgc; // unused
@@ -247,6 +253,11 @@ string AppData::privileges() const
 }
 
 
+LaunchTrace & AppData::trace()
+{
+    return m_trace;
+}
+
 AppData::~AppData()
 {
     setArgv(nullptr);
@@ -21,6 +21,7 @@
 #define APPDATA_H
 
 #include "launcherlib.h"
+#include "launchtrace.h"
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -63,6 +64,9 @@ public:
     //! Return whether or not disable default out of memory killing adjustments for application process 
     bool disableOutOfMemAdj() const;
 
+    //! Return whether or not the request came from the launch client library
+    bool fromClientLibrary() const;
+
     //! Set argument count
     void setArgc(int argc);
 
@@ -129,6 +133,9 @@ public:
     //! Get privilege string for this app
     string privileges() const;
 
+    //! Get launch timeline
+    LaunchTrace & trace();
+
 private:
 
     AppData(const AppData & r);
@@ -147,6 +154,7 @@ private:
     gid_t       m_gid;
     uid_t       m_uid;
     string      m_privileges;
+    LaunchTrace m_trace;
 };
 
 #endif // APPDATA_H
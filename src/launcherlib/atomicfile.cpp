@@ -0,0 +1,53 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "atomicfile.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+
+bool AtomicFile::replace(const string &path, const string &data, mode_t mode)
+{
+    std::ostringstream temp;
+    temp << path << '.' << getpid() << ".new";
+    const string tempPath = temp.str();
+
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd == -1)
+        return false;
+
+    int error = 0;
+    for (size_t done = 0; done < data.size() && !error;) {
+        ssize_t written = write(fd, data.data() + done, data.size() - done);
+        if (written > 0)
+            done += written;
+        else if (written == 0)
+            error = EIO;
+        else if (errno != EINTR)
+            error = errno;
+    }
+    if (close(fd) == -1 && !error)
+        error = errno;
+
+    if (!error && rename(tempPath.c_str(), path.c_str()) == -1)
+        error = errno;
+
+    if (error) {
+        unlink(tempPath.c_str());
+        errno = error;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef ATOMICFILE_H
+#define ATOMICFILE_H
+
+#include "launcherlib.h"
+#include <sys/types.h>
+
+#include <string>
+
+using std::string;
+
+/*!
+ * \class AtomicFile
+ * \brief Replaces files that other processes read while they are written.
+ *
+ * The data is written under a temporary name that includes the pid of
+ * the writer and renamed over the file, so readers see either the old
+ * or the new content, also when several boosters write the same file.
+ */
+class DECL_EXPORT AtomicFile
+{
+public:
+
+    /*! \brief Replace the file at path with data.
+     *  \param mode Permissions of a new file, before umask
+     *  \return false with errno set if the file can't be replaced.
+     */
+    static bool replace(const string &path, const string &data, mode_t mode = 0600);
+};
+
+#endif // ATOMICFILE_H
@@ -41,7 +41,11 @@
 #include <stdexcept>
 #include <syslog.h>
 #include <dirent.h>
+#include <glob.h>
 #include <algorithm>
+#include <malloc.h>
+#include <poll.h>
+#include <sys/mman.h>
 
 #include <fstream>
 
@@ -55,11 +59,49 @@
 
 #include "coverage.h"
 
+#ifndef MADV_COLD
+#define MADV_COLD 20
+#endif
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+// Time (ms) the launcher has for sending an activation
+static const int ACTIVATION_TIMEOUT = 1000;
+
+// Set by TrimSignal, handled while waiting for invokers
+static volatile sig_atomic_t trimRequested = 0;
+
+static void trimRequestHandler(int)
+{
+    trimRequested = 1;
+}
+
 static std::string basename(const std::string &str)
 {
     return str.substr(str.find_last_of("/") + 1);
 }
 
+// Copy of the environment, see restoreEnvironment()
+static vector<string> saveEnvironment()
+{
+    vector<string> saved;
+    for (char **var = environ; var && *var; ++var)
+        saved.push_back(*var);
+    return saved;
+}
+
+// Undo what an invoker has set, the next one sends a delta against the original
+static void restoreEnvironment(const vector<string> &saved)
+{
+    clearenv();
+    for (vector<string>::const_iterator it = saved.begin(); it != saved.end(); ++it) {
+        const size_t eq = it->find('=');
+        if (eq != string::npos)
+            setenv(it->substr(0, eq).c_str(), it->c_str() + eq + 1, true);
+    }
+}
+
 Booster::Booster() :
     m_appData(new AppData),
     m_connection(NULL),
@@ -67,7 +109,12 @@ Booster::Booster() :
     m_oldPriorityOk(false),
     m_spaceAvailable(0),
     m_boostedApplication("default"),
-    m_bootMode(false)
+    m_bootMode(false),
+    m_launchMode(ElfInfo::LaunchDlopen),
+    m_elfRecord(),
+    m_learnedPreloads(),
+    m_manifest(),
+    m_zygotePreloaded(false)
 {
 }
 
@@ -92,8 +139,17 @@ void Booster::initialize(int initialArgc, char ** initialArgv, int newBoosterLau
     pushPriority(10);
 
     // Preload stuff
-    if (!m_bootMode)
+    if (!m_bootMode) {
+        sendStateToParent(MessagePreloading);
+        const uint64_t start = LaunchTrace::now();
+
+        applyPreloadManifest();
         preload();
+        if (!m_zygotePreloaded)
+            applyLearnedPreloads();
+
+        sendStateToParent(MessagePreloaded, (LaunchTrace::now() - start) / 1000);
+    }
 
     // Rename process to temporary booster process name
     std::string temporaryProcessName = "booster [";
@@ -105,6 +161,15 @@ void Booster::initialize(int initialArgc, char ** initialArgv, int newBoosterLau
     // Restore priority
     popPriority();
 
+    // Let the launcher ask for memory back while waiting
+    setTrimHandler(true);
+
+    // Let the launcher know that launches are served from now on
+    sendStateToParent(MessageReady);
+
+    // Environment the published baseline describes
+    const vector<string> environment = saveEnvironment();
+
     while (true)
     {
         // Wait and read commands from the invoker
@@ -115,46 +180,71 @@ void Booster::initialize(int initialArgc, char ** initialArgv, int newBoosterLau
         // Run process as single instance if requested
         if (m_appData->singleInstance())
         {
-            // Check if instance is already running
+            // Check if instance is already running, the registry of
+            // the launcher knows without touching the file system
             SingleInstancePluginEntry * pluginEntry = singleInstance->pluginEntry();
-            if (pluginEntry)
+            pid_t owner = 0;
+            SingleInstance::ClaimResult claim = singleInstance->claim(m_appData->appName(), getpid(), &owner);
+            bool running = claim == SingleInstance::Running;
+            if (!running)
             {
-                std::string lockedAppName = m_appData->appName();
-                if (!pluginEntry->lockFunc(m_appData->appName().c_str()))
+                // The registry covers this launcher only, the lock file
+                // is what other launchers and pisces-single-instance see
+                if (pluginEntry)
+                    running = !pluginEntry->lockFunc(m_appData->appName().c_str());
+                else
+                    Logger::logWarning("Booster: Single-instance launch wanted, but single-instance plugin not loaded!");
+
+                if (running && claim == SingleInstance::Claimed)
+                    singleInstance->release(getpid());
+            }
+
+            if (running)
+            {
+                Logger::logDebug("Booster: %s is already running (pid=%d)",
+                                 m_appData->appName().c_str(), (int)owner);
+
+                // The launcher activates the window of the existing instance
+                // over its own bus connection, the plugin is the fallback
+                if (!sendActivationToParent() &&
+                    (!pluginEntry || !pluginEntry->activateExistingInstanceFunc(m_appData->appName().c_str())))
+                {
+                    Logger::logWarning("Booster: Can't activate existing instance of the application!");
+                    m_connection->sendExitValue(EXIT_FAILURE);
+                }
+                else
                 {
-                    // Try to activate the window of the existing instance
-                    if (!pluginEntry->activateExistingInstanceFunc(lockedAppName.c_str()))
-                    {
-                        Logger::logWarning("Booster: Can't activate existing instance of the application!");
-                        m_connection->sendExitValue(EXIT_FAILURE);
-                    }
-                    else
-                    {
-                        m_connection->sendExitValue(EXIT_SUCCESS);
-                    }
-                    m_connection->close();
-
-                    // invoker requested to start an application that is already running
-                    // booster is not needed this time, let's wait for the next connection from invoker
-                    continue;
+                    m_connection->sendExitValue(EXIT_SUCCESS);
                 }
+                m_connection->close();
+                restoreEnvironment(environment);
 
-                // Close the single-instance plugin
-                singleInstance->closePlugin();
-            }
-            else
-            {
-                Logger::logWarning("Booster: Single-instance launch wanted, but single-instance plugin not loaded!");
+                // invoker requested to start an application that is already running
+                // booster is not needed this time, let's wait for the next connection from invoker
+                continue;
             }
+
+            // Close the single-instance plugin
+            if (pluginEntry)
+                singleInstance->closePlugin();
         }
 
         //this instance of booster will be used to start application, exit from the loop
         break;
     }
 
+    // The application gets the default signal disposition and
+    // no access to the single-instance registry
+    setTrimHandler(false);
+    singleInstance->closeRegistry();
+
+    // Decide between dlopen() and exec(), new decisions go to the launcher
+    m_launchMode = ElfInfo::select(m_appData->fileName(), &m_elfRecord);
+
     // Send parent process a message that it can create a new booster,
     // send pid of invoker, booster respawn value and invoker socket connection.
     sendDataToParent();
+    m_appData->trace().mark(LaunchTrace::SentToParent);
 
     // Give the process the real application name now that it
     // has been read from invoker in receiveDataFromInvoker().
@@ -169,6 +259,152 @@ void Booster::initialize(int initialArgc, char ** initialArgv, int newBoosterLau
     prctl(PR_SET_PDEATHSIG, 0);
 }
 
+void Booster::initializeZygote(Zygote::Stage stage, int initialArgc, char **initialArgv)
+{
+    pushPriority(10);
+
+    std::string processName = "booster-zygote [";
+    switch (stage) {
+    case Zygote::StageBase: {
+        // Nothing booster specific, what all the types below it share
+        PreloadManifest manifest;
+        const string path = PreloadManifest::baseManifestFile();
+        if (manifest.load(path))
+            preloadManifestItems(manifest, true);
+        else
+            Logger::logDebug("Booster: no preload manifest %s", path.c_str());
+        processName += "base";
+        break;
+    }
+
+    case Zygote::StageType:
+        applyPreloadManifest(true);
+        m_zygotePreloaded = true;
+        processName += boosterType();
+        break;
+
+    case Zygote::StageApplication:
+        applyLearnedPreloads();
+        processName += socketId();
+        break;
+    }
+    processName += "]";
+
+    const char *tempArgv[] = {processName.c_str()};
+    renameProcess(initialArgc, initialArgv, 1, tempArgv);
+
+    popPriority();
+}
+
+void Booster::inheritZygote(const Booster &other)
+{
+    m_manifest = other.m_manifest;
+    m_zygotePreloaded = other.m_zygotePreloaded;
+}
+
+void Booster::applyPreloadManifest(bool forkSafeOnly)
+{
+    // Boosters forked from a zygote continue from where it stopped
+    if (!m_zygotePreloaded) {
+        const string path = PreloadManifest::manifestFile(boosterType());
+        if (!m_manifest.load(path)) {
+            Logger::logDebug("Booster: no preload manifest %s", path.c_str());
+            return;
+        }
+    }
+
+    preloadManifestItems(m_manifest, forkSafeOnly);
+
+    if (!forkSafeOnly && !m_manifest.items().empty())
+        m_manifest.report(boosterType());
+}
+
+void Booster::preloadManifestItems(PreloadManifest &manifest, bool forkSafeOnly)
+{
+    for (size_t i = 0; i < manifest.items().size(); ++i) {
+        // QML imports need the application object of the booster
+        const PreloadManifest::Item &item = manifest.items()[i];
+        if (manifest.isDone(i) || (forkSafeOnly && item.kind == PreloadManifest::Item::QmlImport))
+            continue;
+
+        string error;
+        const uint64_t start = LaunchTrace::now();
+        const bool ok = preloadItem(item, error);
+        manifest.setResult(i, ok, LaunchTrace::now() - start, error);
+    }
+}
+
+void Booster::applyLearnedPreloads()
+{
+    if (m_learnedPreloads.empty())
+        return;
+
+    unsigned loaded = 0;
+    const uint64_t start = LaunchTrace::now();
+    for (size_t i = 0; i < m_learnedPreloads.size(); ++i) {
+        const char *library = m_learnedPreloads[i].c_str();
+        if (dlopen(library, RTLD_NOW | RTLD_LOCAL | RTLD_NOLOAD))
+            continue;
+
+        // Local scope, the application adds it to its own when it links it
+        if (dlopen(library, RTLD_NOW | RTLD_LOCAL))
+            loaded++;
+        else
+            Logger::logWarning("Booster: can't preload %s: %s", library, dlerror());
+    }
+
+    Logger::logDebug("Booster: preloaded %u of %u learned libraries of %s in %llu us",
+                     loaded, (unsigned)m_learnedPreloads.size(), boostedApplication().c_str(),
+                     (unsigned long long)(LaunchTrace::now() - start));
+}
+
+bool Booster::preloadItem(const PreloadManifest::Item &item, string &error)
+{
+    switch (item.kind) {
+    case PreloadManifest::Item::Library:
+    case PreloadManifest::Item::Plugin:
+        // The handle is never closed, the library stays loaded
+        if (!dlopen(item.name.c_str(), item.flags)) {
+            error = dlerror();
+            return false;
+        }
+        return true;
+
+    case PreloadManifest::Item::File: {
+        glob_t files;
+        if (glob(item.name.c_str(), GLOB_NOSORT, NULL, &files) != 0) {
+            error = "no such file";
+            return false;
+        }
+
+        // Read the files into the page cache
+        for (size_t i = 0; i < files.gl_pathc; ++i) {
+            int fd = open(files.gl_pathv[i], O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd == -1 || fstat(fd, &st) == -1 || readahead(fd, 0, st.st_size) == -1) {
+                error = string(files.gl_pathv[i]) + ": " + strerror(errno);
+                if (fd != -1)
+                    close(fd);
+                globfree(&files);
+                return false;
+            }
+            close(fd);
+        }
+        globfree(&files);
+        return true;
+    }
+
+    default:
+        error = "not supported by this booster";
+        return false;
+    }
+}
+
+void Booster::setLearnedPreloads(const vector<string> &libraries)
+{
+    m_learnedPreloads = libraries;
+}
+
 bool Booster::bootMode() const
 {
     return m_bootMode;
@@ -178,24 +414,42 @@ void Booster::sendDataToParent()
 {
     // Number of data items to be sent to
     // the parent (launcher) process
-    const unsigned int NUM_DATA_ITEMS = 2;
+    const unsigned int NUM_DATA_ITEMS = 6;
 
     struct iovec    iov[NUM_DATA_ITEMS];
     struct msghdr   msg;
     struct cmsghdr *cmsg;
     char buf[CMSG_SPACE(sizeof(int))];
 
+    int message = MessageLaunch;
+    iov[0].iov_base = &message;
+    iov[0].iov_len  = sizeof(int);
+
+    // Identify ourselves, there can be several boosters
+    // waiting in the pool of the parent process
+    pid_t boosterPid = getpid();
+    iov[1].iov_base = &boosterPid;
+    iov[1].iov_len  = sizeof(pid_t);
+
     // Signal the parent process that it can create a new
     // waiting booster process and close write end
     // Send to the parent process pid of invoker for tracking
     pid_t pid = invokersPid();
-    iov[0].iov_base = &pid;
-    iov[0].iov_len  = sizeof(pid_t);
+    iov[2].iov_base = &pid;
+    iov[2].iov_len  = sizeof(pid_t);
 
     // Send to the parent process booster respawn delay value
     int delay = m_appData->delay();
-    iov[1].iov_base = &delay;
-    iov[1].iov_len  = sizeof(int);
+    iov[3].iov_base = &delay;
+    iov[3].iov_len  = sizeof(int);
+
+    // Send to the parent process the launch mode decision to be cached
+    iov[4].iov_base = &m_elfRecord;
+    iov[4].iov_len  = sizeof(m_elfRecord);
+
+    // Application name, NUL terminated
+    iov[5].iov_base = const_cast<char *>(m_appData->appName().c_str());
+    iov[5].iov_len  = m_appData->appName().size() + 1;
 
     msg.msg_iov     = iov;
     msg.msg_iovlen  = NUM_DATA_ITEMS;
@@ -233,6 +487,107 @@ void Booster::sendDataToParent()
     }
 }
 
+void Booster::sendStateToParent(ParentMessage message, unsigned int duration)
+{
+    // Leading fields of the launch data, the duration as the delay
+    int value = message;
+    pid_t boosterPid = getpid();
+    pid_t invokerPid = 0;
+    int delay = duration;
+
+    struct iovec iov[4];
+    iov[0].iov_base = &value;
+    iov[0].iov_len  = sizeof(int);
+    iov[1].iov_base = &boosterPid;
+    iov[1].iov_len  = sizeof(pid_t);
+    iov[2].iov_base = &invokerPid;
+    iov[2].iov_len  = sizeof(pid_t);
+    iov[3].iov_base = &delay;
+    iov[3].iov_len  = sizeof(int);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 4;
+
+    if (sendmsg(boosterLauncherSocket(), &msg, 0) < 0)
+        Logger::logError("Booster: Couldn't send state %d to launcher process\n", message);
+}
+
+bool Booster::sendActivationToParent()
+{
+    // Same layout as the launch data, without a launch
+    int message = MessageActivate;
+    pid_t boosterPid = getpid();
+    pid_t invokerPid = 0;
+    int delay = 0;
+    ElfInfo::Record elfRecord;
+    memset(&elfRecord, 0, sizeof elfRecord);
+    const string &name = m_appData->appName();
+
+    struct iovec iov[6];
+    iov[0].iov_base = &message;
+    iov[0].iov_len  = sizeof(int);
+    iov[1].iov_base = &boosterPid;
+    iov[1].iov_len  = sizeof(pid_t);
+    iov[2].iov_base = &invokerPid;
+    iov[2].iov_len  = sizeof(pid_t);
+    iov[3].iov_base = &delay;
+    iov[3].iov_len  = sizeof(int);
+    iov[4].iov_base = &elfRecord;
+    iov[4].iov_len  = sizeof(elfRecord);
+    iov[5].iov_base = const_cast<char *>(name.c_str());
+    iov[5].iov_len  = name.size() + 1;
+
+    // The launcher tells on this socket whether it could send the activation
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        Logger::logError("Booster: Couldn't create activation socket: %s\n", strerror(errno));
+        return false;
+    }
+
+    char buf[CMSG_SPACE(sizeof fds[1])];
+    memset(buf, 0, sizeof buf);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov        = iov;
+    msg.msg_iovlen     = 6;
+    msg.msg_control    = buf;
+    msg.msg_controllen = sizeof buf;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_len   = CMSG_LEN(sizeof fds[1]);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    memcpy(CMSG_DATA(cmsg), &fds[1], sizeof fds[1]);
+
+    const bool sent = sendmsg(boosterLauncherSocket(), &msg, 0) >= 0;
+    close(fds[1]);
+    if (!sent)
+    {
+        Logger::logError("Booster: Couldn't send activation to launcher process\n");
+        close(fds[0]);
+        return false;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = fds[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int rc;
+    while ((rc = poll(&pfd, 1, ACTIVATION_TIMEOUT)) == -1 && errno == EINTR)
+        ;
+
+    char result = 0;
+    if (rc != 1 || recv(fds[0], &result, sizeof result, MSG_DONTWAIT) != sizeof result)
+        Logger::logWarning("Booster: No activation result from launcher process\n");
+    close(fds[0]);
+    return result == 1;
+}
+
 bool Booster::receiveDataFromInvoker(int socketFd)
 {
     // delete previous connection instance because booster can
@@ -246,6 +601,9 @@ bool Booster::receiveDataFromInvoker(int socketFd)
     // Setup the conversation channel with the invoker.
     m_connection = new Connection(socketFd);
 
+    if (!waitForInvoker(socketFd))
+        return false;
+
     // Accept a new invocation.
     if (m_connection->accept(m_appData))
     {
@@ -269,6 +627,97 @@ bool Booster::receiveDataFromInvoker(int socketFd)
     return false;
 }
 
+bool Booster::waitForInvoker(int socketFd)
+{
+    // TrimSignal is blocked except within ppoll(), so a request is
+    // never lost between checking the flag and going to sleep
+    sigset_t mask;
+    sigprocmask(SIG_SETMASK, NULL, &mask);
+    sigdelset(&mask, TrimSignal);
+
+    for (;;) {
+        if (trimRequested) {
+            trimRequested = 0;
+            trimMemory();
+        }
+
+        struct pollfd pfd;
+        pfd.fd = socketFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int rc = ppoll(&pfd, 1, NULL, &mask);
+        if (rc > 0)
+            return true;
+        if (rc == -1 && errno != EINTR) {
+            Logger::logError("Booster: Failed to wait for invoker: %s\n", strerror(errno));
+            return false;
+        }
+    }
+}
+
+void Booster::trimMemory()
+{
+    const uint64_t start = LaunchTrace::now();
+
+    // Free heap at the top of the arenas goes back to the kernel
+    malloc_trim(0);
+
+    // <first>-<last> <perms> <offset> <dev> <inode> [<path>]
+    FILE *maps = fopen("/proc/self/maps", "re");
+    if (!maps) {
+        Logger::logWarning("Booster: can't read /proc/self/maps: %m");
+        return;
+    }
+
+    unsigned long pagedOut = 0;
+    char line[512];
+    while (fgets(line, sizeof line, maps)) {
+        unsigned long first = 0;
+        unsigned long last = 0;
+        char perms[8];
+        char path[256] = "";
+        if (sscanf(line, "%lx-%lx %7s %*s %*s %*s %255s", &first, &last, perms, path) < 3)
+            continue;
+
+        // Private writable anonymous memory and the heap only, file
+        // backed pages are dropped by the kernel as needed anyway
+        if (perms[1] != 'w' || perms[3] != 'p' || (path[0] && strcmp(path, "[heap]")))
+            continue;
+
+        void *address = reinterpret_cast<void *>(first);
+        if (madvise(address, last - first, MADV_PAGEOUT) == 0 ||
+            (errno == EINVAL && madvise(address, last - first, MADV_COLD) == 0))
+            pagedOut += (last - first) / 1024;
+    }
+    fclose(maps);
+
+    Logger::logDebug("Booster: trimmed memory, paged out up to %lu kB in %llu us", pagedOut,
+                     (unsigned long long)(LaunchTrace::now() - start));
+}
+
+void Booster::setTrimHandler(bool enable)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, TrimSignal);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    sigemptyset(&action.sa_mask);
+
+    if (enable) {
+        action.sa_handler = trimRequestHandler;
+        sigaction(TrimSignal, &action, NULL);
+        sigprocmask(SIG_BLOCK, &set, NULL);
+    } else {
+        // Default disposition discards a pending request
+        action.sa_handler = SIG_DFL;
+        sigaction(TrimSignal, &action, NULL);
+        sigprocmask(SIG_UNBLOCK, &set, NULL);
+        trimRequested = 0;
+    }
+}
+
 int Booster::run(SocketManager * socketManager)
 {
     if (!m_appData->fileName().empty())
@@ -489,23 +938,32 @@ void Booster::setEnvironmentBeforeLaunch()
     }
 
     Logger::logDebug("Booster: launching process: '%s' ", m_appData->fileName().c_str());
+    m_appData->trace().mark(LaunchTrace::Environment);
 }
 
 int Booster::launchProcess()
 {
     setEnvironmentBeforeLaunch();
 
+    if (m_launchMode == ElfInfo::LaunchExec)
+        return execProcess();
+
     // Load the application and find out the address of main()
     loadMain();
+    m_appData->trace().mark(LaunchTrace::Dlopen);
 
     // make booster specific initializations unless booster is in boot mode
-    if (!m_bootMode)
+    if (!m_bootMode) {
         preinit();
+        m_appData->trace().mark(LaunchTrace::Preinit);
+    }
 
 #ifdef WITH_COVERAGE
     __gcov_flush();
 #endif
 
+    traceLaunch();
+
     // Close syslog
     closelog();
 
@@ -519,6 +977,17 @@ int Booster::launchProcess()
     return retVal;
 }
 
+int Booster::execProcess()
+{
+    traceLaunch();
+
+    // Exec the binary (execv returns only in case of an error).
+    execv(m_appData->fileName().c_str(), const_cast<char **>(m_appData->argv()));
+
+    throw std::runtime_error(std::string("Booster: Executing invoked application failed: '") +
+                             strerror(errno) + "'\n");
+}
+
 void* Booster::loadMain()
 {
     // Setup flags for dlopen
@@ -557,6 +1026,12 @@ void* Booster::loadMain()
     return module;
 }
 
+void Booster::traceLaunch()
+{
+    m_appData->trace().mark(LaunchTrace::Main);
+    m_appData->trace().dump(m_appData->appName(), m_appData->fileName());
+}
+
 bool Booster::pushPriority(int nice)
 {
     errno = 0;
@@ -642,7 +1117,9 @@ const string Booster::socketId() const
 
 pid_t Booster::invokersPid()
 {
-    if (m_connection->isReportAppExitStatusNeeded())
+    // A client library peer is the launching shell itself, the
+    // launcher must not terminate it when tearing down the launch
+    if (m_connection->isReportAppExitStatusNeeded() && !m_appData->fromClientLibrary())
     {
         return m_connection->peerPid();
     }
@@ -25,11 +25,17 @@
 #include "launcherlib.h"
 
 #include <cstdlib>
+#include <signal.h>
 #include <string>
+#include <vector>
 
 using std::string;
+using std::vector;
 
 #include "appdata.h"
+#include "elfinfo.h"
+#include "preloadmanifest.h"
+#include "zygote.h"
 
 class Connection;
 class SocketManager;
@@ -52,6 +58,21 @@ class DECL_EXPORT Booster
 {
 public:
 
+    //! Messages sent from a booster to the launcher
+    enum ParentMessage
+    {
+        MessageReady = 1,  //!< Preloading done, waiting for invokers
+        MessageLaunch,     //!< Taken into use for a launch
+        MessageActivate,   //!< Running single-instance application to be activated, the result comes back on the attached socket
+        MessagePreloading, //!< Preloading started
+        MessagePreloaded   //!< Preloading done, its duration (ms) in the delay field
+    };
+
+    //! Signal the launcher sends to a waiting booster to give memory
+    //! back under memory pressure. Ignored by default, so a booster
+    //! that has just launched an application is not harmed by it.
+    static const int TrimSignal = SIGURG;
+
     //! Constructor
     Booster();
 
@@ -129,6 +150,30 @@ public:
     //! Return true, if in boot mode.
     bool bootMode() const;
 
+    //! Set libraries learned from earlier launches to be preloaded
+    void setLearnedPreloads(const vector<string> &libraries);
+
+    /*!
+     * \brief Preload what the boosters forked from a zygote share.
+     * Runs in the zygote process, the boosters it forks skip what was
+     * done here. Only preloads that can be forked from are done: the
+     * libraries, plugins and files of the base and booster type
+     * manifests and the learned preloads. preload() and QML imports,
+     * which may connect to the display or start threads, run in the
+     * boosters.
+     * \param stage Layer of the zygote tree the zygote is
+     * \param initialArgc argc of the parent process.
+     * \param initialArgv argv of the parent process.
+     */
+    void initializeZygote(Zygote::Stage stage, int initialArgc, char **initialArgv);
+
+    /*!
+     * \brief Continue from the zygote stages another booster has done.
+     * For boosters and zygotes forked from the zygote of the booster
+     * type that did its preloads with the booster of another pool.
+     */
+    void inheritZygote(const Booster &other);
+
 protected:
 
     /*!
@@ -138,11 +183,16 @@ protected:
      */
     virtual void setEnvironmentBeforeLaunch();
 
-    /*! Load the library and jump to main.
-     * Re-implement if needed.
+    /*! Load the library and jump to main, or exec() the binary
+     * if it can't be loaded. Re-implement if needed.
      */
     virtual int launchProcess();
 
+    /*! Replace the booster with the application binary. Returns
+     *  only if exec() fails.
+     */
+    int execProcess();
+
     /*!
      * \brief Preload libraries / initialize cache etc.
      * Called from initialize if not in the boot mode.
@@ -150,6 +200,34 @@ protected:
      */
     virtual bool preload() = 0;
 
+    /*!
+     * \brief Preload the items in the preload manifest of the booster type.
+     * Called from initialize before preload() if not in the boot mode.
+     * Items already preloaded by the zygote are skipped.
+     * \param forkSafeOnly Preload only the items a zygote may preload
+     */
+    void applyPreloadManifest(bool forkSafeOnly = false);
+
+    //! Preload the items of manifest that are not done yet
+    void preloadManifestItems(PreloadManifest &manifest, bool forkSafeOnly);
+
+    /*!
+     * \brief Preload one item of the preload manifest.
+     * Handles libraries, plugins and files. Re-implement in the custom
+     * Booster to support QML imports, call the base class for the rest.
+     * \param item Item to be preloaded
+     * \param error Set to the reason of a failure
+     * \return true on success
+     */
+    virtual bool preloadItem(const PreloadManifest::Item &item, string &error);
+
+    /*!
+     * \brief Preload the libraries set with setLearnedPreloads().
+     * Called from initialize after preload(), skips libraries that
+     * are already loaded.
+     */
+    void applyLearnedPreloads();
+
     /*!
      * \brief Wait for connection from invoker and read the input.
      * This method accepts a socket connection from the invoker
@@ -160,6 +238,23 @@ protected:
      */
     virtual bool receiveDataFromInvoker(int socketFd);
 
+    /*!
+     * \brief Wait until an invoker connects to the socket.
+     * Memory is trimmed with trimMemory() whenever the launcher sends
+     * TrimSignal in the meantime.
+     *
+     * \param socketFd Fd of the UNIX socket file.
+     * \return true when a connection is waiting
+     */
+    bool waitForInvoker(int socketFd);
+
+    /*!
+     * \brief Give memory back to the system.
+     * Returns free heap to the kernel and pages out private anonymous
+     * memory. Pages that are used again are faulted back in.
+     */
+    void trimMemory();
+
     /*! This method is called just before call boosted application's
      *  main function. Empty by default but some booster specific
      *  initializations can be done here.
@@ -167,6 +262,12 @@ protected:
      */
     virtual void preinit() {};
 
+    /*! Record the jump to main() / exec() in the launch timeline and
+     *  write it out. Called by launchProcess(), call from custom
+     *  launchProcess() implementations too.
+     */
+    void traceLaunch();
+
     //! Set nice value and store the old priority. Return true on success.
     bool pushPriority(int nice);
 
@@ -198,6 +299,16 @@ private:
     //! and signal that a new booster can be created.
     void sendDataToParent();
 
+    //! Tell the parent process how far the booster has got, see ParentMessage
+    void sendStateToParent(ParentMessage message, unsigned int duration = 0);
+
+    //! Ask the parent process to activate the running instance of the application,
+    //! return true once it has sent the activation
+    bool sendActivationToParent();
+
+    //! Catch TrimSignal while waiting for invokers, or restore its default
+    void setTrimHandler(bool enable);
+
     //! Helper method: load the library and find out address for "main".
     void* loadMain();
 
@@ -226,6 +337,22 @@ private:
     //! True, if being run in boot mode.
     bool m_bootMode;
 
+    //! How the application is launched
+    ElfInfo::LaunchMode m_launchMode;
+
+    //! New launch mode decision to be cached by the launcher
+    ElfInfo::Record m_elfRecord;
+
+    //! Libraries the boosted application used in earlier launches
+    vector<string> m_learnedPreloads;
+
+    //! Preload manifest, kept for the boosters forked from a zygote
+    PreloadManifest m_manifest;
+
+    //! True if the booster was forked from a zygote that has preloaded
+    //! the manifest of the booster type
+    bool m_zygotePreloaded;
+
 #ifdef UNIT_TEST
     friend class Ut_Booster;
 #endif
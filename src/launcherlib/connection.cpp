@@ -22,6 +22,7 @@
 #include "connection.h"
 #include "logger.h"
 #include "report.h"
+#include "envbaseline.h"
 
 #include <sys/socket.h>
 #include <sys/un.h>       /* for getsockopt */
@@ -31,8 +32,13 @@
 #include <cerrno>
 #include <unistd.h>
 #include <stdexcept>
+#include <algorithm>
 #include <sys/syslog.h>
 
+// Initial size of the receive buffer, big enough for a typical
+// launch request to arrive with a single recvmsg() call
+static const size_t RECV_BUFFER_SIZE = 32768;
+
 Connection::Connection(int socketFd, bool testMode) :
         m_testMode(testMode),
         m_fd(-1),
@@ -44,7 +50,18 @@ Connection::Connection(int socketFd, bool testMode) :
         m_delay(0),
         m_sendPid(false),
         m_gid(0),
-        m_uid(0)
+        m_uid(0),
+        m_version(INVOKER_MSG_MAGIC_VERSION_UNFRAMED),
+        m_frameLeft(0),
+        m_buf(),
+        m_bufPos(0),
+        m_bufLen(0),
+        m_ioReceived(false),
+        m_envResend(false),
+        m_envResent(false),
+        m_launchId(0),
+        m_invokerStart(0),
+        m_invokerConnect(0)
 {
     m_io[0] = -1;
     m_io[1] = -1;
@@ -82,7 +99,6 @@ int Connection::getFd() const
 
 bool Connection::accept(AppData *appData)
 {
-    (void)appData; // unused
     if (!m_testMode)
     {
         m_fd = ::accept(m_curSocket, NULL, NULL);
@@ -94,6 +110,9 @@ bool Connection::accept(AppData *appData)
         }
     }
 
+    if (appData)
+        appData->trace().mark(LaunchTrace::Accept);
+
     return true;
 }
 
@@ -115,12 +134,14 @@ void Connection::close()
     }
 }
 
-bool Connection::sendMsg(uint32_t msg)
+bool Connection::sendMsgs(const uint32_t *msgs, int count)
 {
     if (!m_testMode)
     {
-        Logger::logDebug("Connection: %s: %08x", __FUNCTION__, msg);
-        return write(m_fd, &msg, sizeof(msg)) != -1;
+        for (int i = 0; i < count; ++i)
+            Logger::logDebug("Connection: %s: %08x", __FUNCTION__, msgs[i]);
+        ssize_t size = count * sizeof *msgs;
+        return write(m_fd, msgs, size) == size;
     }
     else
     {
@@ -128,26 +149,123 @@ bool Connection::sendMsg(uint32_t msg)
     }
 }
 
+void Connection::takeDescriptors(struct msghdr *msg)
+{
+    if (msg->msg_flags & MSG_CTRUNC)
+        Logger::logWarning("Connection: control data was truncated");
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int fds[IO_DESCRIPTOR_COUNT];
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (count == IO_DESCRIPTOR_COUNT && !m_ioReceived)
+        {
+            memcpy(m_io, CMSG_DATA(cmsg), sizeof(m_io));
+            m_ioReceived = true;
+            continue;
+        }
+
+        Logger::logWarning("Connection: ignoring %u unexpected descriptors", (unsigned)count);
+        for (size_t i = 0; i < count; i += IO_DESCRIPTOR_COUNT)
+        {
+            size_t n = std::min(count - i, (size_t)IO_DESCRIPTOR_COUNT);
+            memcpy(fds, CMSG_DATA(cmsg) + i * sizeof(int), n * sizeof(int));
+            for (size_t k = 0; k < n; ++k)
+                ::close(fds[k]);
+        }
+    }
+}
+
+bool Connection::fillBuffer(size_t size)
+{
+    if (m_bufLen - m_bufPos >= size)
+        return true;
+
+    // Move unread data to the start of the buffer
+    if (m_bufPos > 0)
+    {
+        memmove(&m_buf[0], &m_buf[m_bufPos], m_bufLen - m_bufPos);
+        m_bufLen -= m_bufPos;
+        m_bufPos = 0;
+    }
+
+    if (m_buf.size() < std::max(size, RECV_BUFFER_SIZE))
+        m_buf.resize(std::max(size, RECV_BUFFER_SIZE));
+
+    while (m_bufLen < size)
+    {
+        struct iovec iov;
+        iov.iov_base = &m_buf[m_bufLen];
+        iov.iov_len  = m_buf.size() - m_bufLen;
+
+        char buf[CMSG_SPACE(sizeof(m_io))];
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = buf;
+        msg.msg_controllen = sizeof(buf);
+
+        ssize_t ret = recvmsg(m_fd, &msg, MSG_CMSG_CLOEXEC);
+        if (ret == -1 && errno == EINTR)
+            continue;
+
+        if (ret <= 0)
+        {
+            if (ret == 0)
+                Logger::logError("Connection: unexpected end of file, got %u of %u bytes",
+                                 (unsigned)m_bufLen, (unsigned)size);
+            else
+                Logger::logError("Connection: recvmsg failed: %s", strerror(errno));
+            return false;
+        }
+
+        takeDescriptors(&msg);
+        m_bufLen += ret;
+    }
+
+    return true;
+}
+
+bool Connection::readBuffer(void *data, size_t size)
+{
+    if (m_version == INVOKER_MSG_MAGIC_VERSION)
+    {
+        // Framed request must not be parsed past its end
+        if (size > m_frameLeft)
+        {
+            Logger::logError("Connection: request is truncated, %u of %u bytes left",
+                             m_frameLeft, (unsigned)size);
+            return false;
+        }
+        m_frameLeft -= size;
+    }
+
+    if (!fillBuffer(size))
+        return false;
+
+    memcpy(data, &m_buf[m_bufPos], size);
+    m_bufPos += size;
+    return true;
+}
+
 bool Connection::recvMsg(uint32_t *msg)
 {
     if (!m_testMode)
     {
-        uint32_t buf = 0;
-        int len = sizeof(buf);
-        ssize_t ret = read(m_fd, &buf, len);
-
-        if (ret < len)
+        if (!readBuffer(msg, sizeof(*msg)))
         {
             Logger::logError("Connection: can't read data from connecton in %s", __FUNCTION__);
             *msg = 0;
-        }
-        else
-        {
-            Logger::logDebug("Connection: %s: %08x", __FUNCTION__, *msg);
-            *msg = buf;
+            return false;
         }
 
-        return ret != -1;
+        Logger::logDebug("Connection: %s: %08x", __FUNCTION__, *msg);
+        return true;
     }
     else
     {
@@ -171,17 +289,11 @@ char *Connection::recvStr()
         }
 
         char * str = new char[size];
-        if (!str)
-        {
-            Logger::logError("Connection: mallocing in %s", __FUNCTION__);
-            return NULL;
-        }
 
         // Get the string.
-        uint32_t ret = read(m_fd, str, size);
-        if (ret < size)
+        if (!readBuffer(str, size))
         {
-            Logger::logError("Connection: getting string, got %u of %u bytes", ret, size);
+            Logger::logError("Connection: getting string of %u bytes failed", size);
             delete [] str;
             return NULL;
         }
@@ -197,20 +309,10 @@ char *Connection::recvStr()
     }
 }
 
-bool Connection::sendPid(pid_t pid)
-{
-    sendMsg(INVOKER_MSG_PID);
-    sendMsg(pid);
-
-    return true;
-}
-
 bool Connection::sendExitValue(int value)
 {
-    sendMsg(INVOKER_MSG_EXIT);
-    sendMsg(value);
-
-    return true;
+    const uint32_t msgs[2] = { INVOKER_MSG_EXIT, (uint32_t)value };
+    return sendMsgs(msgs, 2);
 }
 
 uint32_t Connection::receiveMagic()
@@ -218,11 +320,29 @@ uint32_t Connection::receiveMagic()
     uint32_t magic = 0;
 
     // Receive the magic.
-    recvMsg(&magic);
+    if (!recvMsg(&magic))
+        return -1;
 
     if ((magic & INVOKER_MSG_MASK) == INVOKER_MSG_MAGIC)
     {
-        if (!((magic & INVOKER_MSG_MAGIC_VERSION_MASK) == INVOKER_MSG_MAGIC_VERSION))
+        uint32_t version = magic & INVOKER_MSG_MAGIC_VERSION_MASK;
+        if (version == INVOKER_MSG_MAGIC_VERSION)
+        {
+            // Framed request: length of the rest of the request follows
+            uint32_t length = 0;
+            if (!recvMsg(&length) || length > INVOKER_MSG_FRAME_MAX)
+            {
+                Logger::logError("Connection: receiving bad request length (%u)\n", length);
+                return -1;
+            }
+
+            // Normally this is already buffered by the first receive
+            m_version = version;
+            m_frameLeft = length;
+            if (!fillBuffer(length))
+                return -1;
+        }
+        else if (version != INVOKER_MSG_MAGIC_VERSION_UNFRAMED)
         {
             Logger::logError("Connection: receiving bad magic version (%08x)\n", magic);
             return -1;
@@ -238,7 +358,8 @@ string Connection::receiveAppName()
     uint32_t msg = 0;
 
     // Get the action.
-    recvMsg(&msg);
+    if (!recvMsg(&msg))
+        return string();
     if (msg != INVOKER_MSG_NAME)
     {
         Logger::logError("Connection: receiving invalid action (%08x)", msg);
@@ -270,21 +391,33 @@ bool Connection::receiveExec()
 
 bool Connection::receivePriority()
 {
-    recvMsg(&m_priority);
-    return true;
+    return recvMsg(&m_priority);
 }
 
 bool Connection::receiveDelay()
 {
-    recvMsg(&m_delay);
+    return recvMsg(&m_delay);
+}
+
+bool Connection::recvMsg64(uint64_t *value)
+{
+    uint32_t lo = 0, hi = 0;
+    if (!recvMsg(&lo) || !recvMsg(&hi))
+        return false;
+    *value = ((uint64_t)hi << 32) | lo;
     return true;
 }
 
+bool Connection::receiveTrace()
+{
+    return (recvMsg64(&m_launchId) &&
+            recvMsg64(&m_invokerStart) &&
+            recvMsg64(&m_invokerConnect));
+}
+
 bool Connection::receiveIDs()
 {
-    recvMsg(&m_uid);
-    recvMsg(&m_gid);
-    return true;
+    return recvMsg(&m_uid) && recvMsg(&m_gid);
 }
 
 bool Connection::receiveArgs()
@@ -300,7 +433,8 @@ bool Connection::receiveArgs()
 
     // Get argc
     uint32_t argc = 0;
-    recvMsg(&argc);
+    if (!recvMsg(&argc))
+        return false;
     if (argc < 1 || argc > argMax) {
         Logger::logError("Connection: invalid number of parameters %d", m_argc);
         return false;
@@ -319,7 +453,7 @@ bool Connection::receiveArgs()
     return true;
 }
 
-bool Connection::receiveEnv()
+bool Connection::receiveEnv(bool apply)
 {
     // Have some "reasonable" limit for environment variables to protect from
     // malicious data
@@ -327,8 +461,9 @@ bool Connection::receiveEnv()
 
     // Get number of environment variables.
     uint32_t n_vars = 0;
-    recvMsg(&n_vars);
-    if (n_vars > 0 && n_vars < MAX_VARS)
+    if (!recvMsg(&n_vars))
+        return false;
+    if (n_vars < MAX_VARS)
     {
         // Get environment variables
         for (uint32_t i = 0; i < n_vars; i++)
@@ -339,7 +474,7 @@ bool Connection::receiveEnv()
                 Logger::logError("Connection: receiving environ[%i]", i);
                 return false;
             }
-            char *val = strchr(var, '=');
+            char *val = apply ? strchr(var, '=') : NULL;
             if (val) {
                 *val++ = 0;
                 const char *cur = getenv(var);
@@ -366,53 +501,82 @@ bool Connection::receiveEnv()
     return true;
 }
 
-bool Connection::receiveIO()
+bool Connection::receiveEnvDelta()
 {
-    int dummy = 0;
-
-    struct iovec iov;
-    iov.iov_base = &dummy;
-    iov.iov_len = 1;
-
-    char buf[CMSG_SPACE(sizeof(m_io))];
-    
-    struct msghdr msg;
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_iov        = &iov;
-    msg.msg_iovlen     = 1;
-    msg.msg_control    = buf;
-    msg.msg_controllen = sizeof(buf);
-
-    struct cmsghdr *cmsg;
-    cmsg             = CMSG_FIRSTHDR(&msg);
-    cmsg->cmsg_len   = CMSG_LEN(sizeof(m_io));
-    cmsg->cmsg_level = SOL_SOCKET;
-    cmsg->cmsg_type  = SCM_RIGHTS;
-
-    memcpy(CMSG_DATA(cmsg), m_io, sizeof(m_io));
-
-    if (recvmsg(m_fd, &msg, 0) < 0)
+    uint64_t digest = 0;
+    if (!recvMsg64(&digest))
+        return false;
+
+    // Only framed requests can ask for the full environment afterwards
+    if (m_version != INVOKER_MSG_MAGIC_VERSION || m_envResent)
     {
-        Logger::logWarning("Connection: recvmsg failed in invoked_get_io: %s", strerror(errno));
+        Logger::logError("Connection: unexpected environment delta\n");
         return false;
     }
 
-    if (msg.msg_flags)
+    // Variables equal to the baseline are already in our environment,
+    // a booster that is kept waiting restores it after each request
+    if (EnvBaseline::matches(digest))
+        return receiveEnv();
+
+    Logger::logDebug("Connection: unknown environment digest %016llx",
+                     (unsigned long long)digest);
+    m_envResend = true;
+    return receiveEnv(false);
+}
+
+bool Connection::receiveEnvFrame()
+{
+    const uint32_t resend = INVOKER_MSG_ENV_RESEND;
+    if (!sendMsgs(&resend, 1))
+        return false;
+
+    m_envResend = false;
+    m_envResent = true;
+
+    // Frame header: magic and payload length
+    uint32_t header[2] = { 0, 0 };
+    if (!fillBuffer(sizeof header))
+        return false;
+    memcpy(header, &m_buf[m_bufPos], sizeof header);
+    m_bufPos += sizeof header;
+
+    const uint32_t mask = INVOKER_MSG_MASK | INVOKER_MSG_MAGIC_VERSION_MASK;
+    if ((header[0] & mask) != (INVOKER_MSG_MAGIC | INVOKER_MSG_MAGIC_VERSION)
+        || header[1] > INVOKER_MSG_FRAME_MAX)
     {
-        Logger::logWarning("Connection: unexpected msg flags in invoked_get_io");
+        Logger::logError("Connection: bad environment frame (%08x, %u bytes)\n",
+                         header[0], header[1]);
         return false;
     }
 
-    cmsg = CMSG_FIRSTHDR(&msg);
-    if (cmsg == NULL || cmsg->cmsg_len != CMSG_LEN(sizeof(m_io)) ||
-        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    m_frameLeft = header[1];
+    return fillBuffer(m_frameLeft);
+}
+
+bool Connection::receiveIO()
+{
+    if (m_testMode)
+        return true;
+
+    // Unframed invoker sends the descriptors with a separate one byte
+    // message, framed invoker attaches them to the request itself
+    if (m_version != INVOKER_MSG_MAGIC_VERSION)
+    {
+        char dummy = 0;
+        if (!readBuffer(&dummy, 1))
+        {
+            Logger::logWarning("Connection: recvmsg failed in invoked_get_io");
+            return false;
+        }
+    }
+
+    if (!m_ioReceived)
     {
         Logger::logWarning("Connection: invalid cmsg in invoked_get_io");
         return false;
     }
 
-    memcpy(m_io, CMSG_DATA(cmsg), sizeof(m_io));
-
     return true;
 }
 
@@ -445,6 +609,11 @@ bool Connection::receiveActions()
                 return false;
             break;
 
+        case INVOKER_MSG_ENV_DELTA:
+            if (!receiveEnvDelta())
+                return false;
+            break;
+
         case INVOKER_MSG_PRIO:
             if (!receivePriority())
                 return false;
@@ -465,6 +634,11 @@ bool Connection::receiveActions()
                 return false;
             break;
 
+        case INVOKER_MSG_TRACE:
+            if (!receiveTrace())
+                return false;
+            break;
+
         case INVOKER_MSG_SPLASH:
             Logger::logError("Connection: received a now-unsupported MSG_SPLASH\n");
             return false;
@@ -474,11 +648,25 @@ bool Connection::receiveActions()
             return false;
 
         case INVOKER_MSG_END:
-            if (!sendMsg(INVOKER_MSG_ACK))
-                return false;
-            if (m_sendPid && !sendPid(getpid()))
+        {
+            if (m_version == INVOKER_MSG_MAGIC_VERSION && m_frameLeft != 0)
+            {
+                Logger::logError("Connection: %u bytes of garbage after request\n", m_frameLeft);
                 return false;
-            return true;
+            }
+
+            // The full environment follows in a frame of its own
+            if (m_envResend)
+            {
+                if (!receiveEnvFrame())
+                    return false;
+                break;
+            }
+
+            // Acknowledge and report pid with a single write
+            const uint32_t reply[3] = { INVOKER_MSG_ACK, INVOKER_MSG_PID, (uint32_t)getpid() };
+            return sendMsgs(reply, m_sendPid ? 3 : 1);
+        }
 
         default:
             Logger::logError("Connection: received invalid action (%08x)\n", action);
@@ -515,6 +703,10 @@ bool Connection::receiveApplicationData(AppData* appData)
         appData->setArgv((const char **)m_argv);
         appData->setIODescriptors(vector<int>(m_io, m_io + IO_DESCRIPTOR_COUNT));
         appData->setIDs(m_uid, m_gid);
+        appData->trace().setId(m_launchId);
+        appData->trace().setTime(LaunchTrace::InvokerStart, m_invokerStart);
+        appData->trace().setTime(LaunchTrace::InvokerConnect, m_invokerConnect);
+        appData->trace().mark(LaunchTrace::Received);
     }
     else
     {
@@ -27,8 +27,10 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 using std::string;
+using std::vector;
 
 #define IO_DESCRIPTOR_COUNT 3
 
@@ -115,8 +117,16 @@ private:
     //! Receive arguments
     bool receiveArgs();
 
-    //! Receive environment
-    bool receiveEnv();
+    /*! \brief Receive environment variables and set them.
+     *  \param apply If false, the variables are read and dropped.
+     */
+    bool receiveEnv(bool apply = true);
+
+    //! Receive variables that differ from the environment baseline
+    bool receiveEnvDelta();
+
+    //! Ask for the full environment and read the frame carrying it
+    bool receiveEnvFrame();
 
     //! Receive I/O descriptors
     bool receiveIO();
@@ -130,11 +140,14 @@ private:
     //! Receive booster respawn delay
     bool receiveDelay();
 
-    //! Send process pid
-    bool sendPid(pid_t pid);
+    //! Receive launch id and invoker timestamps
+    bool receiveTrace();
+
+    //! Receive a 64 bit value sent as two messages
+    bool recvMsg64(uint64_t *value);
 
-    //! Send message to a socket. This is a virtual to help unit testing.
-    virtual bool sendMsg(uint32_t msg);
+    //! Send messages to a socket with one write. This is a virtual to help unit testing.
+    virtual bool sendMsgs(const uint32_t *msgs, int count);
 
     //! Receive a message from a socket. This is a virtual to help unit testing.
     virtual bool recvMsg(uint32_t *msg);
@@ -142,6 +155,17 @@ private:
     //! Receive a string. This is a virtual to help unit testing.
     virtual char *recvStr();
 
+    /*! \brief Make sure the receive buffer holds at least size unread bytes.
+     * Descriptors that arrive with the data are stored to m_io.
+     */
+    bool fillBuffer(size_t size);
+
+    //! Take size bytes from the receive buffer
+    bool readBuffer(void *data, size_t size);
+
+    //! Store I/O descriptors passed in a control message
+    void takeDescriptors(struct msghdr *msg);
+
     //! Run in test mode, if true
     bool m_testMode;
 
@@ -161,6 +185,31 @@ private:
     gid_t    m_gid;
     uid_t    m_uid;
 
+    //! Protocol version used by the invoker
+    uint32_t m_version;
+
+    //! Unparsed bytes left in a framed request
+    uint32_t m_frameLeft;
+
+    //! Receive buffer, unread data is at [m_bufPos, m_bufLen)
+    vector<char> m_buf;
+    size_t       m_bufPos;
+    size_t       m_bufLen;
+
+    //! True when m_io holds descriptors received from the invoker
+    bool m_ioReceived;
+
+    //! Environment delta could not be applied, full environment is needed
+    bool m_envResend;
+
+    //! Full environment was already asked for
+    bool m_envResent;
+
+    //! Launch id and invoker timestamps, 0 if not received
+    uint64_t m_launchId;
+    uint64_t m_invokerStart;
+    uint64_t m_invokerConnect;
+
 
 #ifdef UNIT_TEST
     friend class Ut_Connection;
@@ -26,8 +26,20 @@
 #include "booster.h"
 #include "singleinstance.h"
 #include "socketmanager.h"
+#include "launchtrace.h"
+#include "envbaseline.h"
+#include "elfinfo.h"
+#include "preloadmanifest.h"
+#include "usageprofile.h"
+#include "respawnscheduler.h"
+#include "memorystats.h"
+#include "memorypressure.h"
+#include "instanceactivator.h"
+#include "zygote.h"
+#include "atomicfile.h"
 
 #include <deque>
+#include <algorithm>
 #include <cstdlib>
 #include <cerrno>
 #include <sys/capability.h>
@@ -44,26 +56,67 @@
 #include <fstream>
 #include <sstream>
 #include <libgen.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <systemd/sd-daemon.h>
 #include <unistd.h>
 #include <poll.h>
 #include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 
 #include "coverage.h"
 
-/* Setting VERBOSE_SIGNALS to non-zero value logs receiving of
- * async-signals - which is useful only when actively debugging
- * booster / invoker interoperation.
- */
-#define VERBOSE_SIGNALS 01
-
-
 // Environment
 extern char ** environ;
 
 Daemon * Daemon::m_instance = NULL;
 const int Daemon::m_boosterSleepTime = 2;
+const int Daemon::m_boosterCrashSleepTime = 1;
+const unsigned int Daemon::m_poolBurstWindow = 10000;
+
+// Teardown timeouts (ms)
+static const unsigned int DISCONNECT_TIMEOUT = 5000;
+static const unsigned int TERMINATE_TIMEOUT  = 10000;
+static const unsigned int KILL_TIMEOUT       = 10000;
+static const unsigned int LIVENESS_POLL      = 250;
+static const unsigned int SHUTDOWN_TIMEOUT   = 15000;
+
+// Upper limit (s) for the respawn delay of boosters that keep failing before ready
+static const int MAX_CRASH_SLEEP_TIME = 60;
+
+// Exit statuses of unknown reaped children kept for zygoteForked()
+static const size_t MAX_UNKNOWN_EXITS = 32;
+
+// Upper limit for --pool-min / --pool-max
+static const unsigned int MAX_POOL_SIZE = 16;
+
+// Time (ms) after a launch at which the libraries of the application are sampled
+static const unsigned int USAGE_SAMPLE_DELAY = 10000;
+
+// Upper limit for --backlog
+static const unsigned int MAX_BACKLOG = 4096;
+
+// Upper limit (s) for --idle-timeout
+static const unsigned int MAX_IDLE_TIMEOUT = 86400;
+
+// Upper limit (s) for --memory-stats
+static const unsigned int MAX_MEMORY_STATS_INTERVAL = 86400;
+
+// Time (ms) without memory pressure events after which pools are refilled
+static const unsigned int PRESSURE_CALM_TIME = 10000;
+
+// Time (ms) after which systemd is notified even if no booster is ready yet
+static const unsigned int READY_NOTIFY_TIMEOUT = 10000;
+
+// Change (ms) in the expected ready time of a pool that is worth publishing
+static const int READINESS_SLACK = 100;
+
+// Default and upper limit for --learned-preloads
+static const unsigned int DEFAULT_LEARNED_PRELOADS = 32;
+static const unsigned int MAX_LEARNED_PRELOADS = 256;
 
 static void write_dontcare(int fd, const void *data, size_t size)
 {
@@ -74,67 +127,73 @@ static void write_dontcare(int fd, const void *data, size_t size)
         Logger::logWarning("write to fd=%d failed", fd);
 }
 
-#if VERBOSE_SIGNALS
-static char *addstr(char *pos, char *end, const char *str)
+/* Tags stored in epoll event data: watch kind in the upper
+ * half, kind specific value (such as booster pid) in the lower.
+ */
+enum WatchKind {
+    WatchSignal = 1,
+    WatchBoosterSocket,
+    WatchInvoker,
+    WatchTimer,
+    WatchTeardown,
+    WatchListen,
+    WatchPressure,
+    WatchActivator,
+    WatchChild,
+    WatchTeardownExit,
+    WatchZygote,
+};
+
+static uint64_t watch_tag(WatchKind kind, uint32_t value)
 {
-    while (pos < end && *str)
-        *pos++ = *str++;
-    return pos;
+    return ((uint64_t)kind << 32) | value;
 }
-static char *addnum(char *pos, char *end, int num)
+
+static WatchKind watch_kind(uint64_t tag)
 {
-    char stk[64];
-    int sp = sizeof stk;
-    bool neg = (num < 0);
-    unsigned mag = (unsigned)(neg ? -num : num);
-    stk[--sp] = 0;
-    do {
-        stk[--sp] = '0' + mag % 10;
-    } while (mag /= 10);
-    if (neg)
-        stk[--sp] = '-';
-    return addstr(pos, end, &stk[sp]);
+    return (WatchKind)(tag >> 32);
 }
-#endif
 
-static void write_to_signal_pipe(int sig)
+static uint32_t watch_value(uint64_t tag)
 {
-#if VERBOSE_SIGNALS
-    char m[256];
-    char *p = m;
-    char *e = m + sizeof m - 1;
-    p = addstr(p, e, "*** signal=");
-    p = addnum(p, e, sig);
-    p = addstr(p, e, " pid=");
-    p = addnum(p, e, getpid());
-    p = addstr(p, e, "\n");
-    if (write(STDERR_FILENO, m, p - m) < 0) {
-        // dontcare
-    }
+    return (uint32_t)tag;
+}
+
+/* Process file descriptors (Linux 5.3+). A pidfd refers to one
+ * process for its whole lifetime, so signals sent through it can't
+ * hit another process that has got the same pid, and it becomes
+ * readable when the process exits.
+ */
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+#ifndef SO_PEERPIDFD
+#define SO_PEERPIDFD 77
 #endif
 
-    char v = (char)sig;
-    if (write(Daemon::instance()->sigPipeFd(), &v, 1) != 1) {
-        /* If we can't write to internal signal forwarding
-         * pipe, we might as well quit */
-        const char m[] = "*** signal pipe write failure - terminating\n";
-        if (write(STDERR_FILENO, m, sizeof m - 1) == -1) {
-            // dontcare
-        }
-        _exit(EXIT_FAILURE);
-    }
+static int pidfd_open(pid_t pid)
+{
+    return (int)syscall(SYS_pidfd_open, pid, 0);
 }
 
-static int read_from_signal_pipe(int fd)
+static int pidfd_send_signal(int pidfd, int sig)
 {
-    char sig = 0;
-    if (read(fd, &sig, 1) != 1) {
-        /* If we can't read from internal signal forwarding
-         * pipe, we might as well quit */
-        Logger::logError("signal pipe read failure - terminating\n");
-        exit(EXIT_FAILURE);
-    }
-    return sig;
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+}
+
+// Signal a booster through its pidfd if it has one, which can't refer to a reused pid
+static int signalBooster(const LaunchRecord &record, int sig)
+{
+    return record.pidFd != -1 ? pidfd_send_signal(record.pidFd, sig) : kill(record.boosterPid, sig);
+}
+
+// True if the record is of a booster waiting in the pool with the index
+static bool isPooledIn(const LaunchRecord *record, int pool)
+{
+    return record && record->state == LaunchRecord::Pooled && record->pool == pool;
 }
 
 static unsigned timestamp(void)
@@ -154,128 +213,547 @@ static unsigned timestamp(void)
             (unsigned)(ts.tv_nsec / (1000 * 1000u)));
 }
 
-static bool shutdown_socket(int socket_fd)
+Daemon::Daemon(int & argc, char * argv[]) :
+    m_daemon(false),
+    m_debugMode(false),
+    m_bootMode(false),
+    m_launches(),
+    m_childrenWithoutPidFd(0),
+    m_pools(),
+    m_boostedApplications(),
+    m_poolMin(1),
+    m_poolMax(1),
+    m_signalFd(-1),
+    m_epollFd(-1),
+    m_timerFd(-1),
+    m_shuttingDown(false),
+    m_shutdownDeadline(0),
+    m_usageSamples(),
+    m_learnedPreloads(DEFAULT_LEARNED_PRELOADS),
+    m_idleTimeout(0),
+    m_memoryStatsInterval(0),
+    m_memoryStatsDeadline(0),
+    m_memoryPressure(),
+    m_pressureLevel(MemoryPressure::None),
+    m_pressureDeadline(0),
+    m_socketManager(new SocketManager),
+    m_singleInstance(new SingleInstance),
+    m_instanceActivator(new InstanceActivator),
+    m_notifySystemd(false),
+    m_notifyPending(false),
+    m_notifyDeadline(0),
+    m_zygotes(false)
 {
-    bool disconnected = false;
+    // Open the log
+    Logger::openLog(argc > 0 ? argv[0] : "booster");
+    Logger::logDebug("starting..");
 
-    /* Close transmit end from our side, then wait
-     * for peer to receive EOF and close the receive
-     * end too.
-     */
+    // Block the signals we are interested in and receive them via
+    // signalfd instead. The mask is undone in boosters.
+    sigemptyset(&m_signalMask);
+    trapUnixSignal(SIGCHLD); // reap zombies
+    trapUnixSignal(SIGINT);  // exit launcher
+    trapUnixSignal(SIGTERM); // exit launcher
+    trapUnixSignal(SIGUSR1); // enter normal mode from boot mode
+    trapUnixSignal(SIGUSR2); // enter boot mode (same as --boot-mode)
+    trapUnixSignal(SIGPIPE); // broken invoker's pipe
+    trapUnixSignal(SIGHUP);  // re-exec
+
+    if (sigprocmask(SIG_BLOCK, &m_signalMask, NULL) == -1)
+    {
+        throw std::runtime_error("Daemon: Blocking Unix signals failed!\n");
+    }
+
+    if (!Daemon::m_instance)
+    {
+        Daemon::m_instance = this;
+    }
+    else
+    {
+        throw std::runtime_error("Daemon: Daemon already created!\n");
+    }
+
+    // Store arguments list
+    m_initialArgv = argv;
+    m_initialArgc = argc;
+
+    // Parse arguments
+    parseArgs(argc, argv);
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, m_boosterLauncherSocket) == -1)
+    {
+        throw std::runtime_error("Daemon: Creating a socket pair for boosters failed!\n");
+    }
 
-    debug("trying to disconnect booster socket...\n");
+    if ((m_signalFd = signalfd(-1, &m_signalMask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)
+    {
+        throw std::runtime_error("Daemon: Creating a signalfd for Unix signals failed!\n");
+    }
 
-    unsigned started = timestamp();
-    unsigned timeout = 5000;
+    if ((m_epollFd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    {
+        throw std::runtime_error("Daemon: Creating an epoll instance failed!\n");
+    }
 
-    if (shutdown(socket_fd, SHUT_WR) == -1) {
-        warning("socket shutdown failed: %m\n");
-        goto EXIT;
+    if ((m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+    {
+        throw std::runtime_error("Daemon: Creating a timerfd failed!\n");
     }
+}
 
-    for (;;) {
-        unsigned elapsed = timestamp() - started;
-        if (elapsed >= timeout)
-            break;
+Daemon * Daemon::instance()
+{
+    return Daemon::m_instance;
+}
 
-        struct pollfd pfd = {
-            .fd = socket_fd,
-            .events = POLLIN,
-            .revents = 0,
-        };
+vector<string> Daemon::boostedApplications() const
+{
+    vector<string> applications;
+    for (BoostedApplicationVect::const_iterator iter = m_boostedApplications.begin();
+         iter != m_boostedApplications.end(); ++iter)
+        applications.push_back(iter->name);
+    if (applications.empty())
+        applications.push_back("default");
+    return applications;
+}
 
-        debug("waiting for booster socket input...\n");
-        int rc = poll(&pfd, 1, (int)(timeout - elapsed));
+void Daemon::addBooster(Booster *booster, const string &application)
+{
+    booster->setBoostedApplication(application);
 
-        if (rc == 0)
-            break;
+    for (BoosterPoolVect::const_iterator iter = m_pools.begin(); iter != m_pools.end(); ++iter) {
+        if ((*iter)->booster->socketId() == booster->socketId()) {
+            Logger::logError("Daemon: booster %s added twice", booster->socketId().c_str());
+            delete booster;
+            return;
+        }
+    }
 
-        if (rc == -1) {
-            if (errno == EINTR || errno == EAGAIN)
-                continue;
-            warning("socket poll failed: %m\n");
-            goto EXIT;
+    BoosterPool *pool = new BoosterPool;
+    pool->booster = booster;
+    pool->index = m_pools.size();
+    pool->poolMin = m_poolMin;
+    pool->poolMax = m_poolMax;
+    pool->lastLaunchTime = 0;
+    pool->respawnDeadline = 0;
+    pool->preloadTime = 0;
+    pool->bareTime = 0;
+    pool->preloadDuration = 0;
+    pool->readyValue = 0;
+    pool->listenWatched = false;
+    pool->launchPending = false;
+    pool->learnedPreloads = 0;
+    pool->lazy = m_idleTimeout > 0 && booster->boostedApplication() != "default";
+    pool->idleDeadline = 0;
+    pool->zygote = -1;
+    pool->forkPending = 0;
+    pool->crashCount = 0;
+    pool->pooledCount = 0;
+    pool->bareCount = 0;
+    pool->readyCount = 0;
+
+    for (BoostedApplicationVect::const_iterator iter = m_boostedApplications.begin();
+         iter != m_boostedApplications.end(); ++iter) {
+        if (iter->name != application)
+            continue;
+        if (iter->poolMin)
+            pool->poolMin = iter->poolMin;
+        if (iter->poolMax)
+            pool->poolMax = iter->poolMax;
+        else if (iter->poolMin)
+            pool->poolMax = iter->poolMin;
+    }
+    if (pool->poolMax < pool->poolMin)
+        pool->poolMax = pool->poolMin;
+    // Lazy pools stay empty until the application is launched
+    pool->poolTarget = pool->lazy ? 0 : pool->poolMin;
+
+    // Application specific boosters learn what the application loads
+    if (booster->boostedApplication() != "default" && m_learnedPreloads > 0) {
+        const string path = UsageProfile::defaultFile(booster->boostedApplication(),
+                                                      booster->boosterType());
+        if (!path.empty()) {
+            pool->usageProfile.load(path);
+            pool->learnedPreloads = m_learnedPreloads;
         }
+    }
 
-        char buf[256];
-        rc = recv(socket_fd, buf, sizeof buf, MSG_DONTWAIT);
-        if (rc == 0) {
-            /* EOF -> peer closed the socket */
-            disconnected = true;
-            goto EXIT;
+    m_pools.push_back(pool);
+}
+
+void Daemon::run(Booster *booster)
+{
+    const vector<string> applications(boostedApplications());
+    if (applications.size() > 1)
+        Logger::logWarning("Daemon: serving only application %s", applications.front().c_str());
+    addBooster(booster, applications.front());
+    run();
+}
+
+void Daemon::run()
+{
+    if (m_pools.empty()) {
+        // Critical error unknown booster type. Exiting applauncherd.
+        Logger::logError("Daemon: no boosters to run\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Make sure that LD_BIND_NOW does not prevent dynamic linker to
+    // use lazy binding in later dlopen() calls.
+    unsetenv("LD_BIND_NOW");
+
+    // dlopen single-instance
+    loadSingleInstancePlugin();
+
+    // Boosters share the registry of running single-instance applications
+    m_singleInstance->initRegistry();
+
+    for (BoosterPoolVect::const_iterator iter = m_pools.begin(); iter != m_pools.end(); ++iter) {
+        Booster *booster = (*iter)->booster;
+
+        // Create socket for the booster
+        Logger::logDebug("Daemon: initing socket: %s", booster->socketId().c_str());
+        m_socketManager->initSocket(booster->socketId());
+
+        // Let invokers send only the variables that differ from ours
+        EnvBaseline::publish(m_socketManager->socketRootPath() + booster->socketId() + ".env");
+    }
+    m_socketManager->closeUnusedListenFds();
+
+    // Daemonize if desired
+    if (m_daemon)
+    {
+        daemonize();
+    }
+
+    // Boosters forked by zygotes are reparented to the launcher
+    if (m_zygotes && prctl(PR_SET_CHILD_SUBREAPER, 1) == -1) {
+        Logger::logWarning("Daemon: can't become a child subreaper, not using zygotes: %s",
+                           strerror(errno));
+        m_zygotes = false;
+    }
+    if (m_zygotes)
+        planZygotes();
+
+    // Fork the initial pools of boosters
+    fillBoosterPools();
+    m_memoryStatsDeadline = timestamp() + m_memoryStatsInterval * 1000;
+
+    // Notify systemd once the first booster is ready, see handleBoosterReady()
+    if (m_notifySystemd) {
+        m_notifyPending = true;
+        m_notifyDeadline = timestamp() + READY_NOTIFY_TIMEOUT;
+
+        bool forking = false;
+        for (BoosterPoolVect::const_iterator pool = m_pools.begin(); pool != m_pools.end(); ++pool)
+            forking = forking || (*pool)->poolTarget > 0;
+        if (!forking)
+            notifyReady("no boosters to wait for");
+    }
+
+    // Sockets and signals are registered once, invoker
+    // sockets are added and removed as launches come and go
+    addWatch(m_signalFd, watch_tag(WatchSignal, 0));
+    addWatch(m_boosterLauncherSocket[0], watch_tag(WatchBoosterSocket, 0));
+    addWatch(m_timerFd, watch_tag(WatchTimer, 0));
+
+    // Bus connection of the instance activator, opened before launches
+    // are served as the handshake blocks
+    m_instanceActivator->connect();
+    if (m_instanceActivator->fd() != -1)
+        addWatch(m_instanceActivator->fd(), watch_tag(WatchActivator, 0));
+
+    // Give memory back before the system has to kill something
+    if (m_memoryPressure.open()) {
+        const vector<int> &fds = m_memoryPressure.fds();
+        for (vector<int>::const_iterator iter = fds.begin(); iter != fds.end(); ++iter)
+            addWatch(*iter, watch_tag(WatchPressure, *iter), EPOLLPRI);
+    }
+
+    // Main loop
+    while (true)
+    {
+        const int MAX_EVENTS = 32;
+        struct epoll_event events[MAX_EVENTS];
+
+        // Wait for something appearing in the sockets.
+        int count = epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+        if (count == -1) {
+            if (errno != EINTR)
+                Logger::logError("Daemon: epoll_wait failed: %s", strerror(errno));
+            continue;
         }
 
-        if (rc == -1) {
-            warning("socket read failed: %m\n");
-            goto EXIT;
+        for (int i = 0; i < count; ++i) {
+            const uint64_t tag = events[i].data.u64;
+
+            switch (watch_kind(tag)) {
+            case WatchBoosterSocket:
+                // Booster took an application into use
+                Logger::logDebug("Daemon: booster socket readable");
+                readFromBoosterSocket(m_boosterLauncherSocket[0]);
+                break;
+
+            case WatchSignal:
+                // Check if we got SIGCHLD, SIGTERM, SIGUSR1 or SIGUSR2
+                readFromSignalFd();
+                break;
+
+            case WatchInvoker:
+                // Invoker socket got closed or has unexpected input
+                handleInvokerHangup(watch_value(tag));
+                break;
+
+            case WatchTimer:
+                // Some teardown step timed out
+                handleTimer();
+                break;
+
+            case WatchTeardown:
+                // Invoker socket that is being disconnected got input / EOF
+                handleTeardownSocket(watch_value(tag));
+                break;
+
+            case WatchListen:
+                // Invoker is waiting for a booster that is not ready
+                if (watch_value(tag) < m_pools.size())
+                    handlePendingLaunch(*m_pools[watch_value(tag)]);
+                break;
+
+            case WatchPressure:
+                // System is running short of memory
+                handleMemoryPressure(m_memoryPressure.read(watch_value(tag)));
+                break;
+
+            case WatchActivator:
+                // Session bus connection is readable / writable
+                m_instanceActivator->handleEvents();
+                break;
+
+            case WatchChild:
+                // Booster process exited
+                handleChildExit(watch_value(tag));
+                break;
+
+            case WatchTeardownExit:
+                // Invoker that is being terminated exited
+                handleTeardownExit(watch_value(tag));
+                break;
+
+            case WatchZygote:
+                // Zygote finished preloading or went away
+                if (watch_value(tag) < m_zygoteTree.size())
+                    handleZygoteMessage(watch_value(tag));
+                break;
+
+            default:
+                Logger::logWarning("Daemon: unexpected epoll event tag %llx",
+                                   (unsigned long long)tag);
+                break;
+            }
         }
+
+        // Activations requested by boosters during this round, repeated
+        // requests for the same application are sent once
+        m_instanceActivator->flush();
+
+        updateListenWatch();
+        publishReadiness();
+        updateTeardownTimer();
+        checkShutdown();
     }
-    warning("socket poll timeout\n");
+}
 
-EXIT:
-    if (disconnected)
-        debug("booster socket was succesfully disconnected\n");
-    else
-        warning("could not disconnect booster socket\n");
+void Daemon::addWatch(int fd, uint64_t tag, uint32_t events)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof event);
+    event.events = events;
+    event.data.u64 = tag;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+        Logger::logError("Daemon: can't watch fd=%d: %s", fd, strerror(errno));
+}
+
+void Daemon::removeWatch(int fd)
+{
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, NULL) == -1)
+        Logger::logWarning("Daemon: can't unwatch fd=%d: %s", fd, strerror(errno));
+}
 
-    return disconnected;
+void Daemon::readFromSignalFd()
+{
+    for (;;) {
+        struct signalfd_siginfo info;
+        ssize_t rc = read(m_signalFd, &info, sizeof info);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1 && errno == EAGAIN)
+            break;
+        if (rc != sizeof info) {
+            /* If we can't read from the signalfd,
+             * we might as well quit */
+            Logger::logError("signalfd read failure - terminating\n");
+            exit(EXIT_FAILURE);
+        }
+        handleSignal(info.ssi_signo);
+    }
 }
 
-static void kill_process(const char *label, pid_t pid)
+void Daemon::handleSignal(int sig)
 {
-    if (pid == -1) {
-        warning("%s pid is not known, can't kill it", label);
-        goto EXIT;
+    switch (sig)
+    {
+    case SIGCHLD:
+        Logger::logDebug("Daemon: SIGCHLD received.");
+        // Only needed for children without pidfd
+        reapZombies();
+        break;
+
+    case SIGINT:
+    case SIGTERM:
+        Logger::logDebug("Daemon: SIGINT / SIGTERM received.");
+        startShutdown();
+        break;
+
+    case SIGUSR1:
+        Logger::logDebug("Daemon: SIGUSR1 received.");
+        enterNormalMode();
+        break;
+
+    case SIGUSR2:
+        Logger::logDebug("Daemon: SIGUSR2 received.");
+        enterBootMode();
+        break;
+
+    case SIGPIPE:
+        /* Not logged: when the log output itself is a broken pipe,
+         * logging would raise SIGPIPE again, endlessly. */
+        break;
+
+    default:
+        break;
     }
+}
 
-    warning("sending SIGTERM to %s (pid=%d)", label, (int)pid);
+void Daemon::handleInvokerHangup(pid_t booster_pid)
+{
+    /* Note: bookkeeping must be updated first to avoid
+     *       any ringing due to socket closes / child
+     *       process exits.
+     */
+    int socket_fd = takeInvokerFd(booster_pid);
+    if (socket_fd == -1)
+        return;
 
-    if (kill(pid, SIGTERM) == -1)
-        goto FAIL;
+    pid_t invoker_pid = takeInvokerPid(booster_pid);
 
-    for (int i = 0; i < 10; ++i) {
-        sleep(1);
-        /* We use this function for both boosters and invokers.
-         * Boosters are child processes and we must use wait*()
-         * to reap them. But invokers are not descendants of
-         * booster daemon, so ECHILD failures are expected too.
-         */
-        int status = 0;
-        if (waitpid(pid, &status, WNOHANG) == -1 && errno != ECHILD)
-            warning("%s pid=%d) waitpid error: %m", label, (int)pid);
-        if (kill(pid, 0) == -1)
-            goto FAIL;
+    /* Note that it is slightly unexpected if we get here
+     * as it means invoker exited rather than application.
+     */
+    warning("terminating: booster:%d invoker:%d socket:%d",
+            (int)booster_pid, (int)invoker_pid, socket_fd);
+
+    /* Terminate invoker */
+    closeInvoker(invoker_pid, takeInvokerPidFd(booster_pid), socket_fd, EXIT_FAILURE);
+
+    /* Terminate booster */
+    terminateProcess("booster", booster_pid, true);
+}
+
+void Daemon::startShutdown()
+{
+    if (m_shuttingDown) {
+        Logger::logDebug("Daemon: already shutting down");
+        return;
+    }
+
+    m_shuttingDown = true;
+    m_shutdownDeadline = timestamp() + SHUTDOWN_TIMEOUT;
+
+    // FIXME: Legacy pid file path -> see daemonize()
+    const std::string pidFilePath = m_socketManager->socketRootPath() + m_pools.front()->booster->boosterType() + ".pid";
+    FILE * const pidFile = fopen(pidFilePath.c_str(), "r");
+    if (pidFile)
+    {
+        pid_t filePid;
+        if (fscanf(pidFile, "%d\n", &filePid) == 1 && filePid == getpid())
+        {
+            unlink(pidFilePath.c_str());
+        }
+        fclose(pidFile);
     }
 
-    warning("sending SIGKILL to %s (pid=%d)", label, (int)pid);
+    /* Zygotes exit when their socket is closed, and with the
+     * launcher at the latest.
+     */
+    for (size_t index = 0; index < m_zygoteTree.size(); ++index)
+        stopZygote(index);
+
+    /* Children are removed from bookkeeping as they get reaped,
+     * all teardowns proceed in parallel within the event loop.
+     */
+    const vector<pid_t> children(m_launches.pids());
+    for (vector<pid_t>::const_iterator iter = children.begin(); iter != children.end(); ++iter) {
+        pid_t booster_pid = *iter;
 
-    if (kill(pid, SIGKILL) == -1)
-        goto FAIL;
+        /* Get and remove booster socket  fd */
+        int socket_fd = takeInvokerFd(booster_pid);
 
-    for (int i = 0; i < 10; ++i) {
-        sleep(1);
-        int status = 0;
-        if (waitpid(pid, &status, WNOHANG) == -1 && errno != ECHILD)
-            warning("%s pid=%d) waitpid error: %m", label, (int)pid);
-        if (kill(pid, 0) == -1)
-            goto FAIL;
+        /* Get and remove invoker pid */
+        pid_t invoker_pid = takeInvokerPid(booster_pid);
+
+        /* Normally boosters are stopped on shutdown / user switch,
+         * and even then it should happen after applications have
+         * already been stopped.
+         */
+        warning("terminating: booster:%d invoker:%d socket:%d",
+                (int)booster_pid, (int)invoker_pid, socket_fd);
+
+        /* Terminate invoker */
+        closeInvoker(invoker_pid, takeInvokerPidFd(booster_pid), socket_fd, EXIT_FAILURE);
+
+        /* Terminate booster */
+        terminateProcess("booster", booster_pid, true);
     }
+}
 
-    warning("%s (pid=%d) did not exit", label, (int)pid);
-    goto EXIT;
+void Daemon::checkShutdown()
+{
+    if (!m_shuttingDown)
+        return;
 
-FAIL:
-    if (errno == ESRCH)
-        debug("%s (pid=%d) has exited", label, (int)pid);
-    else
-        warning("%s (pid=%d) kill failed: %m", label, (int)pid);
+    if (m_launches.size() == 0 && m_teardowns.empty()) {
+        Logger::logDebug("booster exit");
+        exit(EXIT_SUCCESS);
+    }
 
-EXIT:
-    return;
+    if ((int)(timestamp() - m_shutdownDeadline) >= 0) {
+        for (TeardownVect::const_iterator iter = m_teardowns.begin(); iter != m_teardowns.end(); ++iter) {
+            if (iter->pid != -1) {
+                warning("shutdown timeout: sending SIGKILL to %s (pid=%d)", iter->label, (int)iter->pid);
+                signalTeardown(*iter, SIGKILL);
+            }
+        }
+        for (size_t index = 0; index < m_launches.capacity(); ++index) {
+            if (const LaunchRecord *record = m_launches.slot(index))
+                signalBooster(*record, SIGKILL);
+        }
+
+        Logger::logWarning("Daemon: shutdown timeout, %u processes left behind",
+                           (unsigned)m_teardowns.size());
+        exit(EXIT_SUCCESS);
+    }
 }
 
-static void close_invoker(pid_t invoker_pid, int socket_fd, int exit_status)
+void Daemon::closeInvoker(pid_t invoker_pid, int pid_fd, int socket_fd, int exit_status)
 {
+    Teardown teardown;
+    teardown.label = "invoker";
+    teardown.pid = invoker_pid;
+    teardown.socketFd = -1;
+    teardown.child = false;
+    teardown.pidFd = pid_fd;
+
     if (socket_fd != -1) {
         Logger::logWarning("Daemon: sending exit(%d) to invoker(%d)\n",
                            exit_status, (int)invoker_pid);
@@ -284,554 +762,1888 @@ static void close_invoker(pid_t invoker_pid, int socket_fd, int exit_status)
         write_dontcare(socket_fd, &msg, sizeof msg);
         write_dontcare(socket_fd, &dta, sizeof dta);
 
-        if (shutdown_socket(socket_fd))
-            invoker_pid = -1;
-
-        close(socket_fd),
-            socket_fd = -1;
+        /* Close transmit end from our side, then wait
+         * for peer to receive EOF and close the receive
+         * end too.
+         */
+        debug("trying to disconnect booster socket...\n");
+
+        if (shutdown(socket_fd, SHUT_WR) == -1) {
+            warning("socket shutdown failed: %m\n");
+            warning("could not disconnect booster socket\n");
+            close(socket_fd);
+        } else {
+            teardown.state = Teardown::Disconnect;
+            teardown.socketFd = socket_fd;
+            teardown.deadline = timestamp() + DISCONNECT_TIMEOUT;
+            addWatch(socket_fd, watch_tag(WatchTeardown, socket_fd));
+            addTeardown(teardown);
+            return;
+        }
     }
 
     if (invoker_pid != -1)
-        kill_process("invoker", invoker_pid);
+        terminateProcess(teardown.label, invoker_pid, false, pid_fd);
+    else if (pid_fd != -1)
+        close(pid_fd);
 }
 
-Daemon::Daemon(int & argc, char * argv[]) :
-    m_daemon(false),
-    m_debugMode(false),
-    m_bootMode(false),
-    m_boosterPid(0),
-    m_socketManager(new SocketManager),
-    m_singleInstance(new SingleInstance),
-    m_notifySystemd(false),
-    m_booster(0)
+void Daemon::terminateProcess(const char *label, pid_t pid, bool child, int pid_fd)
 {
-    // Open the log
-    Logger::openLog(argc > 0 ? argv[0] : "booster");
-    Logger::logDebug("starting..");
+    if (pid == -1) {
+        warning("%s pid is not known, can't kill it", label);
+        if (pid_fd != -1)
+            close(pid_fd);
+        return;
+    }
 
-    // Install signal handlers. The original handlers are saved
-    // in the daemon instance so that they can be restored in boosters.
-    setUnixSignalHandler(SIGCHLD, write_to_signal_pipe); // reap zombies
-    setUnixSignalHandler(SIGINT,  write_to_signal_pipe); // exit launcher
-    setUnixSignalHandler(SIGTERM, write_to_signal_pipe); // exit launcher
-    setUnixSignalHandler(SIGUSR1, write_to_signal_pipe); // enter normal mode from boot mode
-    setUnixSignalHandler(SIGUSR2, write_to_signal_pipe); // enter boot mode (same as --boot-mode)
-    setUnixSignalHandler(SIGPIPE, write_to_signal_pipe); // broken invoker's pipe
-    setUnixSignalHandler(SIGHUP,  write_to_signal_pipe); // re-exec
+    Teardown teardown;
+    teardown.state = Teardown::Terminate;
+    teardown.label = label;
+    teardown.pid = pid;
+    teardown.socketFd = -1;
+    teardown.child = child;
+    teardown.pidFd = pid_fd;
+    teardown.deadline = timestamp() + TERMINATE_TIMEOUT;
 
-    if (!Daemon::m_instance)
-    {
-        Daemon::m_instance = this;
-    }
+    warning("sending SIGTERM to %s (pid=%d)", label, (int)pid);
+    if (signalTeardown(teardown, SIGTERM))
+        addTeardown(teardown);
     else
-    {
-        throw std::runtime_error("Daemon: Daemon already created!\n");
+        releaseTeardown(teardown);
+}
+
+void Daemon::addTeardown(const Teardown &teardown)
+{
+    // Exit of the process ends the teardown without polling
+    if (teardown.pidFd != -1)
+        addWatch(teardown.pidFd, watch_tag(WatchTeardownExit, teardown.pidFd));
+    m_teardowns.push_back(teardown);
+}
+
+void Daemon::releaseTeardown(Teardown &teardown)
+{
+    if (teardown.socketFd != -1) {
+        removeWatch(teardown.socketFd);
+        close(teardown.socketFd);
+        teardown.socketFd = -1;
+    }
+    if (teardown.pidFd != -1) {
+        // Closing removes the fd from the epoll set
+        close(teardown.pidFd);
+        teardown.pidFd = -1;
+    }
+}
+
+bool Daemon::signalTeardown(const Teardown &teardown, int sig)
+{
+    int rc = teardown.pidFd != -1 ? pidfd_send_signal(teardown.pidFd, sig)
+                                  : kill(teardown.pid, sig);
+    if (rc == -1) {
+        if (errno == ESRCH)
+            debug("%s (pid=%d) has exited", teardown.label, (int)teardown.pid);
+        else
+            warning("%s (pid=%d) kill failed: %m", teardown.label, (int)teardown.pid);
+        return false;
+    }
+    return true;
+}
+
+bool Daemon::advanceTeardown(Teardown &teardown, unsigned now)
+{
+    switch (teardown.state) {
+    case Teardown::Disconnect:
+        if ((int)(now - teardown.deadline) < 0)
+            return true;
+        warning("socket poll timeout\n");
+        warning("could not disconnect booster socket\n");
+        removeWatch(teardown.socketFd);
+        close(teardown.socketFd);
+        teardown.socketFd = -1;
+        if (teardown.pid == -1)
+            return false;
+        teardown.state = Teardown::Terminate;
+        teardown.deadline = now + TERMINATE_TIMEOUT;
+        warning("sending SIGTERM to %s (pid=%d)", teardown.label, (int)teardown.pid);
+        return signalTeardown(teardown, SIGTERM);
+
+    case Teardown::Terminate:
+    case Teardown::Kill:
+        /* Boosters are child processes and get reaped via
+         * their pidfds. Invokers are not descendants of booster
+         * daemon, they are watched via a pidfd too, or polled
+         * if the kernel does not support them.
+         */
+        if (!teardown.child && teardown.pidFd == -1 && kill(teardown.pid, 0) == -1 && errno == ESRCH) {
+            debug("%s (pid=%d) has exited", teardown.label, (int)teardown.pid);
+            return false;
+        }
+        if ((int)(now - teardown.deadline) < 0)
+            return true;
+        if (teardown.state == Teardown::Kill) {
+            warning("%s (pid=%d) did not exit", teardown.label, (int)teardown.pid);
+            return false;
+        }
+        teardown.state = Teardown::Kill;
+        teardown.deadline = now + KILL_TIMEOUT;
+        warning("sending SIGKILL to %s (pid=%d)", teardown.label, (int)teardown.pid);
+        return signalTeardown(teardown, SIGKILL);
+    }
+
+    return false;
+}
+
+void Daemon::handleTimer()
+{
+    uint64_t expirations = 0;
+    if (read(m_timerFd, &expirations, sizeof expirations) == -1 && errno != EAGAIN)
+        Logger::logWarning("Daemon: timerfd read failed: %s", strerror(errno));
+
+    const unsigned now = timestamp();
+    for (TeardownVect::iterator iter = m_teardowns.begin(); iter != m_teardowns.end();) {
+        if (advanceTeardown(*iter, now)) {
+            ++iter;
+        } else {
+            releaseTeardown(*iter);
+            iter = m_teardowns.erase(iter);
+        }
+    }
+
+    sampleUsage(now);
+    checkMemoryPressure(now);
+    checkRespawn();
+    checkIdle(now);
+
+    if (m_memoryStatsInterval && (int)(now - m_memoryStatsDeadline) >= 0) {
+        reportMemoryStats();
+        m_memoryStatsDeadline = now + m_memoryStatsInterval * 1000;
     }
 
-    // Store arguments list
-    m_initialArgv = argv;
-    m_initialArgc = argc;
+    if (m_notifyPending && (int)(now - m_notifyDeadline) >= 0)
+        notifyReady("no booster ready in time");
+}
+
+void Daemon::handleTeardownSocket(int socket_fd)
+{
+    for (TeardownVect::iterator iter = m_teardowns.begin(); iter != m_teardowns.end(); ++iter) {
+        if (iter->state != Teardown::Disconnect || iter->socketFd != socket_fd)
+            continue;
+
+        char buf[256];
+        ssize_t rc = recv(socket_fd, buf, sizeof buf, MSG_DONTWAIT);
+        if (rc > 0 || (rc == -1 && (errno == EINTR || errno == EAGAIN)))
+            return;
+
+        removeWatch(socket_fd);
+        close(socket_fd);
+        iter->socketFd = -1;
+
+        if (rc == 0) {
+            /* EOF -> peer closed the socket, no need to kill it */
+            debug("booster socket was succesfully disconnected\n");
+            releaseTeardown(*iter);
+            m_teardowns.erase(iter);
+            return;
+        }
+
+        warning("socket read failed: %m\n");
+        warning("could not disconnect booster socket\n");
+        if (iter->pid == -1) {
+            releaseTeardown(*iter);
+            m_teardowns.erase(iter);
+            return;
+        }
+        iter->state = Teardown::Terminate;
+        iter->deadline = timestamp() + TERMINATE_TIMEOUT;
+        warning("sending SIGTERM to %s (pid=%d)", iter->label, (int)iter->pid);
+        if (!signalTeardown(*iter, SIGTERM)) {
+            releaseTeardown(*iter);
+            m_teardowns.erase(iter);
+        }
+        return;
+    }
+}
+
+void Daemon::finishTeardown(pid_t pid)
+{
+    for (TeardownVect::iterator iter = m_teardowns.begin(); iter != m_teardowns.end(); ++iter) {
+        if (iter->child && iter->pid == pid) {
+            debug("%s (pid=%d) has exited", iter->label, (int)pid);
+            releaseTeardown(*iter);
+            m_teardowns.erase(iter);
+            return;
+        }
+    }
+}
+
+void Daemon::handleTeardownExit(int pid_fd)
+{
+    for (TeardownVect::iterator iter = m_teardowns.begin(); iter != m_teardowns.end(); ++iter) {
+        if (iter->pidFd == pid_fd) {
+            debug("%s (pid=%d) has exited", iter->label, (int)iter->pid);
+            releaseTeardown(*iter);
+            m_teardowns.erase(iter);
+            return;
+        }
+    }
+}
+
+void Daemon::sampleUsage(unsigned now)
+{
+    for (UsageSampleVect::iterator iter = m_usageSamples.begin(); iter != m_usageSamples.end();) {
+        if ((int)(now - iter->deadline) < 0) {
+            ++iter;
+            continue;
+        }
+        if (iter->pool->usageProfile.addSample(iter->pid, iter->dev, iter->ino))
+            iter->pool->usageProfile.save();
+        iter = m_usageSamples.erase(iter);
+    }
+}
+
+void Daemon::cancelUsageSample(pid_t pid)
+{
+    for (UsageSampleVect::iterator iter = m_usageSamples.begin(); iter != m_usageSamples.end(); ++iter) {
+        if (iter->pid == pid) {
+            m_usageSamples.erase(iter);
+            return;
+        }
+    }
+}
+
+void Daemon::reportMemoryStats() const
+{
+    for (BoosterPoolVect::const_iterator pool = m_pools.begin(); pool != m_pools.end(); ++pool) {
+        const string socketId = (*pool)->booster->socketId();
+
+        // What the boosters waiting for a launch cost
+        MemoryStats waiting;
+        unsigned int waitingCount = 0;
+        for (size_t index = 0; index < m_launches.capacity(); ++index) {
+            const LaunchRecord *record = m_launches.slot(index);
+            if (!isPooledIn(record, (*pool)->index))
+                continue;
+            MemoryStats stats;
+            if (!stats.read(record->boosterPid))
+                continue;
+            Logger::logDebug("MemoryStats: %s: waiting booster %d: %s", socketId.c_str(),
+                             record->boosterPid, stats.toString().c_str());
+            waiting.add(stats);
+            waitingCount++;
+        }
+
+        // How much of the launched applications is still shared, in
+        // total and in the libraries the boosters have preloaded
+        const vector<string> libraries = preloadedLibraries(**pool);
+        MemoryStats launched;
+        unsigned int launchedCount = 0;
+        for (size_t index = 0; index < m_launches.capacity(); ++index) {
+            const LaunchRecord *record = m_launches.slot(index);
+            if (!record || record->state != LaunchRecord::Launched || record->pool != (*pool)->index)
+                continue;
+            MemoryStats stats;
+            if (!stats.read(record->boosterPid))
+                continue;
+            stats.readLibraries(record->boosterPid, libraries);
+            Logger::logDebug("MemoryStats: %s: application %d (%s): %s, shared=%lu kB, "
+                             "preloads shared=%lu kB", socketId.c_str(),
+                             record->boosterPid, record->appName.c_str(),
+                             stats.toString().c_str(), stats.shared(), stats.librariesShared());
+            launched.add(stats);
+            launchedCount++;
+        }
+
+        Logger::logInfo("MemoryStats: %s: %u waiting boosters: %s", socketId.c_str(),
+                        waitingCount, waiting.toString().c_str());
+        if (launchedCount)
+            Logger::logInfo("MemoryStats: %s: %u applications: %s, shared=%lu kB, "
+                            "preloads shared=%lu kB (%lu%% of rss)",
+                            socketId.c_str(), launchedCount, launched.toString().c_str(),
+                            launched.shared(), launched.librariesShared(),
+                            launched.rss() ? launched.librariesShared() * 100 / launched.rss() : 0);
+    }
+}
+
+vector<string> Daemon::preloadedLibraries(const BoosterPool &pool) const
+{
+    // Boosters forked from zygotes also have the base manifest preloaded
+    vector<string> manifests(1, PreloadManifest::manifestFile(pool.booster->boosterType()));
+    if (pool.zygote != -1)
+        manifests.push_back(PreloadManifest::baseManifestFile());
+
+    vector<string> libraries;
+    for (vector<string>::const_iterator path = manifests.begin(); path != manifests.end(); ++path) {
+        PreloadManifest manifest;
+        if (!manifest.load(*path))
+            continue;
+        const vector<PreloadManifest::Item> &items = manifest.items();
+        for (vector<PreloadManifest::Item>::const_iterator item = items.begin(); item != items.end(); ++item) {
+            if (item->kind != PreloadManifest::Item::Library && item->kind != PreloadManifest::Item::Plugin)
+                continue;
+
+            // Mappings are listed by the resolved path
+            char resolved[PATH_MAX];
+            if (item->name[0] == '/' && realpath(item->name.c_str(), resolved))
+                libraries.push_back(resolved);
+            else
+                libraries.push_back(item->name);
+        }
+    }
+
+    // Learned preloads are paths read from maps already
+    if (pool.learnedPreloads > 0) {
+        const vector<string> learned = pool.usageProfile.top(pool.learnedPreloads);
+        libraries.insert(libraries.end(), learned.begin(), learned.end());
+    }
+    return libraries;
+}
+
+void Daemon::handleMemoryPressure(MemoryPressure::Level level)
+{
+    if (level == MemoryPressure::None)
+        return;
+
+    // Pressure is over once it has not been reported for a while
+    m_pressureDeadline = timestamp() + PRESSURE_CALM_TIME;
+    if (level <= m_pressureLevel)
+        return;
+
+    Logger::logInfo("Daemon: %s memory pressure", MemoryPressure::levelName(level));
+    m_pressureLevel = level;
+
+    // Zygotes are shared by the pools, their preloads are given up with the boosters
+    if (level == MemoryPressure::Severe) {
+        for (size_t index = 0; index < m_zygoteTree.size(); ++index)
+            stopZygote(index);
+    }
+
+    for (BoosterPoolVect::const_iterator pool = m_pools.begin(); pool != m_pools.end(); ++pool) {
+        // No new boosters until pressure is over, see fillBoosterPool()
+        (*pool)->respawnScheduler.cancel();
+
+        if (level == MemoryPressure::Severe)
+            logPoolState(**pool, "parked");
+
+        for (size_t index = 0; index < m_launches.capacity(); ++index) {
+            const LaunchRecord *record = m_launches.slot(index);
+            if (!isPooledIn(record, (*pool)->index))
+                continue;
+
+            if (level == MemoryPressure::Severe) {
+                // Preloaded boosters are given up. Bare ones are small and
+                // already serving a launch that is waiting for them.
+                if (!record->bare)
+                    killProcess(record->boosterPid, SIGTERM);
+            } else {
+                // Keep warm launches available, but with less memory
+                trimBooster(record->boosterPid);
+            }
+        }
+    }
+}
+
+void Daemon::checkMemoryPressure(unsigned int now)
+{
+    if (m_pressureLevel == MemoryPressure::None || (int)(now - m_pressureDeadline) < 0)
+        return;
+
+    Logger::logInfo("Daemon: memory pressure is over");
+    m_pressureLevel = MemoryPressure::None;
+
+    for (size_t index = 0; index < m_launches.capacity(); ++index) {
+        LaunchRecord *record = m_launches.slot(index);
+        if (record && record->state == LaunchRecord::Pooled)
+            record->trimmed = false;
+    }
+
+    // Preload again once the system has room for it
+    for (BoosterPoolVect::const_iterator pool = m_pools.begin(); pool != m_pools.end(); ++pool)
+        fillBoosterPool(**pool, m_boosterSleepTime);
+}
+
+void Daemon::trimBooster(pid_t pid)
+{
+    LaunchRecord *record = m_launches.find(pid);
+    if (!record || record->state != LaunchRecord::Pooled)
+        return;
+
+    // Boosters that are still preloading would dirty the pages again
+    if (record->progress != LaunchRecord::Ready || record->bare || record->trimmed)
+        return;
+
+    Logger::logDebug("Daemon: asking booster %d to trim its memory", pid);
+    record->trimmed = true;
+    if (signalBooster(*record, Booster::TrimSignal) == -1)
+        Logger::logWarning("Daemon: can't signal booster %d: %s", pid, strerror(errno));
+}
+
+void Daemon::updateTeardownTimer()
+{
+    /* Wake up at the nearest teardown deadline, or for the
+     * next liveness poll of a non-child process without pidfd.
+     */
+    const unsigned now = timestamp();
+    bool armed = false;
+    int delay = 0;
+
+    for (TeardownVect::const_iterator iter = m_teardowns.begin(); iter != m_teardowns.end(); ++iter) {
+        int left = (int)(iter->deadline - now);
+        if (!iter->child && iter->pidFd == -1 && iter->state != Teardown::Disconnect &&
+            left > (int)LIVENESS_POLL)
+            left = LIVENESS_POLL;
+        if (!armed || left < delay)
+            delay = left, armed = true;
+    }
+
+    if (m_shuttingDown) {
+        int left = (int)(m_shutdownDeadline - now);
+        if (!armed || left < delay)
+            delay = left, armed = true;
+    }
+
+    for (UsageSampleVect::const_iterator iter = m_usageSamples.begin(); iter != m_usageSamples.end(); ++iter) {
+        int left = (int)(iter->deadline - now);
+        if (!armed || left < delay)
+            delay = left, armed = true;
+    }
+
+    for (BoosterPoolVect::const_iterator iter = m_pools.begin(); iter != m_pools.end(); ++iter) {
+        if ((*iter)->respawnScheduler.isWaiting()) {
+            int left = (int)((*iter)->respawnDeadline - now);
+            if (!armed || left < delay)
+                delay = left, armed = true;
+        }
+        if ((*iter)->lazy && (*iter)->poolTarget > 0) {
+            int left = (int)((*iter)->idleDeadline - now);
+            if (!armed || left < delay)
+                delay = left, armed = true;
+        }
+    }
+
+    if (m_memoryStatsInterval) {
+        int left = (int)(m_memoryStatsDeadline - now);
+        if (!armed || left < delay)
+            delay = left, armed = true;
+    }
+
+    if (m_pressureLevel != MemoryPressure::None) {
+        int left = (int)(m_pressureDeadline - now);
+        if (!armed || left < delay)
+            delay = left, armed = true;
+    }
+
+    if (m_notifyPending) {
+        int left = (int)(m_notifyDeadline - now);
+        if (!armed || left < delay)
+            delay = left, armed = true;
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof spec);
+    if (armed) {
+        if (delay < 1)
+            delay = 1;
+        spec.it_value.tv_sec = delay / 1000;
+        spec.it_value.tv_nsec = (delay % 1000) * 1000000L;
+    }
+    if (timerfd_settime(m_timerFd, 0, &spec, NULL) == -1)
+        Logger::logWarning("Daemon: timerfd_settime failed: %s", strerror(errno));
+}
+
+int Daemon::takeInvokerFd(pid_t booster_pid)
+{
+    int socket_fd = -1;
+    if (LaunchRecord *record = m_launches.find(booster_pid)) {
+        socket_fd = record->invokerFd;
+        record->invokerFd = -1;
+        if (socket_fd != -1)
+            removeWatch(socket_fd);
+    }
+    return socket_fd;
+}
+
+int Daemon::takeInvokerPidFd(pid_t booster_pid)
+{
+    int pid_fd = -1;
+    if (LaunchRecord *record = m_launches.find(booster_pid)) {
+        pid_fd = record->invokerPidFd;
+        record->invokerPidFd = -1;
+    }
+    return pid_fd;
+}
+
+pid_t Daemon::takeInvokerPid(pid_t booster_pid)
+{
+    pid_t invoker_pid = -1;
+    if (LaunchRecord *record = m_launches.find(booster_pid)) {
+        invoker_pid = record->invokerPid;
+        record->invokerPid = -1;
+    }
+    return invoker_pid;
+}
+
+int Daemon::openInvokerPidFd(int socket_fd, pid_t invoker_pid)
+{
+    /* The socket refers to the process that connected it (Linux 6.5+),
+     * pidfd_open() may pick up an unrelated process if the invoker has
+     * already exited and its pid got reused.
+     */
+    int pid_fd = -1;
+    socklen_t len = sizeof pid_fd;
+    if (socket_fd != -1 && getsockopt(socket_fd, SOL_SOCKET, SO_PEERPIDFD, &pid_fd, &len) == 0)
+        return pid_fd;
+
+    pid_fd = pidfd_open(invoker_pid);
+    if (pid_fd == -1)
+        Logger::logDebug("Daemon: no pidfd for invoker %d: %s", invoker_pid, strerror(errno));
+    return pid_fd;
+}
+
+void Daemon::readFromBoosterSocket(int fd)
+{
+    int message = 0;
+    pid_t boosterPid = 0;
+    pid_t invokerPid = 0;
+    int delay = 0;
+    int socketFd = -1;
+    ElfInfo::Record elfRecord;
+    char name[PATH_MAX];
+
+    struct iovec iov[6];
+    char buf[CMSG_SPACE(sizeof socketFd)];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+
+    memset(iov, 0, sizeof iov);
+    memset(buf, 0, sizeof buf);
+    memset(&msg, 0, sizeof msg);
+    memset(&elfRecord, 0, sizeof elfRecord);
+    memset(name, 0, sizeof name);
+
+    iov[0].iov_base = &message;
+    iov[0].iov_len = sizeof message;
+    iov[1].iov_base = &boosterPid;
+    iov[1].iov_len = sizeof boosterPid;
+    iov[2].iov_base = &invokerPid;
+    iov[2].iov_len = sizeof invokerPid;
+    iov[3].iov_base = &delay;
+    iov[3].iov_len = sizeof delay;
+    iov[4].iov_base = &elfRecord;
+    iov[4].iov_len = sizeof elfRecord;
+    iov[5].iov_base = name;
+    iov[5].iov_len = sizeof name - 1;
+
+    msg.msg_iov        = iov;
+    msg.msg_iovlen     = 6;
+    msg.msg_name       = NULL;
+    msg.msg_namelen    = 0;
+    msg.msg_control    = buf;
+    msg.msg_controllen = sizeof buf;
+
+    if (recvmsg(fd, &msg, 0) == -1) {
+        Logger::logError("Daemon: Critical error communicating with booster. Exiting applauncherd.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len >= CMSG_LEN(sizeof(socketFd))) {
+            memcpy(&socketFd, CMSG_DATA(cmsg), sizeof socketFd);
+        }
+    }
+
+    if (message == Booster::MessageReady) {
+        if (socketFd != -1)
+            close(socketFd);
+        handleBoosterReady(boosterPid);
+        return;
+    }
+
+    if (message == Booster::MessagePreloading || message == Booster::MessagePreloaded) {
+        if (socketFd != -1)
+            close(socketFd);
+        handleBoosterPreload(boosterPid, message, delay > 0 ? delay : 0);
+        return;
+    }
+
+    if (message == Booster::MessageActivate) {
+        Logger::logDebug("Daemon: booster %d found %s running", boosterPid, name);
+        m_instanceActivator->activate(name, socketFd);
+        return;
+    }
+
+    Logger::logDebug("Daemon: booster=%d invoker=%d socket=%d delay=%d\n",
+                     boosterPid, invokerPid, socketFd, delay);
+
+    // Boosters forked from now on know how to launch the binary
+    ElfInfo::remember(elfRecord);
+
+    BoosterPool *pool = findPool(boosterPid);
+    LaunchRecord *record = m_launches.find(boosterPid);
+    if (pool && record) {
+        /* We were expecting booster details => update bookkeeping,
+         * the booster leaves the pool */
+        countPooled(*record, -1);
+        record->state = LaunchRecord::Launched;
+        record->launchTime = timestamp();
+        record->appName = name;
+        if (invokerPid > 0) {
+            // Store invoker pid, and the pidfd that is used
+            // for terminating the invoker race free
+            record->invokerPid = invokerPid;
+            record->invokerPidFd = openInvokerPidFd(socketFd, invokerPid);
+        }
+        if (socketFd != -1) {
+            // Store invoker socket and listen to invoker EOF
+            addWatch(socketFd, watch_tag(WatchInvoker, boosterPid));
+            record->invokerFd = socketFd, socketFd = -1;
+        }
+        if (pool->learnedPreloads > 0) {
+            // Look at what the application has loaded once it is up
+            UsageSample sample = { pool, boosterPid, elfRecord.dev, elfRecord.ino,
+                                   timestamp() + USAGE_SAMPLE_DELAY };
+            m_usageSamples.push_back(sample);
+        }
+        updatePoolTarget(*pool);
+    } else {
+        Logger::logWarning("Daemon: launch data from unknown booster %d\n", boosterPid);
+    }
+
+    if (socketFd != -1) {
+        /* If we are not going to use the received fd, it needs to be closed */
+        Logger::logWarning("Daemon: close stray socket file descriptor: %d\n", socketFd);
+        close(socketFd);
+    }
+
+    // Param guarantees some time for the just launched application
+    // to start up before forking new booster. Not doing this would
+    // slow down the start-up significantly on single core CPUs.
+
+    if (pool)
+        fillBoosterPool(*pool, delay);
+}
+
+void Daemon::fillBoosterPool(BoosterPool &pool, int sleepTime, int minSleepTime)
+{
+    // Boosters are not preloaded while memory is short
+    if (m_shuttingDown || m_pressureLevel != MemoryPressure::None || poolSize(pool) >= pool.poolTarget)
+        return;
+
+    // Boosters are forked from the zygote once it has preloaded
+    if (zygoteStarting(pool))
+        return;
+
+    // Not waiting for the just launched application in the boot mode
+    if ((m_bootMode && !pool.crashCount) || sleepTime <= 0) {
+        pool.respawnScheduler.cancel();
+        while (poolSize(pool) < pool.poolTarget)
+            forkBooster(pool);
+        logPoolState(pool, "filled");
+        return;
+    }
+
+    // Give the just launched application time to start up before
+    // forking, for as long as the system is busy
+    if (!pool.respawnScheduler.isWaiting()) {
+        Logger::logDebug("Daemon: respawning %s boosters within %ds",
+                         pool.booster->socketId().c_str(), sleepTime);
+        pool.respawnDeadline = timestamp() + pool.respawnScheduler.start(minSleepTime * 1000,
+                                                                         sleepTime * 1000);
+    }
+}
+
+void Daemon::fillBoosterPools()
+{
+    for (BoosterPoolVect::const_iterator iter = m_pools.begin(); iter != m_pools.end(); ++iter)
+        fillBoosterPool(**iter);
+}
+
+void Daemon::checkRespawn()
+{
+    const unsigned int now = timestamp();
+    for (BoosterPoolVect::const_iterator iter = m_pools.begin(); iter != m_pools.end(); ++iter) {
+        BoosterPool &pool = **iter;
+        if (!pool.respawnScheduler.isWaiting() || (int)(now - pool.respawnDeadline) < 0)
+            continue;
+
+        unsigned int delay = 0;
+        if (pool.respawnScheduler.check(delay))
+            fillBoosterPool(pool);
+        else
+            pool.respawnDeadline = timestamp() + delay;
+    }
+}
+
+void Daemon::checkIdle(unsigned int now)
+{
+    for (BoosterPoolVect::const_iterator iter = m_pools.begin(); iter != m_pools.end(); ++iter) {
+        BoosterPool &pool = **iter;
+        if (!pool.lazy || pool.poolTarget == 0 || pool.launchPending ||
+            (int)(now - pool.idleDeadline) < 0)
+            continue;
+
+        // Not launched for a while, give the memory of the boosters back.
+        // Boosters are removed from the pool as they get reaped and not
+        // replaced until the next launch wakes the pool up.
+        pool.poolTarget = 0;
+        pool.respawnScheduler.cancel();
+        logPoolState(pool, "idle");
+        for (size_t index = 0; pool.pooledCount + pool.bareCount > 0 && index < m_launches.capacity(); ++index) {
+            const LaunchRecord *record = m_launches.slot(index);
+            if (isPooledIn(record, pool.index))
+                killProcess(record->boosterPid, SIGTERM);
+        }
+    }
+}
+
+void Daemon::handleBoosterReady(pid_t pid)
+{
+    BoosterPool *pool = findPool(pid);
+    if (!pool) {
+        Logger::logWarning("Daemon: ready message from unknown booster %d\n", pid);
+        return;
+    }
+    LaunchRecord &booster = *m_launches.find(pid);
+
+    // Keep a running average of the time boosters take to get ready
+    const unsigned int elapsed = timestamp() - booster.forkTime;
+    unsigned int &average = booster.bare ? pool->bareTime : pool->preloadTime;
+    average = average ? (3 * average + elapsed) / 4 : elapsed;
+    setProgress(booster, LaunchRecord::Ready);
+    booster.progressTime = timestamp();
+    pool->launchPending = false;
+    pool->crashCount = 0;
+
+    Logger::logDebug("Daemon: %s booster %d ready in %u ms (average %u ms)",
+                     booster.bare ? "bare" : "preloaded", pid, elapsed, average);
+
+    notifyReady("first booster ready");
+
+    if (booster.bare)
+        return;
+
+    // Booster was forked before memory pressure began
+    if (m_pressureLevel != MemoryPressure::None)
+        trimBooster(pid);
+
+    // Bare boosters are not needed anymore, launches are served preloaded
+    for (size_t index = 0; pool->bareCount > 0 && index < m_launches.capacity(); ++index) {
+        const LaunchRecord *record = m_launches.slot(index);
+        if (isPooledIn(record, pool->index) && record->bare) {
+            Logger::logDebug("Daemon: terminating unused bare booster %d", record->boosterPid);
+            killProcess(record->boosterPid, SIGTERM);
+        }
+    }
+}
+
+void Daemon::handleBoosterPreload(pid_t pid, int message, unsigned int duration)
+{
+    BoosterPool *pool = findPool(pid);
+    if (!pool) {
+        Logger::logWarning("Daemon: preload message from unknown booster %d\n", pid);
+        return;
+    }
+
+    LaunchRecord &booster = *m_launches.find(pid);
+    booster.progressTime = timestamp();
+    if (message == Booster::MessagePreloading) {
+        setProgress(booster, LaunchRecord::Preloading);
+        return;
+    }
+
+    // Keep a running average of the time boosters spend preloading
+    setProgress(booster, LaunchRecord::Preloaded);
+    unsigned int &average = pool->preloadDuration;
+    average = average ? (3 * average + duration) / 4 : duration;
+
+    Logger::logDebug("Daemon: booster %d preloaded in %u ms (average %u ms)", pid, duration, average);
+}
+
+unsigned int Daemon::readyAt(const BoosterPool &pool, const LaunchRecord &booster)
+{
+    switch (booster.progress) {
+    case LaunchRecord::Forked:
+        return booster.forkTime + (booster.bare ? pool.bareTime : pool.preloadTime);
+
+    case LaunchRecord::Preloading:
+        // Started preloading later than usual if it had to wait for the CPU
+        if (pool.preloadDuration)
+            return booster.progressTime + pool.preloadDuration;
+        return booster.forkTime + pool.preloadTime;
+
+    default:
+        // Accepts launches as soon as it gets scheduled
+        return booster.progressTime;
+    }
+}
+
+void Daemon::publishReadiness()
+{
+    const unsigned int now = timestamp();
+
+    // Earliest time a preloaded booster of each pool without a ready
+    // one is expected to be ready, in one pass over the table
+    vector<unsigned int> boosterReadyAt(m_pools.size(), 0);
+    vector<bool> boosterPreloading(m_pools.size(), false);
+    bool scan = false;
+    for (BoosterPoolVect::const_iterator iter = m_pools.begin(); iter != m_pools.end() && !scan; ++iter)
+        scan = !hasReadyBooster(**iter) && (*iter)->pooledCount > 0;
+    for (size_t index = 0; scan && index < m_launches.capacity(); ++index) {
+        const LaunchRecord *booster = m_launches.slot(index);
+        if (!booster || booster->state != LaunchRecord::Pooled || booster->pool < 0 || booster->bare)
+            continue;
+        const unsigned int at = readyAt(*m_pools[booster->pool], *booster);
+        if (!boosterPreloading[booster->pool] || (int)(at - boosterReadyAt[booster->pool]) < 0) {
+            boosterReadyAt[booster->pool] = at;
+            boosterPreloading[booster->pool] = true;
+        }
+    }
+
+    for (BoosterPoolVect::const_iterator iter = m_pools.begin(); iter != m_pools.end(); ++iter) {
+        BoosterPool &pool = **iter;
+        if (m_socketManager->findSocket(pool.booster->socketId()) == -1)
+            continue;
+
+        /* The time a booster is expected to be ready is a timestamp()
+         * value, invokers read the same clock. Without boosters on the
+         * way it is the time preloading takes after a launch.
+         */
+        string state = "idle";
+        unsigned int zygoteLeft = 0;
+        unsigned int value = pool.preloadTime;
+        bool preloading = false;
+        if (hasReadyBooster(pool)) {
+            state = "ready";
+            value = 0;
+        } else {
+            if (zygotePreloading(pool, now, zygoteLeft)) {
+                value = now + zygoteLeft + pool.preloadTime;
+                preloading = true;
+            } else {
+                value += zygoteLeft;
+            }
+            const unsigned int at = boosterReadyAt[pool.index];
+            if (boosterPreloading[pool.index] && (!preloading || (int)(at - value) < 0))
+                value = at, preloading = true;
+            if (pool.forkPending > 0 && (!preloading || (int)(now + pool.preloadTime - value) < 0))
+                value = now + pool.preloadTime, preloading = true;
+            if (preloading)
+                state = "preloading";
+        }
+
+        // Estimates of zygotes that are late move with the clock
+        const int drift = (int)(value - pool.readyValue);
+        if (state == pool.readyState &&
+            (value == pool.readyValue || (preloading && drift > -READINESS_SLACK && drift < READINESS_SLACK)))
+            continue;
+        pool.readyState = state;
+        pool.readyValue = value;
+
+        std::ostringstream data;
+        data << state << ' ' << value << '\n';
+        const string path = m_socketManager->socketRootPath() + pool.booster->socketId() + ".ready";
+        if (!AtomicFile::replace(path, data.str()))
+            Logger::logWarning("Daemon: can't write %s: %s", path.c_str(), strerror(errno));
+    }
+}
+
+void Daemon::notifyReady(const char *reason)
+{
+    if (!m_notifyPending)
+        return;
+    m_notifyPending = false;
+
+    Logger::logDebug("Daemon: initialization done, %s. Notify systemd\n", reason);
+    sd_notify(0, "READY=1");
+}
+
+void Daemon::handlePendingLaunch(BoosterPool &pool)
+{
+    if (pool.launchPending || hasReadyBooster(pool))
+        return;
+    pool.launchPending = true;
+
+    // Lazy pool that is empty gets boosters again
+    if (pool.lazy && pool.poolTarget == 0) {
+        pool.poolTarget = pool.poolMin;
+        pool.idleDeadline = timestamp() + m_idleTimeout * 1000;
+        logPoolState(pool, "woken up");
+    }
+
+    // When would a preloaded booster be ready
+    const unsigned int now = timestamp();
+    unsigned int preloadLeft = pool.preloadTime;
+    bool preloading = false;
+    unsigned int zygoteLeft;
+    if (zygotePreloading(pool, now, zygoteLeft)) {
+        // The zygote forks the first booster once it has preloaded
+        preloadLeft = zygoteLeft + pool.preloadTime;
+        preloading = true;
+    }
+    if (pool.forkPending > 0) {
+        // Asked from the zygote, forked any moment
+        if (!preloading || pool.preloadTime < preloadLeft)
+            preloadLeft = pool.preloadTime;
+        preloading = true;
+    }
+    const bool bareForked = pool.bareCount > 0;
+    for (size_t index = 0; pool.pooledCount > 0 && index < m_launches.capacity(); ++index) {
+        const LaunchRecord *booster = m_launches.slot(index);
+        if (!isPooledIn(booster, pool.index) || booster->bare)
+            continue;
+        const int late = (int)(now - readyAt(pool, *booster));
+        const unsigned int left = late < 0 ? -late : 0;
+        if (!preloading || left < preloadLeft)
+            preloadLeft = left;
+        preloading = true;
+    }
+
+    const string socketId = pool.booster->socketId();
+    if (bareForked) {
+        Logger::logInfo("Daemon: launch waiting on %s, bare booster already starting",
+                        socketId.c_str());
+    } else if (preloadLeft > pool.bareTime) {
+        // Serve the launch without preloads, the pool is filled as scheduled
+        Logger::logInfo("Daemon: launch waiting on %s, forking bare booster (preload %u ms left, bare %u ms)",
+                        socketId.c_str(), preloadLeft, pool.bareTime);
+        forkBooster(pool, true);
+    } else if (!preloading && m_pressureLevel != MemoryPressure::None) {
+        // Pools are not filled under memory pressure
+        Logger::logInfo("Daemon: launch waiting on %s under memory pressure, forking bare booster",
+                        socketId.c_str());
+        forkBooster(pool, true);
+    } else if (!preloading) {
+        Logger::logInfo("Daemon: launch waiting on %s, respawning boosters now", socketId.c_str());
+        fillBoosterPool(pool);
+    } else {
+        Logger::logInfo("Daemon: launch waiting on %s, booster ready in %u ms",
+                        socketId.c_str(), preloadLeft);
+    }
+}
+
+void Daemon::updateListenWatch()
+{
+    for (size_t i = 0; i < m_pools.size(); ++i) {
+        BoosterPool &pool = *m_pools[i];
+        const int socketFd = m_socketManager->findSocket(pool.booster->socketId());
+        const bool watch = socketFd != -1 && !m_shuttingDown && !pool.launchPending && !hasReadyBooster(pool);
+        if (watch == pool.listenWatched)
+            continue;
+
+        if (watch)
+            addWatch(socketFd, watch_tag(WatchListen, i));
+        else
+            removeWatch(socketFd);
+        pool.listenWatched = watch;
+    }
+}
+
+void Daemon::countPooled(const LaunchRecord &record, int delta)
+{
+    if (record.state != LaunchRecord::Pooled || record.pool < 0)
+        return;
+    BoosterPool &pool = *m_pools[record.pool];
+    (record.bare ? pool.bareCount : pool.pooledCount) += delta;
+    if (record.progress == LaunchRecord::Ready)
+        pool.readyCount += delta;
+}
+
+void Daemon::setProgress(LaunchRecord &record, LaunchRecord::Progress progress)
+{
+    countPooled(record, -1);
+    record.progress = progress;
+    countPooled(record, 1);
+}
+
+unsigned int Daemon::poolSize(const BoosterPool &pool) const
+{
+    return pool.pooledCount + pool.forkPending;
+}
+
+bool Daemon::hasReadyBooster(const BoosterPool &pool) const
+{
+    return pool.readyCount > 0;
+}
+
+void Daemon::updatePoolTarget(BoosterPool &pool)
+{
+    // A launch that arrives within the burst window of the previous one
+    // grows the pool so that the next burst is served by warm boosters.
+    // Once launches have calmed down, the pool shrinks back to its
+    // minimum size simply by not replacing the consumed boosters.
+    const unsigned now = timestamp();
+    const bool burst = pool.lastLaunchTime && now - pool.lastLaunchTime < m_poolBurstWindow;
+    pool.lastLaunchTime = now;
+
+    if (burst && pool.poolTarget < pool.poolMax)
+        ++pool.poolTarget;
+    else if (!burst && pool.poolTarget != pool.poolMin)
+        pool.poolTarget = pool.poolMin;
+
+    // Lazy pool is kept filled for a while after each launch
+    if (pool.lazy)
+        pool.idleDeadline = now + m_idleTimeout * 1000;
+
+    logPoolState(pool, burst ? "burst launch" : "launch");
+}
+
+void Daemon::logPoolState(const BoosterPool &pool, const char *reason) const
+{
+    Logger::logInfo("Daemon: booster pool %s (%s): %u waiting, target %u (min %u, max %u)",
+                    pool.booster->socketId().c_str(), reason, poolSize(pool),
+                    pool.poolTarget, pool.poolMin, pool.poolMax);
+}
+
+Daemon::BoosterPool *Daemon::findPool(pid_t pid) const
+{
+    const LaunchRecord *record = pid > 0 ? m_launches.find(pid) : NULL;
+    if (!record || record->state != LaunchRecord::Pooled || record->pool < 0)
+        return NULL;
+    return m_pools[record->pool];
+}
+
+void Daemon::killProcess(pid_t pid, int signal) const
+{
+    if (pid > 0)
+    {
+        // Boosters are terminated routinely, e.g. when idle or under memory pressure
+        if (signal == SIGTERM)
+            Logger::logDebug("Daemon: Terminating pid %d", pid);
+        else
+            Logger::logWarning("Daemon: Killing pid %d with %d", pid, signal);
+
+        const LaunchRecord *record = m_launches.find(pid);
+        if ((record ? signalBooster(*record, signal) : kill(pid, signal)) != 0)
+        {
+            Logger::logError("Daemon: Failed to kill %d: %s\n",
+                             pid, strerror(errno));
+        }
+    }
+}
+
+void Daemon::loadSingleInstancePlugin()
+{
+    void * handle = dlopen(SINGLE_INSTANCE_PATH, RTLD_NOW);
+    if (!handle)
+    {
+        Logger::logWarning("Daemon: dlopening single-instance failed: %s", dlerror());
+    }
+    else
+    {
+        if (m_singleInstance->validateAndRegisterPlugin(handle))
+        {
+            Logger::logDebug("Daemon: single-instance plugin loaded.'");
+        }
+        else
+        {
+            Logger::logWarning("Daemon: Invalid single-instance plugin: '%s'",
+                               SINGLE_INSTANCE_PATH);
+        }
+    }
+}
+
+void Daemon::dropCapabilities()
+{
+    cap_t caps = cap_init();
+
+    if (!caps || cap_set_proc(caps) == -1) {
+        Logger::logError("Daemon: Failed to drop capabilities");
+    }
+
+    if (caps) {
+        cap_free(caps);
+    }
+}
+
+void Daemon::forkBooster(BoosterPool &pool, bool bare)
+{
+    // Respawning is a fork of the preloaded zygote
+    if (!bare && forkFromZygote(pool))
+        return;
+
+    // Fork a new process
+    pid_t newPid = fork();
+
+    if (newPid == -1)
+        throw std::runtime_error("Daemon: Forking while invoking");
+
+    if (newPid == 0) /* Child process */
+    {
+        prepareChild();
+
+        // Will get this signal if applauncherd dies
+        prctl(PR_SET_PDEATHSIG, SIGHUP);
+
+        runBooster(pool, bare);
+    }
+    else /* Parent process */
+    {
+        addChild(pool, newPid, bare);
+    }
+}
+
+void Daemon::prepareChild()
+{
+    // Will be reopened with new identity when/if
+    // there is something to report
+    Logger::closeLog();
+
+    // Restore used signal handlers
+    restoreUnixSignalHandlers();
+
+    // Close unused read end of the booster socket
+    close(m_boosterLauncherSocket[0]);
+
+    // Close signal and event loop file descriptors
+    close(m_signalFd);
+    close(m_epollFd);
+    close(m_timerFd);
+    m_memoryPressure.close();
+    m_instanceActivator->closeInChild();
+
+    // Close sockets and pidfds of processes that are being terminated
+    for (TeardownVect::iterator iter = m_teardowns.begin(); iter != m_teardowns.end(); ++iter) {
+        if (iter->socketFd != -1)
+            close(iter->socketFd);
+        if (iter->pidFd != -1)
+            close(iter->pidFd);
+    }
+    m_teardowns.clear();
+    m_usageSamples.clear();
+
+    // Close pidfds of boosters and invokers, and invoker sockets
+    for (size_t index = 0; index < m_launches.capacity(); ++index) {
+        const LaunchRecord *record = m_launches.slot(index);
+        if (!record)
+            continue;
+        if (record->pidFd != -1)
+            close(record->pidFd);
+        if (record->invokerPidFd != -1)
+            close(record->invokerPidFd);
+        if (record->invokerFd != -1)
+            close(record->invokerFd);
+    }
+    m_launches.clear();
+
+    // Close zygote sockets
+    for (ZygoteVect::iterator iter = m_zygoteTree.begin(); iter != m_zygoteTree.end(); ++iter) {
+        if (iter->fd != -1)
+            close(iter->fd);
+        iter->fd = -1;
+    }
+}
+
+void Daemon::runBooster(BoosterPool &pool, bool bare)
+{
+    Booster *booster = pool.booster;
+
+    // Set session id
+    if (setsid() < 0)
+        Logger::logError("Daemon: Couldn't set session id\n");
+
+    Logger::logDebug("Daemon: Running a new %sBooster of type '%s' for '%s'",
+                     bare ? "bare " : "", booster->boosterType().c_str(),
+                     booster->boostedApplication().c_str());
+
+    // Preload what the application needed in earlier launches
+    if (pool.learnedPreloads > 0 && !bare)
+        booster->setLearnedPreloads(pool.usageProfile.top(pool.learnedPreloads));
+
+    // Initialize and wait for commands from invoker
+    try {
+        booster->initialize(m_initialArgc, m_initialArgv, m_boosterLauncherSocket[1],
+                            m_socketManager->findSocket(booster->socketId()),
+                            m_singleInstance, m_bootMode || bare);
+    } catch (const std::runtime_error &e) {
+        Logger::logError("Booster: Failed to initialize: %s\n", e.what());
+        delete booster;
+        _exit(EXIT_FAILURE);
+    }
+
+    m_instance = NULL;
+
+    // No need for capabilities anymore
+    dropCapabilities();
+
+    // Run the current Booster
+    int retval = booster->run(m_socketManager);
+
+    // Finish
+    delete booster;
 
-    // Parse arguments
-    parseArgs(argc, argv);
+    // _exit() instead of exit() to avoid situation when destructors
+    // for static objects may be run incorrectly
+    _exit(retval);
+}
 
-    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, m_boosterLauncherSocket) == -1)
-    {
-        throw std::runtime_error("Daemon: Creating a socket pair for boosters failed!\n");
+bool Daemon::addChild(BoosterPool &pool, pid_t newPid, bool bare)
+{
+    // Store the pid so that we can reap it later
+    // The new booster waits in the pool until it is used for a launch,
+    // so that we know which boosters to restart when they exit.
+    LaunchRecord &record = m_launches.insert(newPid);
+    record.forkTime = timestamp();
+    record.progressTime = record.forkTime;
+    record.pool = pool.index;
+    record.bare = bare;
+    countPooled(record, 1);
+
+    /* The child can't be reaped by anyone else, so the pid refers
+     * to it until we wait for it. Its pidfd wakes the event loop
+     * for exactly this process. Without pidfd support it is
+     * reaped on SIGCHLD.
+     */
+    record.pidFd = pidfd_open(newPid);
+    if (record.pidFd != -1) {
+        addWatch(record.pidFd, watch_tag(WatchChild, newPid));
+
+        // A status of an earlier process with the same pid is stale
+        int status;
+        takeUnknownExit(newPid, status);
+        return true;
     }
 
-    if (pipe(m_sigPipeFd) == -1)
-    {
-        throw std::runtime_error("Daemon: Creating a pipe for Unix signals failed!\n");
+    const int error = errno;
+    Logger::logDebug("Daemon: no pidfd for booster %d: %s", newPid, strerror(error));
+    m_childrenWithoutPidFd++;
+    if (error != ESRCH)
+        return true;
+
+    /* Booster forked by a zygote has exited and been reaped
+     * before the zygote told about it, handle the exit now.
+     */
+    int status = 0;
+    if (!takeUnknownExit(newPid, status)) {
+        Logger::logWarning("Daemon: booster %d was reaped, exit status not known", newPid);
+        status = W_EXITCODE(EXIT_FAILURE, 0);
     }
+    handleExitedChildren(vector<std::pair<pid_t, int> >(1, std::make_pair(newPid, status)));
+    return false;
 }
 
-Daemon * Daemon::instance()
+bool Daemon::takeUnknownExit(pid_t pid, int &status)
 {
-    return Daemon::m_instance;
+    for (vector<std::pair<pid_t, int> >::iterator iter = m_unknownExits.begin();
+         iter != m_unknownExits.end(); ++iter) {
+        if (iter->first == pid) {
+            status = iter->second;
+            m_unknownExits.erase(iter);
+            return true;
+        }
+    }
+    return false;
 }
 
-void Daemon::run(Booster *booster)
+void Daemon::planZygotes()
 {
-    m_booster = booster;
+    // The base layer is only worth a process if there is something to share
+    int base = -1;
+    if (!m_pools.empty() && access(PreloadManifest::baseManifestFile().c_str(), R_OK) == 0)
+        base = addZygote(Zygote::StageBase, -1, 0);
+
+    for (size_t index = 0; index < m_pools.size(); ++index) {
+        BoosterPool &pool = *m_pools[index];
+
+        // Lazy pools give their memory back when idle, a zygote would keep it
+        if (pool.lazy)
+            continue;
+
+        // Pools of the same booster type share the zygote of the type
+        int type = -1;
+        for (size_t i = 0; i < m_zygoteTree.size() && type == -1; ++i) {
+            const ZygoteProcess &zygote = m_zygoteTree[i];
+            if (zygote.stage == Zygote::StageType &&
+                m_pools[zygote.pool]->booster->boosterType() == pool.booster->boosterType())
+                type = i;
+        }
+        if (type == -1)
+            type = addZygote(Zygote::StageType, base, index);
 
-    if (!m_boostedApplication.empty())
-        m_booster->setBoostedApplication(m_boostedApplication);
+        // Learned preloads differ between applications
+        pool.zygote = pool.learnedPreloads > 0 ? addZygote(Zygote::StageApplication, type, index) : type;
+    }
+}
 
-    // Make sure that LD_BIND_NOW does not prevent dynamic linker to
-    // use lazy binding in later dlopen() calls.
-    unsetenv("LD_BIND_NOW");
+int Daemon::addZygote(Zygote::Stage stage, int parent, unsigned int pool)
+{
+    ZygoteProcess zygote;
+    zygote.stage = stage;
+    zygote.parent = parent;
+    zygote.pool = pool;
+    zygote.pid = -1;
+    zygote.fd = -1;
+    zygote.pending = 0;
+    zygote.forkTime = 0;
+    zygote.requested = false;
+    zygote.preloadTime = 0;
+    zygote.ready = false;
+    zygote.failed = false;
+    zygote.stopping = false;
+    m_zygoteTree.push_back(zygote);
+    return m_zygoteTree.size() - 1;
+}
 
-    // dlopen single-instance
-    loadSingleInstancePlugin();
+string Daemon::zygoteName(const ZygoteProcess &zygote) const
+{
+    const Booster *booster = m_pools[zygote.pool]->booster;
+    switch (zygote.stage) {
+    case Zygote::StageBase:
+        return "base";
+    case Zygote::StageType:
+        return booster->boosterType();
+    default:
+        return booster->socketId();
+    }
+}
 
-    // Create socket for the booster
-    Logger::logDebug("Daemon: initing socket: %s", booster->boosterType().c_str());
-    m_socketManager->initSocket(booster->socketId());
+void Daemon::forkZygote(int index)
+{
+    ZygoteProcess &zygote = m_zygoteTree[index];
+
+    if (zygote.parent != -1) {
+        // Forked by its parent, so that it shares the pages of the parent
+        ZygoteProcess &parent = m_zygoteTree[zygote.parent];
+        if (!Zygote::requestZygote(parent.fd, index)) {
+            Logger::logWarning("Daemon: can't ask zygote %d for the %s zygote", parent.pid,
+                               zygoteName(zygote).c_str());
+            stopZygote(zygote.parent);
+            return;
+        }
 
-    // Daemonize if desired
-    if (m_daemon)
-    {
-        daemonize();
+        // Started when the reply comes, see zygoteForkedZygote()
+        parent.pending++;
+        zygote.requested = true;
+        zygote.forkTime = timestamp();
+        return;
     }
 
-    // Fork each booster for the first time
-    Logger::logDebug("Daemon: forking booster: %s", booster->boosterType().c_str());
-    forkBooster();
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1) {
+        Logger::logError("Daemon: can't create zygote socket: %s", strerror(errno));
+        zygote.failed = true;
+        return;
+    }
 
-    // Notify systemd that init is done
-    if (m_notifySystemd) {
-        Logger::logDebug("Daemon: initialization done. Notify systemd\n");
-        sd_notify(0, "READY=1");
+    const pid_t launcherPid = getpid();
+    const pid_t newPid = fork();
+    if (newPid == -1) {
+        Logger::logError("Daemon: can't fork zygote: %s", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        zygote.failed = true;
+        return;
     }
 
-    // Main loop
-    while (true)
+    if (newPid == 0) /* Zygote process */
     {
-        // Variables used by the select call
-        fd_set rfds;
-        int ndfs = 0;
+        prepareChild();
+        close(fds[0]);
 
-        // Init data for select
-        FD_ZERO(&rfds);
+        // Will get this signal if applauncherd dies
+        prctl(PR_SET_PDEATHSIG, SIGHUP);
 
-        FD_SET(m_boosterLauncherSocket[0], &rfds);
-        ndfs = std::max(ndfs, m_boosterLauncherSocket[0]);
+        runZygote(index, fds[1], launcherPid);
+    }
 
-        FD_SET(m_sigPipeFd[0], &rfds);
-        ndfs = std::max(ndfs, m_sigPipeFd[0]);
+    close(fds[1]);
+    zygote.forkTime = timestamp();
+    zygoteStarted(index, newPid, fds[0]);
+}
 
-        /* Listen to invoker EOFs */
-        for (auto iter = m_boosterPidToInvokerFd.begin(); iter != m_boosterPidToInvokerFd.end(); ++iter) {
-            int fd = iter->second;
-            if (fd != -1) {
-                FD_SET(fd, &rfds);
-                ndfs = std::max(ndfs, fd);
-            }
+void Daemon::zygoteStarted(int index, pid_t pid, int fd)
+{
+    ZygoteProcess &zygote = m_zygoteTree[index];
+    zygote.pid = pid;
+    zygote.fd = fd;
+    zygote.pending = 0;
+    zygote.requested = false;
+    zygote.ready = false;
+    zygote.stopping = false;
+    addWatch(zygote.fd, watch_tag(WatchZygote, index));
+
+    Logger::logDebug("Daemon: forked %s zygote %d", zygoteName(zygote).c_str(), pid);
+}
+
+void Daemon::runZygote(int index, int fd, pid_t launcherPid)
+{
+    // Every round is a new process, forked from the zygote of the previous one
+    for (;;) {
+        const ZygoteProcess &zygote = m_zygoteTree[index];
+        BoosterPool &pool = *m_pools[zygote.pool];
+
+        if (setsid() < 0)
+            Logger::logError("Daemon: Couldn't set session id\n");
+
+        Logger::logDebug("Daemon: Running the %s zygote", zygoteName(zygote).c_str());
+
+        if (zygote.parent != -1)
+            inheritZygote(zygote.parent, pool);
+        if (zygote.stage == Zygote::StageApplication)
+            pool.booster->setLearnedPreloads(pool.usageProfile.top(pool.learnedPreloads));
+        pool.booster->initializeZygote(zygote.stage, m_initialArgc, m_initialArgv);
+
+        // Returns in the boosters and zygotes forked by the zygote
+        const Zygote::Request request = Zygote::serve(fd, launcherPid);
+        if (request.index < 0)
+            _exit(EXIT_FAILURE);
+
+        if (request.message == Zygote::MessageForkZygote) {
+            if ((size_t)request.index >= m_zygoteTree.size())
+                _exit(EXIT_FAILURE);
+            index = request.index;
+            fd = request.fd;
+            continue;
         }
 
-        // Wait for something appearing in the pipes.
-        if (select(ndfs + 1, &rfds, NULL, NULL, NULL) > 0)
-        {
-            Logger::logDebug("Daemon: select done.");
+        if ((size_t)request.index >= m_pools.size())
+            _exit(EXIT_FAILURE);
+        BoosterPool &boosterPool = *m_pools[request.index];
+        inheritZygote(index, boosterPool);
+        runBooster(boosterPool, false);
+    }
+}
 
-            // Check if a booster died
-            if (FD_ISSET(m_boosterLauncherSocket[0], &rfds))
-            {
-                Logger::logDebug("Daemon: FD_ISSET(m_boosterLauncherSocket[0])");
-                readFromBoosterSocket(m_boosterLauncherSocket[0]);
-            }
+void Daemon::inheritZygote(int index, BoosterPool &pool)
+{
+    const ZygoteProcess &zygote = m_zygoteTree[index];
+    const Booster *booster = m_pools[zygote.pool]->booster;
 
-            // Check if we got SIGCHLD, SIGTERM, SIGUSR1 or SIGUSR2
-            if (FD_ISSET(m_sigPipeFd[0], &rfds))
-            {
-                Logger::logDebug("Daemon: FD_ISSET(m_sigPipeFd[0])");
-                int dataReceived = read_from_signal_pipe(m_sigPipeFd[0]);
-
-                switch (dataReceived)
-                {
-                case SIGCHLD:
-                    Logger::logDebug("Daemon: SIGCHLD received.");
-                    reapZombies();
-                    break;
-
-                case SIGINT:
-                case SIGTERM: {
-                    Logger::logDebug("Daemon: SIGINT / SIGTERM received.");
-
-                    // FIXME: Legacy pid file path -> see daemonize()
-                    const std::string pidFilePath = m_socketManager->socketRootPath() + m_booster->boosterType() + ".pid";
-                    FILE * const pidFile = fopen(pidFilePath.c_str(), "r");
-                    if (pidFile)
-                    {
-                        pid_t filePid;
-                        if (fscanf(pidFile, "%d\n", &filePid) == 1 && filePid == getpid())
-                        {
-                            unlink(pidFilePath.c_str());
-                        }
-                        fclose(pidFile);
-                    }
-
-                    for (;;) {
-                        PidVect::iterator iter(m_children.begin());
-                        if (iter == m_children.end())
-                            break;
-                        pid_t booster_pid = *iter;
-                        m_children.erase(iter);
-
-                        /* Get and remove booster socket  fd */
-                        int socket_fd = -1;
-                        FdMap::iterator fdIter = m_boosterPidToInvokerFd.find(booster_pid);
-                        if (fdIter != m_boosterPidToInvokerFd.end()) {
-                            socket_fd = (*fdIter).second;
-                            m_boosterPidToInvokerFd.erase(fdIter);
-                        }
-                        /* Get and remove invoker pid */
-                        pid_t invoker_pid = -1;
-                        PidMap::iterator pidIter = m_boosterPidToInvokerPid.find(booster_pid);
-                        if (pidIter != m_boosterPidToInvokerPid.end()) {
-                            invoker_pid = (*pidIter).second;
-                            m_boosterPidToInvokerPid.erase(pidIter);
-                        }
-
-                        /* Normally boosters are stopped on shutdown / user switch,
-                         * and even then it should happen after applications have
-                         * already been stopped.
-                         */
-                        warning("terminating: booster:%d invoker:%d socket:%d",
-                                (int)booster_pid, (int)invoker_pid, socket_fd);
-
-                        /* Terminate invoker */
-                        close_invoker(invoker_pid, socket_fd, EXIT_FAILURE);
-
-                        /* Terminate booster */
-                        kill_process("booster", booster_pid);
-                    }
-
-                    Logger::logDebug("booster exit");
-                    exit(EXIT_SUCCESS);
-                    break;
-                }
+    // The base zygote has nothing booster specific
+    if (zygote.stage != Zygote::StageBase && booster != pool.booster)
+        pool.booster->inheritZygote(*booster);
+}
 
-                case SIGUSR1:
-                    Logger::logDebug("Daemon: SIGUSR1 received.");
-                    enterNormalMode();
-                    break;
+bool Daemon::startZygote(int index)
+{
+    ZygoteProcess &zygote = m_zygoteTree[index];
+    if (zygote.failed)
+        return false;
+
+    if (zygote.pid == -1) {
+        // Asked from the parent already, or replies of the
+        // previous process are read first, see closeZygote()
+        if (zygote.requested || zygote.fd != -1)
+            return true;
+
+        // Forked once the zygote above it is ready, see handleZygoteMessage()
+        if (zygote.parent != -1 && !m_zygoteTree[zygote.parent].ready)
+            return startZygote(zygote.parent);
+        forkZygote(index);
+        if (zygote.requested)
+            return true;
+    }
 
-                case SIGUSR2:
-                    Logger::logDebug("Daemon: SIGUSR2 received.");
-                    enterBootMode();
-                    break;
+    return zygote.pid != -1 && zygote.fd != -1 && !zygote.ready && !zygote.stopping;
+}
 
-                case SIGPIPE:
-                    Logger::logDebug("Daemon: SIGPIPE received.");
-                    break;
+bool Daemon::zygoteStarting(BoosterPool &pool)
+{
+    // Boosters don't preload in the boot mode
+    if (!m_zygotes || m_bootMode || pool.zygote == -1)
+        return false;
 
-                default:
-                    break;
-                }
-                continue;
-            }
+    return startZygote(pool.zygote);
+}
 
-            /* Handle closed booster sockets */
-            for (auto iter = m_boosterPidToInvokerFd.begin(); iter != m_boosterPidToInvokerFd.end();) {
-                int socket_fd = iter->second;
-                if (socket_fd != -1 && FD_ISSET(socket_fd, &rfds)) {
-                    /* Note: bookkeeping must be updated first to avoid
-                     *       any ringing due to socket closes / child
-                     *       process exits.
-                     */
-                    pid_t booster_pid = iter->first;
-                    iter = m_boosterPidToInvokerFd.erase(iter);
-
-                    pid_t invoker_pid = -1;
-                    PidMap::iterator pidIter = m_boosterPidToInvokerPid.find(booster_pid);
-                    if (pidIter != m_boosterPidToInvokerPid.end()) {
-                        invoker_pid = pidIter->second;
-                        m_boosterPidToInvokerPid.erase(pidIter);
-                    }
-
-                    /* Note that it is slightly unexpected if we get here
-                     * as it means invoker exited rather than application.
-                     */
-                    warning("terminating: booster:%d invoker:%d socket:%d",
-                            (int)booster_pid, (int)invoker_pid, socket_fd);
-
-                    /* Terminate invoker */
-                    close_invoker(invoker_pid, socket_fd, EXIT_FAILURE);
-
-                    /* Terminate booster */
-                    kill_process("booster", booster_pid);
-                } else {
-                    ++iter;
-                }
-            }
+bool Daemon::zygotePreloading(const BoosterPool &pool, unsigned int now, unsigned int &left) const
+{
+    left = 0;
+    if (!m_zygotes || m_bootMode)
+        return false;
+
+    // Sum up what the zygotes not ready yet have left, down from the top one preloading
+    bool preloading = false;
+    for (int index = pool.zygote; index != -1; index = m_zygoteTree[index].parent) {
+        const ZygoteProcess &zygote = m_zygoteTree[index];
+        if (zygote.failed || zygote.stopping || (zygote.pid != -1 && zygote.fd == -1))
+            return false;
+        if (zygote.ready)
+            break;
+
+        if (zygote.pid == -1 && !zygote.requested) {
+            left += zygote.preloadTime;
+        } else {
+            const unsigned int elapsed = now - zygote.forkTime;
+            left += elapsed < zygote.preloadTime ? zygote.preloadTime - elapsed : 0;
+            preloading = true;
         }
     }
+    return preloading;
 }
 
-void Daemon::readFromBoosterSocket(int fd)
+bool Daemon::forkFromZygote(BoosterPool &pool)
 {
-    pid_t invokerPid = 0;
-    int delay = 0;
-    int socketFd = -1;
+    // Boosters don't preload in the boot mode
+    if (!m_zygotes || m_bootMode || pool.zygote == -1 || !m_zygoteTree[pool.zygote].ready)
+        return false;
+
+    ZygoteProcess &zygote = m_zygoteTree[pool.zygote];
+    if (!Zygote::requestBooster(zygote.fd, pool.index)) {
+        Logger::logWarning("Daemon: can't ask zygote %d for a booster for %s", zygote.pid,
+                           pool.booster->socketId().c_str());
+        stopZygote(pool.zygote);
+        return false;
+    }
 
-    struct iovec iov[2];
-    char buf[CMSG_SPACE(sizeof socketFd)];
-    struct msghdr msg;
-    struct cmsghdr *cmsg;
+    // Joins the pool when the reply comes, see zygoteForked()
+    zygote.pending++;
+    pool.forkPending++;
+    return true;
+}
 
-    memset(iov, 0, sizeof iov);
-    memset(buf, 0, sizeof buf);
-    memset(&msg, 0, sizeof msg);
+void Daemon::handleZygoteMessage(int index)
+{
+    ZygoteProcess &zygote = m_zygoteTree[index];
+    if (zygote.fd == -1)
+        return;
+
+    Zygote::Message message;
+    pid_t pid = -1;
+    int requestIndex = -1;
+    int attachedFd = -1;
+    if (!Zygote::readMessage(zygote.fd, message, pid, requestIndex, &attachedFd)) {
+        // Exiting, it gets reaped on SIGCHLD. Once it has been, or if
+        // requests were left unanswered, the pools are filled again.
+        const bool refill = zygote.pid == -1 || zygote.pending > 0;
+        closeZygote(index);
+        if (refill)
+            fillBoosterPools();
+        return;
+    }
 
-    iov[0].iov_base = &invokerPid;
-    iov[0].iov_len = sizeof invokerPid;
-    iov[1].iov_base = &delay;
-    iov[1].iov_len = sizeof delay;
+    if (message == Zygote::MessageForkedZygote) {
+        zygoteForkedZygote(index, pid, requestIndex, attachedFd);
+        return;
+    }
 
-    msg.msg_iov        = iov;
-    msg.msg_iovlen     = 2;
-    msg.msg_name       = NULL;
-    msg.msg_namelen    = 0;
-    msg.msg_control    = buf;
-    msg.msg_controllen = sizeof buf;
+    if (attachedFd != -1)
+        close(attachedFd);
 
-    if (recvmsg(fd, &msg, 0) == -1) {
-        Logger::logError("Daemon: Critical error communicating with booster. Exiting applauncherd.\n");
-        exit(EXIT_FAILURE);
+    if (message == Zygote::MessageForked) {
+        zygoteForked(index, pid, requestIndex);
+        return;
     }
 
-    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-        if (cmsg->cmsg_level == SOL_SOCKET &&
-            cmsg->cmsg_type == SCM_RIGHTS &&
-            cmsg->cmsg_len >= CMSG_LEN(sizeof(socketFd))) {
-            memcpy(&socketFd, CMSG_DATA(cmsg), sizeof socketFd);
-        }
-    }
+    if (message != Zygote::MessageReady || zygote.ready || zygote.stopping)
+        return;
 
-    Logger::logDebug("Daemon: booster=%d invoker=%d socket=%d delay=%d\n",
-                     m_boosterPid, invokerPid, socketFd, delay);
+    const unsigned int elapsed = timestamp() - zygote.forkTime;
+    zygote.preloadTime = elapsed;
+    zygote.ready = true;
+    Logger::logDebug("Daemon: %s zygote %d ready in %u ms", zygoteName(zygote).c_str(),
+                     zygote.pid, elapsed);
 
-    if (m_boosterPid > 0) {
-        /* We were expecting booster details => update bookkeeping */
-        if (socketFd != -1) {
-            // Store booster pid - invoker socket pair
-            m_boosterPidToInvokerFd[m_boosterPid] = socketFd, socketFd = -1;
-        }
-        if (invokerPid > 0) {
-            // Store booster pid - invoker pid pair
-            m_boosterPidToInvokerPid[m_boosterPid] = invokerPid;
-        }
+    // Forks the zygotes below it, or the boosters
+    fillBoosterPools();
+}
+
+void Daemon::zygoteForked(int index, pid_t pid, int poolIndex)
+{
+    ZygoteProcess &zygote = m_zygoteTree[index];
+    if (zygote.pending > 0)
+        zygote.pending--;
+
+    if (poolIndex < 0 || (size_t)poolIndex >= m_pools.size()) {
+        Logger::logWarning("Daemon: zygote %d forked %d for unknown pool %d", zygote.pid, pid, poolIndex);
+        killProcess(pid, SIGTERM);
+        return;
     }
 
-    if (socketFd != -1) {
-        /* If we are not going to use the received fd, it needs to be closed */
-        Logger::logWarning("Daemon: close stray socket file descriptor: %d\n", socketFd);
-        close(socketFd);
+    BoosterPool &pool = *m_pools[poolIndex];
+    if (pool.forkPending > 0)
+        pool.forkPending--;
+
+    if (pid <= 0) {
+        // Served by boosters forked from the launcher instead
+        Logger::logWarning("Daemon: zygote %d did not fork a booster for %s", zygote.pid,
+                           pool.booster->socketId().c_str());
+        stopZygote(index);
+        fillBoosterPool(pool);
+        return;
     }
 
-    // 2nd param guarantees some time for the just launched application
-    // to start up before forking new booster. Not doing this would
-    // slow down the start-up significantly on single core CPUs.
+    Logger::logDebug("Daemon: zygote %d forked booster %d", zygote.pid, pid);
+    if (!addChild(pool, pid, false))
+        return;
 
-    forkBooster(delay);
+    // Tracked anyway so that it gets reaped
+    if (zygote.stopping || m_shuttingDown)
+        killProcess(pid, SIGTERM);
 }
 
-void Daemon::killProcess(pid_t pid, int signal) const
+void Daemon::zygoteForkedZygote(int index, pid_t pid, int child, int fd)
 {
-    if (pid > 0)
-    {
-        Logger::logWarning("Daemon: Killing pid %d with %d", pid, signal);
-        if (kill(pid, signal) != 0)
-        {
-            Logger::logError("Daemon: Failed to kill %d: %s\n",
-                             pid, strerror(errno));
-        }
+    ZygoteProcess &parent = m_zygoteTree[index];
+    if (parent.pending > 0)
+        parent.pending--;
+
+    if (child < 0 || (size_t)child >= m_zygoteTree.size() ||
+        m_zygoteTree[child].parent != index || !m_zygoteTree[child].requested) {
+        // Exits as soon as its socket is closed
+        Logger::logWarning("Daemon: zygote %d forked unexpected zygote %d", parent.pid, pid);
+        if (fd != -1)
+            close(fd);
+        return;
+    }
+
+    ZygoteProcess &zygote = m_zygoteTree[child];
+    zygote.requested = false;
+
+    if (pid <= 0 || fd == -1) {
+        // Boosters of its pools are forked by the launcher until the parent is forked again
+        Logger::logWarning("Daemon: zygote %d did not fork the %s zygote", parent.pid,
+                           zygoteName(zygote).c_str());
+        if (fd != -1)
+            close(fd);
+        stopZygote(index);
+        fillBoosterPools();
+        return;
     }
+
+    zygoteStarted(child, pid, fd);
+
+    // Not wanted anymore, it still has to be reaped
+    if (parent.stopping || m_shuttingDown)
+        stopZygote(child);
 }
 
-void Daemon::loadSingleInstancePlugin()
+void Daemon::closeZygote(int index)
 {
-    void * handle = dlopen(SINGLE_INSTANCE_PATH, RTLD_NOW);
-    if (!handle)
-    {
-        Logger::logWarning("Daemon: dlopening single-instance failed: %s", dlerror());
-    }
-    else
-    {
-        if (m_singleInstance->validateAndRegisterPlugin(handle))
-        {
-            Logger::logDebug("Daemon: single-instance plugin loaded.'");
+    ZygoteProcess &zygote = m_zygoteTree[index];
+    if (zygote.fd == -1)
+        return;
+
+    removeWatch(zygote.fd);
+    close(zygote.fd);
+    zygote.fd = -1;
+    zygote.ready = false;
+
+    if (zygote.pending > 0) {
+        Logger::logWarning("Daemon: %s zygote left %u fork requests unanswered",
+                           zygoteName(zygote).c_str(), zygote.pending);
+        zygote.pending = 0;
+        for (BoosterPoolVect::const_iterator pool = m_pools.begin(); pool != m_pools.end(); ++pool) {
+            if ((*pool)->zygote == index)
+                (*pool)->forkPending = 0;
         }
-        else
-        {
-            Logger::logWarning("Daemon: Invalid single-instance plugin: '%s'",
-                               SINGLE_INSTANCE_PATH);
+        for (ZygoteVect::iterator child = m_zygoteTree.begin(); child != m_zygoteTree.end(); ++child) {
+            if (child->parent == index)
+                child->requested = false;
         }
     }
 }
 
-void Daemon::dropCapabilities()
+void Daemon::stopZygote(int index)
 {
-    cap_t caps = cap_init();
+    ZygoteProcess &zygote = m_zygoteTree[index];
+    if (zygote.pid == -1 || zygote.stopping)
+        return;
 
-    if (!caps || cap_set_proc(caps) == -1) {
-        Logger::logError("Daemon: Failed to drop capabilities");
-    }
+    zygote.ready = false;
+    zygote.stopping = true;
 
-    if (caps) {
-        cap_free(caps);
-    }
+    /* A booster it is forking is reparented to the launcher anyway,
+     * so the socket stays open until the reply has been read.
+     */
+    if (zygote.pending == 0)
+        closeZygote(index);
+
+    // Not reaped yet, so the pid can't refer to another process
+    killProcess(zygote.pid, SIGTERM);
 }
 
-void Daemon::forkBooster(int sleepTime)
+void Daemon::zygoteExited(int index, int status)
 {
-    if (!m_booster) {
-        // Critical error unknown booster type. Exiting applauncherd.
-        _exit(EXIT_FAILURE);
+    ZygoteProcess &zygote = m_zygoteTree[index];
+    const string name = zygoteName(zygote);
+
+    if (zygote.stopping || zygote.fd == -1) {
+        Logger::logDebug("Daemon: %s zygote %d exited", name.c_str(), zygote.pid);
+    } else if (!zygote.ready) {
+        // Most likely failed in preloading, don't retry
+        Logger::logWarning("Daemon: %s zygote %d failed (status %d), forking its boosters from the launcher",
+                           name.c_str(), zygote.pid, status);
+        zygote.failed = true;
+    } else {
+        Logger::logWarning("Daemon: %s zygote %d exited (status %d)", name.c_str(), zygote.pid, status);
     }
 
-    // Invalidate current booster pid
-    m_boosterPid = 0;
+    // Replies it sent before exiting are read until the socket closes
+    if (zygote.pending == 0)
+        closeZygote(index);
+    zygote.pid = -1;
+    zygote.ready = false;
 
-    // Fork a new process
-    pid_t newPid = fork();
+    // Boosters and zygotes it forked are children of the launcher and not affected
+    fillBoosterPools();
+}
 
-    if (newPid == -1)
-        throw std::runtime_error("Daemon: Forking while invoking");
+int Daemon::findZygote(pid_t pid) const
+{
+    for (size_t index = 0; index < m_zygoteTree.size(); ++index) {
+        if (m_zygoteTree[index].pid == pid)
+            return index;
+    }
+    return -1;
+}
 
-    if (newPid == 0) /* Child process */
-    {
-        // Will be reopened with new identity when/if
-        // there is something to report
-        Logger::closeLog();
+void Daemon::drainBoosterSocket()
+{
+    struct pollfd pfd;
+    pfd.fd = m_boosterLauncherSocket[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
 
-        // Restore used signal handlers
-        restoreUnixSignalHandlers();
+    while (poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN))
+        readFromBoosterSocket(m_boosterLauncherSocket[0]);
+}
 
-        // Will get this signal if applauncherd dies
-        prctl(PR_SET_PDEATHSIG, SIGHUP);
+void Daemon::handleChildExit(pid_t pid)
+{
+    // Already reaped on SIGCHLD if the launcher is a child subreaper
+    int status = 0;
+    if (waitpid(pid, &status, WNOHANG) != pid)
+        return;
 
-        // Close unused read end of the booster socket
-        close(m_boosterLauncherSocket[0]);
+    handleExitedChildren(vector<std::pair<pid_t, int> >(1, std::make_pair(pid, status)));
+}
 
-        // Close signal pipe
-        close(m_sigPipeFd[0]);
-        close(m_sigPipeFd[1]);
+void Daemon::reapZombies()
+{
+    std::vector<std::pair<pid_t, int> > exited;
 
-        // Close socket file descriptors
-        FdMap::iterator i(m_boosterPidToInvokerFd.begin());
-        while (i != m_boosterPidToInvokerFd.end())
-        {
-            if ((*i).second != -1) {
-                close((*i).second);
-                (*i).second = -1;
+    /* Orphans of launched applications are reparented to a child
+     * subreaper too, so every child is reaped here. Booster pidfds
+     * are closed once the boosters have been handled.
+     */
+    if (m_zygotes) {
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            const int zygote = findZygote(pid);
+            if (zygote != -1)
+                zygoteExited(zygote, status);
+            else if (m_launches.find(pid))
+                exited.push_back(std::make_pair(pid, status));
+            else {
+                // Either an orphan or a booster whose zygote has not told about it yet
+                Logger::logDebug("Daemon: reaped orphan %d", pid);
+                if (m_unknownExits.size() >= MAX_UNKNOWN_EXITS)
+                    m_unknownExits.erase(m_unknownExits.begin());
+                m_unknownExits.push_back(std::make_pair(pid, status));
             }
-            i++;
-        }
-        // Set session id
-        if (setsid() < 0)
-            Logger::logError("Daemon: Couldn't set session id\n");
-
-        // Guarantee some time for the just launched application to
-        // start up before initializing new booster if needed.
-        // Not done if in the boot mode.
-        if (!m_bootMode && sleepTime) {
-            Logger::logDebug("allow time for application startup - sleep(%ds)...\n", sleepTime);
-            sleep(sleepTime);
-        }
-
-        Logger::logDebug("Daemon: Running a new Booster of type '%s'", m_booster->boosterType().c_str());
-
-        // Initialize and wait for commands from invoker
-        try {
-            m_booster->initialize(m_initialArgc, m_initialArgv, m_boosterLauncherSocket[1],
-                                  m_socketManager->findSocket(m_booster->socketId()),
-                                  m_singleInstance, m_bootMode);
-        } catch (const std::runtime_error &e) {
-            Logger::logError("Booster: Failed to initialize: %s\n", e.what());
-            delete m_booster;
-            _exit(EXIT_FAILURE);
         }
+        handleExitedChildren(exited);
+        return;
+    }
 
-        m_instance = NULL;
-
-        // No need for capabilities anymore
-        dropCapabilities();
+    // Children with a pidfd are reaped when it becomes readable
+    if (m_childrenWithoutPidFd == 0)
+        return;
 
-        // Run the current Booster
-        int retval = m_booster->run(m_socketManager);
+    // Reap exited children that have no pidfd with WNOHANG.
+    for (size_t index = 0; index < m_launches.capacity(); ++index) {
+        LaunchRecord *record = m_launches.slot(index);
+        if (!record || record->pidFd != -1)
+            continue;
 
-        // Finish
-        delete m_booster;
+        int status = 0;
+        if (waitpid(record->boosterPid, &status, WNOHANG) != record->boosterPid)
+            continue;
 
-        // _exit() instead of exit() to avoid situation when destructors
-        // for static objects may be run incorrectly
-        _exit(retval);
+        // The pid had exited, its record is removed once handled
+        exited.push_back(std::make_pair(record->boosterPid, status));
     }
-    else /* Parent process */
-    {
-        // Store the pid so that we can reap it later
-        m_children.push_back(newPid);
 
-        // Set current process ID globally to the given booster type
-        // so that we now which booster to restart when booster exits.
-        m_boosterPid = newPid;
-    }
+    handleExitedChildren(exited);
 }
 
-void Daemon::reapZombies()
+void Daemon::handleExitedChildren(const vector<std::pair<pid_t, int> > &exited)
 {
-    // Loop through all child pid's and wait for them with WNOHANG.
-    PidVect::iterator i(m_children.begin());
-    while (i != m_children.end())
+    /* A booster sends launch data before running the application, so
+     * the data of every booster reaped above is already queued. Process
+     * it first, or a booster whose application exited quickly would be
+     * taken for a waiting one and its invoker would lose the exit status.
+     */
+    if (!exited.empty())
+        drainBoosterSocket();
+
+    for (size_t n = 0; n < exited.size(); ++n)
     {
-        // Check if the pid had exited and become a zombie
-        int status = 0;
-        pid_t pid = waitpid(*i, &status, WNOHANG);
-        if (pid > 0)
-        {
-            // The pid had exited. Remove it from the pid vector.
-            i = m_children.erase(i);
-
-            // Find out what happened
-            int exit_status = EXIT_FAILURE;
-            int signal_no = 0;
-
-            if (WIFSIGNALED(status)) {
-                signal_no = WTERMSIG(status);
-                Logger::logWarning("boosted process (pid=%d) signal(%s)\n",
-                                   pid, strsignal(signal_no));
-            } else if (WIFEXITED(status)) {
-                exit_status = WEXITSTATUS(status);
-                if (exit_status != EXIT_SUCCESS)
-                    Logger::logWarning("Boosted process (pid=%d) exit(%d)\n",
-                                       pid, exit_status);
-                else
-                    Logger::logDebug("Boosted process (pid=%d) exit(%d)\n",
-                                     pid, exit_status);
-            }
+        pid_t pid = exited[n].first;
+        int status = exited[n].second;
+
+        // Find out what happened
+        int exit_status = EXIT_FAILURE;
+        int signal_no = 0;
+
+        if (WIFSIGNALED(status)) {
+            signal_no = WTERMSIG(status);
+            Logger::logWarning("boosted process (pid=%d) signal(%s)\n",
+                               pid, strsignal(signal_no));
+        } else if (WIFEXITED(status)) {
+            exit_status = WEXITSTATUS(status);
+            if (exit_status != EXIT_SUCCESS)
+                Logger::logWarning("Boosted process (pid=%d) exit(%d)\n",
+                                   pid, exit_status);
+            else
+                Logger::logDebug("Boosted process (pid=%d) exit(%d)\n",
+                                 pid, exit_status);
+        }
 
-            /* Get and remove booster socket fd */
-            int socket_fd = -1;
-            FdMap::iterator fdIter = m_boosterPidToInvokerFd.find(pid);
-            if (fdIter != m_boosterPidToInvokerFd.end()) {
-                socket_fd = (*fdIter).second;
-                m_boosterPidToInvokerFd.erase(fdIter);
-            }
+        /* Get and remove booster socket fd */
+        int socket_fd = takeInvokerFd(pid);
 
-            /* Get and remove invoker pid */
-            pid_t invoker_pid = -1;
-            PidMap::iterator pidIter = m_boosterPidToInvokerPid.find(pid);
-            if (pidIter != m_boosterPidToInvokerPid.end()) {
-                invoker_pid = (*pidIter).second;
-                m_boosterPidToInvokerPid.erase(pidIter);
-            }
+        /* Get and remove invoker pid */
+        pid_t invoker_pid = takeInvokerPid(pid);
 
-            /* Terminate invoker associated with the booster */
-            close_invoker(invoker_pid, socket_fd, exit_status);
+        /* Booster may have been terminated on purpose */
+        finishTeardown(pid);
 
-            // Check if pid belongs to a booster and restart the dead booster if needed
-            if (pid == m_boosterPid)
-            {
-                forkBooster(m_boosterSleepTime);
-            }
+        /* Single-instance application can be launched again */
+        m_singleInstance->release(pid);
+
+        /* Application exited before its libraries were sampled */
+        cancelUsageSample(pid);
+
+        /* Terminate invoker associated with the booster */
+        closeInvoker(invoker_pid, takeInvokerPidFd(pid), socket_fd, exit_status);
+
+        // Check if pid belongs to a waiting booster, before its record goes
+        BoosterPool *pool = findPool(pid);
+        bool crashed = false;
+        if (LaunchRecord *record = m_launches.find(pid)) {
+            // Boosters terminated on purpose get SIGTERM
+            crashed = pool && record->progress != LaunchRecord::Ready && signal_no != SIGTERM;
+            countPooled(*record, -1);
+
+            // Closing removes the fd from the epoll set
+            if (record->pidFd != -1)
+                close(record->pidFd);
+            else
+                m_childrenWithoutPidFd--;
+            m_launches.remove(pid);
         }
-        else
+
+        // Restart the dead booster if needed
+        if (pool)
         {
-            i++;
+            // Back off exponentially while boosters keep failing before
+            // getting ready, e.g. because a preloaded library crashes
+            int crashSleepTime = m_boosterCrashSleepTime;
+            if (crashed) {
+                pool->crashCount++;
+                crashSleepTime = std::min(m_boosterCrashSleepTime << std::min(pool->crashCount - 1, 6u),
+                                          MAX_CRASH_SLEEP_TIME);
+                Logger::logWarning("Daemon: %s booster %d failed before ready (%u in a row), "
+                                   "respawning in %ds\n", pool->booster->socketId().c_str(),
+                                   pid, pool->crashCount, crashSleepTime);
+                pool->respawnScheduler.cancel();
+            }
+            fillBoosterPool(*pool, std::max(m_boosterSleepTime, crashSleepTime), crashSleepTime);
         }
     }
-
-    /* Handle stray child exits */
-    for (;;) {
-        int status = 0;
-        pid_t pid = waitpid(-1, &status, WNOHANG);
-        if (pid <= 0)
-            break;
-        Logger::logWarning("unexpected child exit pid=%d status=0x%x\n", pid, status);
-    }
 }
 
 void Daemon::daemonize()
@@ -868,10 +2680,10 @@ void Daemon::daemonize()
          */
 #if 0
         // Path that takes also application name into account
-        const std::string pidFilePath = m_socketManager->socketRootPath() + m_booster->socketId() + ".pid";
+        const std::string pidFilePath = m_socketManager->socketRootPath() + m_pools.front()->booster->socketId() + ".pid";
 #else
         // Legacy path
-        const std::string pidFilePath = m_socketManager->socketRootPath() + m_booster->boosterType() + ".pid";
+        const std::string pidFilePath = m_socketManager->socketRootPath() + m_pools.front()->booster->boosterType() + ".pid";
 #endif
         FILE * const pidFile = fopen(pidFilePath.c_str(), "w");
         if (pidFile)
@@ -932,6 +2744,16 @@ void Daemon::parseArgs(int argc, char **argv)
         { "daemon",           no_argument,       NULL, 'd' },
         { "systemd",          no_argument,       NULL, 'n' },
         { "application",      required_argument, NULL, 'a' },
+        { "pool-min",         required_argument, NULL, 'p' },
+        { "pool-max",         required_argument, NULL, 'P' },
+        { "trace",            required_argument, NULL, 't' },
+        { "preload-manifest", required_argument, NULL, 'm' },
+        { "preload-report",   required_argument, NULL, 'r' },
+        { "learned-preloads", required_argument, NULL, 'l' },
+        { "backlog",          required_argument, NULL, 'B' },
+        { "idle-timeout",     required_argument, NULL, 'I' },
+        { "memory-stats",     required_argument, NULL, 'M' },
+        { "zygote",           no_argument,       NULL, 'z' },
         { 0, 0, 0, 0}
     };
     static const char shortopts[] =
@@ -942,7 +2764,18 @@ void Daemon::parseArgs(int argc, char **argv)
         "d"  // --daemon
         "n"  // --systemd
         "a:" // --application=<APP>
+        "p:" // --pool-min=<N>
+        "P:" // --pool-max=<N>
+        "t:" // --trace=<FILE>
+        "m:" // --preload-manifest=<FILE>
+        "r:" // --preload-report=<FILE>
+        "l:" // --learned-preloads=<N>
+        "B:" // --backlog=<N>
+        "I:" // --idle-timeout=<SECONDS>
+        "M:" // --memory-stats=<SECONDS>
+        "z"  // --zygote
         ;
+    bool poolMaxSet = false;
     for (;;) {
         int opt = getopt_long(argc, argv, shortopts, longopts, NULL);
         if (opt == -1)
@@ -965,8 +2798,77 @@ void Daemon::parseArgs(int argc, char **argv)
         case 'n':
             m_notifySystemd = true;
             break;
-        case 'a':
-            m_boostedApplication = optarg;
+        case 'a': {
+            // <application>[:<pool-min>[:<pool-max>]]
+            BoostedApplication application = { optarg, 0, 0 };
+            size_t colon = application.name.find(':');
+            if (colon != string::npos) {
+                string sizes = application.name.substr(colon + 1);
+                application.name.erase(colon);
+                colon = sizes.find(':');
+                if (!parseNumber(sizes.substr(0, colon), 1, MAX_POOL_SIZE, application.poolMin) ||
+                    (colon != string::npos &&
+                     !parseNumber(sizes.substr(colon + 1), 1, MAX_POOL_SIZE, application.poolMax))) {
+                    Logger::logError("Daemon: Invalid booster pool size: %s\n", optarg);
+                    usage(*argv, EXIT_FAILURE);
+                }
+            }
+            m_boostedApplications.push_back(application);
+            break;
+        }
+        case 'p':
+        case 'P': {
+            unsigned int size = 0;
+            if (!parseNumber(optarg, 1, MAX_POOL_SIZE, size)) {
+                Logger::logError("Daemon: Invalid booster pool size: %s\n", optarg);
+                usage(*argv, EXIT_FAILURE);
+            }
+            if (opt == 'p') {
+                m_poolMin = size;
+            } else {
+                m_poolMax = size;
+                poolMaxSet = true;
+            }
+            break;
+        }
+        case 't':
+            LaunchTrace::setOutputFile(optarg);
+            break;
+        case 'm':
+            PreloadManifest::setManifestFile(optarg);
+            break;
+        case 'r':
+            PreloadManifest::setReportFile(optarg);
+            break;
+        case 'l':
+            if (!parseNumber(optarg, 0, MAX_LEARNED_PRELOADS, m_learnedPreloads)) {
+                Logger::logError("Daemon: Invalid learned preload count: %s\n", optarg);
+                usage(*argv, EXIT_FAILURE);
+            }
+            break;
+        case 'B': {
+            unsigned int backlog = 0;
+            if (!parseNumber(optarg, 1, MAX_BACKLOG, backlog)) {
+                Logger::logError("Daemon: Invalid listen backlog: %s\n", optarg);
+                usage(*argv, EXIT_FAILURE);
+            }
+            m_socketManager->setBacklog(backlog);
+            break;
+        }
+        case 'I':
+            if (!parseNumber(optarg, 0, MAX_IDLE_TIMEOUT, m_idleTimeout)) {
+                Logger::logError("Daemon: Invalid idle timeout: %s\n", optarg);
+                usage(*argv, EXIT_FAILURE);
+            }
+            break;
+        case 'M':
+            if (!parseNumber(optarg, 0, MAX_MEMORY_STATS_INTERVAL, m_memoryStatsInterval)) {
+                Logger::logError("Daemon: Invalid memory statistics interval: %s\n", optarg);
+                usage(*argv, EXIT_FAILURE);
+            }
+            break;
+        case 'z':
+            m_zygotes = true;
             break;
         default:
         case '?':
@@ -975,6 +2877,20 @@ void Daemon::parseArgs(int argc, char **argv)
     }
     if (optind < argc)
         usage(*argv, EXIT_FAILURE);
+
+    if (!poolMaxSet || m_poolMax < m_poolMin)
+        m_poolMax = m_poolMin;
+}
+
+bool Daemon::parseNumber(const string &arg, unsigned int min, unsigned int max,
+                         unsigned int &value)
+{
+    char *end = NULL;
+    unsigned long number = strtoul(arg.c_str(), &end, 10);
+    if (!end || end == arg.c_str() || *end || number < min || number > max)
+        return false;
+    value = number;
+    return true;
 }
 
 // Prints the usage and exits with given status
@@ -999,27 +2915,64 @@ void Daemon::usage(const char *name, int status)
            "                   to the launcher.\n"
            "  -d, --daemon\n"
            "                   Run as %s a daemon.\n"
-           "  -a, --application=<application>\n"
-           "                   Run as application specific booster.\n"
+           "  -a, --application=<application>[:<pool-min>[:<pool-max>]]\n"
+           "                   Run as application specific booster. May be given\n"
+           "                   several times to serve several applications from\n"
+           "                   one launcher, \"default\" names the generic\n"
+           "                   booster. Pool sizes override --pool-min and\n"
+           "                   --pool-max for the application.\n"
            "  -n, --systemd\n"
-           "                   Notify systemd when initialization is done\n"
+           "                   Notify systemd when the first booster is ready\n"
+           "  -p, --pool-min=<count>\n"
+           "                   Number of preloaded boosters kept waiting for\n"
+           "                   launches (default 1, max %u).\n"
+           "  -P, --pool-max=<count>\n"
+           "                   Number of preloaded boosters the pool may grow to\n"
+           "                   during bursts of launches (default: pool-min).\n"
+           "  -t, --trace=<file>\n"
+           "                   Append a JSON timeline of every launch to <file>.\n"
+           "  -m, --preload-manifest=<file>\n"
+           "                   Preload the items listed in <file> (default:\n"
+           "                   " PRELOAD_MANIFEST_DIR "/<type>.conf).\n"
+           "  -r, --preload-report=<file>\n"
+           "                   Write the time each preload item took to <file>.\n"
+           "  -l, --learned-preloads=<count>\n"
+           "                   Number of libraries an application specific\n"
+           "                   booster preloads based on what the application\n"
+           "                   loaded in earlier launches (default %u, max %u,\n"
+           "                   0 disables).\n"
+           "  -B, --backlog=<count>\n"
+           "                   Number of launches that may queue on the booster\n"
+           "                   socket (default 10, or Backlog= of the socket\n"
+           "                   unit when started by socket activation, max %u).\n"
+           "  -I, --idle-timeout=<seconds>\n"
+           "                   Fork application specific boosters only when the\n"
+           "                   application is launched, and terminate them when\n"
+           "                   it has not been launched for <seconds> (default 0,\n"
+           "                   keep them running, max %u).\n"
+           "  -M, --memory-stats=<seconds>\n"
+           "                   Log the memory use of boosters and launched\n"
+           "                   applications every <seconds> (default 0, off,\n"
+           "                   max %u).\n"
+           "  -z, --zygote\n"
+           "                   Fork boosters from a tree of processes that have\n"
+           "                   done the preloads they share, instead of repeating\n"
+           "                   them in every booster. The base manifest is read\n"
+           "                   from " PRELOAD_MANIFEST_DIR "/base.conf.\n"
            "  -h, --help\n"
            "                   Print this help.\n"
            "  -v, --verbose, --debug\n"
            "                   Make diagnostic logging more verbose.\n"
            "\n",
-           name, name, name);
+           name, name, name, MAX_POOL_SIZE,
+           DEFAULT_LEARNED_PRELOADS, MAX_LEARNED_PRELOADS, MAX_BACKLOG,
+           MAX_IDLE_TIMEOUT, MAX_MEMORY_STATS_INTERVAL);
 
     free(nameCopy);
 
     exit(status);
 }
 
-int Daemon::sigPipeFd() const
-{
-    return m_sigPipeFd[1];
-}
-
 void Daemon::enterNormalMode()
 {
     if (m_bootMode)
@@ -1056,23 +3009,20 @@ void Daemon::enterBootMode()
 
 void Daemon::killBoosters()
 {
-    if (m_boosterPid > 0)
-        killProcess(m_boosterPid, SIGTERM);
+    for (size_t index = 0; index < m_launches.capacity(); ++index) {
+        const LaunchRecord *record = m_launches.slot(index);
+        if (record && record->state == LaunchRecord::Pooled)
+            killProcess(record->boosterPid, SIGTERM);
+    }
 
-    // NOTE!!: m_boosterPid must not be cleared
+    // NOTE!!: pools must not be cleared
     // in order to automatically start new boosters.
 }
 
-void Daemon::setUnixSignalHandler(int signum, sighandler_t handler)
+void Daemon::trapUnixSignal(int signum)
 {
-    // needs to be undone in instance
-    m_originalSigHandlers[signum] = SIG_DFL;
-
-    struct sigaction sig;
-    memset(&sig, 0, sizeof(sig));
-    sig.sa_flags = SA_RESTART;
-    sig.sa_handler = handler;
-    if (sigaction(signum, &sig, NULL) == -1)
+    // needs to be undone in boosters
+    if (sigaddset(&m_signalMask, signum) == -1)
         warning("trap(%s): %m", strsignal(signum));
     else
         debug("trap(%s): ok", strsignal(signum));
@@ -1080,22 +3030,31 @@ void Daemon::setUnixSignalHandler(int signum, sighandler_t handler)
 
 void Daemon::restoreUnixSignalHandlers()
 {
-    for (SigHandlerMap::iterator it = m_originalSigHandlers.begin(); it != m_originalSigHandlers.end(); it++ )
-    {
-        int signum = it->first;
-        if (signal(signum, SIG_DFL) == SIG_ERR)
-            warning("untrap(%s): %m", strsignal(signum));
-        else
-            debug("untrap(%s): ok", strsignal(signum));
-    }
-    m_originalSigHandlers.clear();
+    if (sigprocmask(SIG_UNBLOCK, &m_signalMask, NULL) == -1)
+        warning("untrap signals: %m");
+    else
+        debug("untrap signals: ok");
+    sigemptyset(&m_signalMask);
 }
 
 
 Daemon::~Daemon()
 {
+    if (m_timerFd != -1)
+        close(m_timerFd);
+    if (m_epollFd != -1)
+        close(m_epollFd);
+    if (m_signalFd != -1)
+        close(m_signalFd);
+
+    for (BoosterPoolVect::const_iterator iter = m_pools.begin(); iter != m_pools.end(); ++iter) {
+        delete (*iter)->booster;
+        delete *iter;
+    }
+
     delete m_socketManager;
     delete m_singleInstance;
+    delete m_instanceActivator;
 
     Logger::closeLog();
 }
@@ -42,11 +42,20 @@ using std::vector;
 using std::map;
 
 #include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 
+#include "usageprofile.h"
+#include "respawnscheduler.h"
+#include "memorypressure.h"
+#include "launchtable.h"
+#include "zygote.h"
+
 class Booster;
 class SocketManager;
 class SingleInstance;
+class InstanceActivator;
 
 /*!
  * \class Daemon.
@@ -77,30 +86,49 @@ public:
 
     /*!
      * \brief Run main loop and fork Boosters.
+     *
+     * Serves the given booster for the first application given with
+     * --application. Use addBooster() and run() to serve several.
      */
     void run(Booster *booster);
 
+    /*!
+     * \brief Run main loop and fork the Boosters added with addBooster().
+     */
+    void run();
+
+    /*!
+     * \brief Serve booster from this daemon.
+     * \param booster Booster instance, ownership is transferred
+     * \param application Application the booster is specific to, or "default"
+     *
+     * Every booster gets its own socket and pool of waiting boosters.
+     * Pool size given for the application with --application overrides
+     * --pool-min and --pool-max. Must be called before run().
+     */
+    void addBooster(Booster *booster, const string &application);
+
+    /*!
+     * \brief Return applications given with --application.
+     * \return "default" alone if none was given
+     */
+    vector<string> boostedApplications() const;
+
     /*! \brief Return the one-and-only Daemon instance.
      * \return Pointer to the Daemon instance.
      */
     static Daemon * instance();
 
-    //! \brief Reapes children processes gone zombies (finished Boosters).
+    //! \brief Reapes children processes gone zombies that have no pidfd.
     void reapZombies();
 
     /*!
-     * Get fd to which signal handler writes the number
-     * of an arriving Unix signal.
-     */
-    int sigPipeFd() const;
-
-    /*!
-     * Set unix signal handler and save its original value.
+     * Block unix signal and add it to the set received via signalfd.
      */
-    void setUnixSignalHandler(int signum, sighandler_t handler);
+    void trapUnixSignal(int signum);
 
     /*!
-     * Restore unix signal handlers to their saved values.
+     * Unblock unix signals trapped with trapUnixSignal().
      */
     void restoreUnixSignalHandlers();
 
@@ -115,14 +143,152 @@ private:
     //! Parse arguments
     void parseArgs(int argc, char **argv);
 
+    //! Parse a decimal option value within [min, max], return false if invalid
+    static bool parseNumber(const string &arg, unsigned int min, unsigned int max,
+                            unsigned int &value);
+
     //! Fork to a daemon
     void daemonize();
 
     //! Fork process that kills boosters if needed
     void forkKiller();
 
-    //! Forks and initializes a new Booster
-    void forkBooster(int sleepTime = 0);
+    struct BoosterPool;
+    struct ZygoteProcess;
+
+    /*! \brief Forks and initializes a new Booster.
+     *  \param pool Pool the booster is forked for
+     *  \param bare Skip preloading, for serving a launch that is
+     *               already waiting as fast as possible
+     */
+    void forkBooster(BoosterPool &pool, bool bare = false);
+
+    //! Close the fds of the launcher and restore signals in a forked process
+    void prepareChild();
+
+    //! Initialize and run the booster of the pool in a forked process, never returns
+    void runBooster(BoosterPool &pool, bool bare);
+
+    /*! \brief Add a forked booster to the pool of waiting boosters.
+     *  \return false if the booster had already been reaped, it is
+     *  handled as exited then and the pid must not be used anymore.
+     */
+    bool addChild(BoosterPool &pool, pid_t pid, bool bare);
+
+    //! Take the exit status of a child reaped before it was added, return false if not known
+    bool takeUnknownExit(pid_t pid, int &status);
+
+    //! Decide which zygotes of the tree the boosters of each pool are forked from
+    void planZygotes();
+
+    //! Add a zygote to the tree, return its index
+    int addZygote(Zygote::Stage stage, int parent, unsigned int pool);
+
+    //! Return name of the zygote for logging
+    string zygoteName(const ZygoteProcess &zygote) const;
+
+    //! Fork the zygote from the launcher or ask its parent zygote for it
+    void forkZygote(int index);
+
+    //! Start watching a zygote that has been forked
+    void zygoteStarted(int index, pid_t pid, int fd);
+
+    //! Preload and serve fork requests in a forked zygote process, never returns
+    void runZygote(int index, int fd, pid_t launcherPid);
+
+    //! Let the booster of the pool continue from the preloads of the zygote, in a forked process
+    void inheritZygote(int index, BoosterPool &pool);
+
+    //! Start the zygote and the ones above it as needed, return true while it is not ready
+    bool startZygote(int index);
+
+    //! Start the zygotes of the pool if it should have them, return true while they preload
+    bool zygoteStarting(BoosterPool &pool);
+
+    //! Return true while the zygotes of the pool preload, left is set to the time (ms) until ready
+    bool zygotePreloading(const BoosterPool &pool, unsigned int now, unsigned int &left) const;
+
+    //! Ask the zygote of the pool for a booster, return false if it has no ready zygote
+    bool forkFromZygote(BoosterPool &pool);
+
+    //! Handle a message or EOF from the zygote
+    void handleZygoteMessage(int index);
+
+    //! Add a booster the zygote has forked to its pool
+    void zygoteForked(int index, pid_t pid, int poolIndex);
+
+    //! Start a zygote its parent has forked, fd is the launcher end of its socket
+    void zygoteForkedZygote(int index, pid_t pid, int child, int fd);
+
+    //! Close the socket of the zygote, requests left without a reply are made again
+    void closeZygote(int index);
+
+    //! Terminate the zygote, it is reaped when it has exited
+    void stopZygote(int index);
+
+    //! Handle reaped zygote
+    void zygoteExited(int index, int status);
+
+    //! Return index of the zygote whose pid is, or -1
+    int findZygote(pid_t pid) const;
+
+    /*! \brief Fork new boosters until the pool of waiting boosters reaches its target size.
+     *  Boosters are forked once the system has room for preloading,
+     *  but at least after minSleepTime and at most after sleepTime
+     *  seconds.
+     */
+    void fillBoosterPool(BoosterPool &pool, int sleepTime = 0, int minSleepTime = 0);
+
+    //! Fill all pools up to their target size
+    void fillBoosterPools();
+
+    //! Fork boosters scheduled by fillBoosterPool() if the system has room
+    void checkRespawn();
+
+    //! Empty lazy pools whose application has not been launched for a while
+    void checkIdle(unsigned int now);
+
+    //! Handle a booster that has finished preloading
+    void handleBoosterReady(pid_t pid);
+
+    //! Handle a booster that has started or finished preloading
+    void handleBoosterPreload(pid_t pid, int message, unsigned int duration);
+
+    //! Return timestamp (ms) at which the booster is expected to accept launches
+    static unsigned int readyAt(const BoosterPool &pool, const LaunchRecord &booster);
+
+    //! Write the readiness of the pools next to their sockets where it has changed
+    void publishReadiness();
+
+    //! Tell systemd that the launcher serves launches, once
+    void notifyReady(const char *reason);
+
+    //! Handle a connection waiting on the booster socket while no booster is ready
+    void handlePendingLaunch(BoosterPool &pool);
+
+    //! Watch booster sockets for connections while no booster is ready
+    void updateListenWatch();
+
+    //! Add (1) or remove (-1) a booster waiting in a pool to the counters of the pool
+    void countPooled(const LaunchRecord &record, int delta);
+
+    //! Set the progress of a booster, keeping the ready count of its pool
+    void setProgress(LaunchRecord &record, LaunchRecord::Progress progress);
+
+    //! Return number of boosters in the pool, not counting bare ones
+    unsigned int poolSize(const BoosterPool &pool) const;
+
+    //! Return true if a booster in the pool accepts launches
+    bool hasReadyBooster(const BoosterPool &pool) const;
+
+    //! Adjust pool target size after a booster has been taken into use
+    void updatePoolTarget(BoosterPool &pool);
+
+    //! Log current state of the booster pool
+    void logPoolState(const BoosterPool &pool, const char *reason) const;
+
+    //! Return pool pid is waiting in, or NULL
+    BoosterPool *findPool(pid_t pid) const;
 
     //! Kill given pid with SIGKILL by default
     void killProcess(pid_t pid, int signal = SIGKILL) const;
@@ -133,6 +299,137 @@ private:
     //! Read and process data from a booster pipe
     void readFromBoosterSocket(int fd);
 
+    //! Handle launch data that boosters have already sent
+    void drainBoosterSocket();
+
+    //! Add fd to the event loop, tag is returned in epoll events
+    void addWatch(int fd, uint64_t tag, uint32_t events = EPOLLIN);
+
+    //! Remove fd from the event loop
+    void removeWatch(int fd);
+
+    //! Read and handle all pending signals from the signalfd
+    void readFromSignalFd();
+
+    //! Handle a unix signal received via signalfd
+    void handleSignal(int sig);
+
+    //! Terminate booster whose invoker socket got closed
+    void handleInvokerHangup(pid_t boosterPid);
+
+    //! Remove invoker socket of a booster from bookkeeping, return the fd or -1
+    int takeInvokerFd(pid_t boosterPid);
+
+    //! Remove invoker pidfd of a booster from bookkeeping, return the fd or -1
+    int takeInvokerPidFd(pid_t boosterPid);
+
+    //! Remove invoker pid of a booster from bookkeeping, return the pid or -1
+    pid_t takeInvokerPid(pid_t boosterPid);
+
+    //! Open a pidfd for the peer of an invoker socket, return the fd or -1
+    static int openInvokerPidFd(int socketFd, pid_t invokerPid);
+
+    //! Reap a booster whose pidfd became readable
+    void handleChildExit(pid_t pid);
+
+    //! Handle reaped boosters, given as pid / wait status pairs
+    void handleExitedChildren(const vector<std::pair<pid_t, int> > &exited);
+
+    /*!
+     * \brief Asynchronous termination of a process.
+     *
+     * Invoker sockets are first disconnected gracefully. Processes
+     * are sent SIGTERM, then SIGKILL after a grace period. Each step
+     * has a deadline that is handled by the event loop timer, so the
+     * main loop never blocks on one process.
+     */
+    struct Teardown
+    {
+        enum State { Disconnect, Terminate, Kill };
+
+        //! Current step
+        State state;
+
+        //! Process description for logging
+        const char *label;
+
+        //! Pid of the process, or -1 if not known
+        pid_t pid;
+
+        //! Socket being disconnected in Disconnect state, or -1
+        int socketFd;
+
+        //! Timestamp (ms) at which the current step times out
+        unsigned int deadline;
+
+        //! True if the process is our child and gets reaped via its own watch
+        bool child;
+
+        //! Pidfd of a non-child process, watched for its exit, or -1
+        int pidFd;
+    };
+    typedef vector<Teardown> TeardownVect;
+
+    //! Send exit status to invoker, then disconnect / terminate it asynchronously
+    void closeInvoker(pid_t invokerPid, int pidFd, int socketFd, int exitStatus);
+
+    //! Start asynchronous termination of a process, pidFd is taken over
+    void terminateProcess(const char *label, pid_t pid, bool child, int pidFd = -1);
+
+    //! Add teardown to the list, watching the exit of its process
+    void addTeardown(const Teardown &teardown);
+
+    //! Close the fds of a finished teardown
+    void releaseTeardown(Teardown &teardown);
+
+    //! Send signal to teardown process, return false if it has already exited
+    bool signalTeardown(const Teardown &teardown, int sig);
+
+    //! Move teardown forward if its deadline is met, return false when finished
+    bool advanceTeardown(Teardown &teardown, unsigned int now);
+
+    //! Handle teardown timer expiry
+    void handleTimer();
+
+    //! Handle input / EOF from an invoker socket that is being disconnected
+    void handleTeardownSocket(int socketFd);
+
+    //! Forget teardown of a reaped child process
+    void finishTeardown(pid_t pid);
+
+    //! Forget teardown of a non-child process whose pidfd became readable
+    void handleTeardownExit(int pidFd);
+
+    //! Record the libraries of applications launched long enough ago
+    void sampleUsage(unsigned int now);
+
+    //! Forget the pending usage sample of a reaped child process
+    void cancelUsageSample(pid_t pid);
+
+    //! Log memory use of waiting boosters and launched applications per pool
+    void reportMemoryStats() const;
+
+    //! Libraries the boosters of a pool preload: manifests and learned preloads
+    vector<string> preloadedLibraries(const BoosterPool &pool) const;
+
+    //! Trim waiting boosters on moderate, terminate them on severe memory pressure
+    void handleMemoryPressure(MemoryPressure::Level level);
+
+    //! Refill the pools once memory pressure has not been reported for a while
+    void checkMemoryPressure(unsigned int now);
+
+    //! Ask a ready booster to give memory back, once per pressure period
+    void trimBooster(pid_t pid);
+
+    //! Arm the timer for the nearest teardown / shutdown / usage sample deadline
+    void updateTeardownTimer();
+
+    //! Start terminating all children in parallel and exit when done
+    void startShutdown();
+
+    //! Exit if shutdown is finished or its deadline has passed
+    void checkShutdown();
+
     //! Enter normal mode (restart boosters with cache enabled)
     void enterNormalMode();
 
@@ -159,27 +456,216 @@ private:
      */
     bool m_bootMode;
 
-    //! Vector of current child PID's
-    typedef vector<pid_t> PidVect;
-    PidVect m_children;
+    //! Child processes and the launches they serve
+    LaunchTable m_launches;
+
+    //! Number of children without pidfd, they are reaped on SIGCHLD
+    unsigned int m_childrenWithoutPidFd;
+
+    //! Exit statuses of children reaped before they were known, e.g. boosters
+    //! that exited before the MessageForked of their zygote was read. Bounded,
+    //! the statuses of orphans that are never claimed are dropped oldest first.
+    vector<std::pair<pid_t, int> > m_unknownExits;
+
+    //! Zygote in the tree the boosters are forked from (--zygote)
+    struct ZygoteProcess
+    {
+        //! What the zygote preloads
+        Zygote::Stage stage;
+
+        //! Index of the zygote this one is forked from, -1 if forked by the launcher
+        int parent;
+
+        //! Index of the pool whose booster does the preloads
+        unsigned int pool;
+
+        //! Pid of the zygote, -1 if not running
+        pid_t pid;
+
+        //! Launcher end of the zygote socket, -1 once closed. It stays
+        //! open after the zygote has exited until the replies are read.
+        int fd;
+
+        //! Fork requests sent, replies not read yet
+        unsigned int pending;
+
+        //! Timestamp (ms) of the fork, or of the request to the parent
+        unsigned int forkTime;
+
+        //! True while the parent has been asked to fork the zygote
+        bool requested;
+
+        //! Measured time (ms) from fork to ready, 0 if not known
+        unsigned int preloadTime;
+
+        //! True once preloading is done and boosters are forked on request
+        bool ready;
+
+        //! True if the zygote exited before it was ready, boosters are
+        //! forked by the launcher from then on
+        bool failed;
+
+        //! True once the launcher has terminated the zygote
+        bool stopping;
+    };
+    typedef vector<ZygoteProcess> ZygoteVect;
+
+    //! Booster served by the daemon and the boosters forked from it
+    struct BoosterPool
+    {
+        //! Booster instance run in the forked processes
+        Booster *booster;
+
+        //! Index in m_pools. Boosters that have been forked but not yet
+        //! used for launching an application are the Pooled records of
+        //! m_launches with this index.
+        int index;
+
+        //! Number of waiting boosters the pool is always topped up to
+        unsigned int poolMin;
 
-    //! Storage of booster <-> invoker pid pairs
-    typedef map<pid_t, pid_t> PidMap;
-    PidMap m_boosterPidToInvokerPid;
+        //! Upper limit for the pool size during launch bursts
+        unsigned int poolMax;
 
-    //! Storage of booster <-> invoker socket file descriptor pairs
-    typedef map<pid_t, pid_t> FdMap;
-    FdMap m_boosterPidToInvokerFd;
+        //! Current pool size target, between poolMin and poolMax
+        unsigned int poolTarget;
 
-    //! Current booster pid
-    pid_t m_boosterPid;
+        //! Timestamp (ms) of the latest launch, used for detecting bursts
+        unsigned int lastLaunchTime;
+
+        //! Decides when boosters are forked to fill the pool
+        RespawnScheduler respawnScheduler;
+
+        //! Timestamp (ms) of the next respawnScheduler check
+        unsigned int respawnDeadline;
+
+        //! Measured time (ms) from fork to ready of normal and bare boosters, 0 if not known
+        unsigned int preloadTime;
+        unsigned int bareTime;
+
+        //! Time (ms) boosters report they spent preloading, 0 if not known
+        unsigned int preloadDuration;
+
+        //! Readiness last written next to the booster socket, see publishReadiness()
+        string readyState;
+        unsigned int readyValue;
+
+        //! True while the booster socket is in the event loop
+        bool listenWatched;
+
+        //! True after a waiting connection was handled, until a booster is ready
+        bool launchPending;
+
+        //! Libraries used by the boosted application
+        UsageProfile usageProfile;
+
+        //! Number of learned libraries boosters preload, 0 if not learning
+        unsigned int learnedPreloads;
+
+        //! True if boosters are forked only after a launch (--idle-timeout)
+        bool lazy;
+
+        //! Timestamp (ms) after which an unused lazy pool is emptied
+        unsigned int idleDeadline;
+
+        //! Index of the zygote the boosters are forked from in m_zygoteTree,
+        //! -1 for lazy pools and without zygotes
+        int zygote;
+
+        //! Boosters asked from the zygote and not forked yet
+        unsigned int forkPending;
+
+        //! Boosters that failed in a row before getting ready, respawns back off
+        unsigned int crashCount;
+
+        //! Pooled records of m_launches with this index: preloaded and
+        //! bare boosters, and of those the ones that accept launches.
+        //! Kept by countPooled() and setProgress().
+        unsigned int pooledCount;
+        unsigned int bareCount;
+        unsigned int readyCount;
+    };
+    typedef vector<BoosterPool *> BoosterPoolVect;
+
+    //! Boosters served by this daemon, in the order they were added
+    BoosterPoolVect m_pools;
+
+    //! Application given with --application, pool sizes 0 if not given
+    struct BoostedApplication
+    {
+        string name;
+        unsigned int poolMin;
+        unsigned int poolMax;
+    };
+    typedef vector<BoostedApplication> BoostedApplicationVect;
+    BoostedApplicationVect m_boostedApplications;
+
+    //! Default pool sizes (--pool-min, --pool-max)
+    unsigned int m_poolMin;
+    unsigned int m_poolMax;
+
+    //! Launches closer to each other than this (ms) are considered a burst
+    static const unsigned int m_poolBurstWindow;
 
     //! Socket pair used to tell the parent that a new booster is needed +
     //! some parameters.
     int m_boosterLauncherSocket[2];
 
-    //! Pipe used to safely catch Unix signals
-    int m_sigPipeFd[2];
+    //! Signals received via m_signalFd instead of signal handlers
+    sigset_t m_signalMask;
+
+    //! Signalfd used to safely catch Unix signals
+    int m_signalFd;
+
+    //! Epoll instance driving the main loop
+    int m_epollFd;
+
+    //! Timer for teardown deadlines
+    int m_timerFd;
+
+    //! Processes that are being terminated
+    TeardownVect m_teardowns;
+
+    //! True after SIGTERM / SIGINT
+    bool m_shuttingDown;
+
+    //! Timestamp (ms) after which remaining processes are killed on shutdown
+    unsigned int m_shutdownDeadline;
+
+    //! Launched application whose maps are sampled at a deadline
+    struct UsageSample
+    {
+        BoosterPool *pool;
+        pid_t pid;
+        dev_t dev; //!< Device and inode of the application binary
+        ino_t ino;
+        unsigned int deadline;
+    };
+    typedef vector<UsageSample> UsageSampleVect;
+
+    //! Launches waiting to be sampled for the usage profile of their pool
+    UsageSampleVect m_usageSamples;
+
+    //! Number of learned libraries application specific boosters preload (--learned-preloads)
+    unsigned int m_learnedPreloads;
+
+    //! Time (s) lazy pools are kept filled after a launch, 0 if pools are not lazy
+    unsigned int m_idleTimeout;
+
+    //! Time (s) between memory use reports (--memory-stats), 0 if not reported
+    unsigned int m_memoryStatsInterval;
+
+    //! Timestamp (ms) of the next memory use report
+    unsigned int m_memoryStatsDeadline;
+
+    //! Memory pressure notifications
+    MemoryPressure m_memoryPressure;
+
+    //! Highest memory pressure level reported since pressure began
+    MemoryPressure::Level m_pressureLevel;
+
+    //! Timestamp (ms) after which memory pressure is considered over
+    unsigned int m_pressureDeadline;
 
     //! Argument vector initially given to the launcher process
     int m_initialArgc;
@@ -190,29 +676,41 @@ private:
     //! Singleton Daemon instance
     static Daemon * m_instance;
 
-    //! Time to sleep before forking a new booster
+    //! Longest time a booster restarted after dying waits for the system to calm down
     static const int m_boosterSleepTime;
 
+    //! Time a booster restarted after dying waits in any case, so that
+    //! a booster failing in preload does not respawn in a tight loop
+    static const int m_boosterCrashSleepTime;
+
     //! Manager for invoker <-> booster sockets
     SocketManager * m_socketManager;
 
     //! Single instance plugin handle
     SingleInstance * m_singleInstance;
 
-    //! Original unix signal handlers are saved here
-    typedef map<int, sighandler_t> SigHandlerMap;
-    SigHandlerMap m_originalSigHandlers;
+    //! Bus connection for activating running single-instance applications
+    InstanceActivator * m_instanceActivator;
 
     //! True if systemd needs to be notified
     bool m_notifySystemd;
-    string m_boostedApplication;
+
+    //! True until systemd has been notified, see notifyReady()
+    bool m_notifyPending;
+
+    //! Timestamp (ms) after which systemd is notified without a ready booster
+    unsigned int m_notifyDeadline;
+
+    //! True if boosters are forked from zygotes (--zygote). The launcher
+    //! is a child subreaper then and reaps all of its children.
+    bool m_zygotes;
+
+    //! Zygotes of all pools, each listed after the one it is forked from
+    ZygoteVect m_zygoteTree;
 
     //! Drop capabilities needed for initialization
     static void dropCapabilities();
 
-    //! Booster instance
-    Booster * m_booster;
-
 #ifdef UNIT_TEST
     friend class Ut_Daemon;
 #endif
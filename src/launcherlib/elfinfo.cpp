@@ -0,0 +1,265 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "elfinfo.h"
+#include "logger.h"
+
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <vector>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::vector;
+
+ElfInfo::Cache ElfInfo::m_cache;
+
+// Upper limit for cached decisions, the cache is simply
+// cleared when it is full
+static const size_t CACHE_MAX = 512;
+
+// Upper limits for the tables read from a file
+static const size_t TABLE_MAX = 16 << 20;
+static const size_t HEADERS_MAX = 4096;
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 30)
+// glibc refuses to dlopen() objects that have DF_1_PIE set
+static const bool DLOPEN_PIE = false;
+#else
+static const bool DLOPEN_PIE = true;
+#endif
+
+static bool readAt(int fd, off_t offset, void *data, size_t size)
+{
+    char *pos = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t rc = pread(fd, pos, size, offset);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return false;
+        pos += rc, offset += rc, size -= rc;
+    }
+    return true;
+}
+
+template <typename T>
+static bool readTable(int fd, off_t offset, size_t count, vector<T> &table)
+{
+    if (count == 0 || count > TABLE_MAX / sizeof(T))
+        return false;
+    table.resize(count);
+    return readAt(fd, offset, &table[0], count * sizeof(T));
+}
+
+ElfInfo::ElfInfo() :
+        m_valid(false),
+        m_dynamic(false),
+        m_pie(false),
+        m_exportsMain(false),
+        m_interpreter(),
+        m_buildId()
+{
+}
+
+bool ElfInfo::inspect(int fd)
+{
+    ElfW(Ehdr) ehdr;
+    if (!readAt(fd, 0, &ehdr, sizeof ehdr) ||
+        memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr.e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+        ehdr.e_ident[EI_VERSION] != EV_CURRENT)
+        return false;
+
+    m_valid = true;
+    m_dynamic = ehdr.e_type == ET_DYN;
+
+    // Program headers: interpreter, dynamic flags and build id
+    vector<ElfW(Phdr)> phdrs;
+    if (ehdr.e_phentsize == sizeof(ElfW(Phdr)) && ehdr.e_phnum <= HEADERS_MAX)
+        readTable(fd, ehdr.e_phoff, ehdr.e_phnum, phdrs);
+
+    for (size_t i = 0; i < phdrs.size(); ++i) {
+        const ElfW(Phdr) &phdr = phdrs[i];
+        if (phdr.p_type == PT_INTERP && phdr.p_filesz < PATH_MAX) {
+            vector<char> interp;
+            if (readTable(fd, phdr.p_offset, phdr.p_filesz, interp))
+                m_interpreter.assign(&interp[0], strnlen(&interp[0], interp.size()));
+        } else if (phdr.p_type == PT_DYNAMIC) {
+            vector<ElfW(Dyn)> dyns;
+            readTable(fd, phdr.p_offset, phdr.p_filesz / sizeof(ElfW(Dyn)), dyns);
+            for (size_t k = 0; k < dyns.size() && dyns[k].d_tag != DT_NULL; ++k)
+                if (dyns[k].d_tag == DT_FLAGS_1 && (dyns[k].d_un.d_val & DF_1_PIE))
+                    m_pie = true;
+        } else if (phdr.p_type == PT_NOTE && m_buildId.empty()) {
+            vector<char> notes;
+            if (!readTable(fd, phdr.p_offset, phdr.p_filesz, notes))
+                continue;
+            const size_t align = phdr.p_align == 8 ? 8 : 4;
+            size_t pos = 0;
+            while (pos + sizeof(ElfW(Nhdr)) <= notes.size()) {
+                ElfW(Nhdr) nhdr;
+                memcpy(&nhdr, &notes[pos], sizeof nhdr);
+                size_t name = pos + sizeof nhdr;
+                size_t desc = name + ((nhdr.n_namesz + align - 1) & ~(align - 1));
+                size_t next = desc + ((nhdr.n_descsz + align - 1) & ~(align - 1));
+                if (desc + nhdr.n_descsz > notes.size())
+                    break;
+                if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == 4 &&
+                    memcmp(&notes[name], "GNU", 4) == 0) {
+                    static const char hex[] = "0123456789abcdef";
+                    for (size_t k = 0; k < nhdr.n_descsz; ++k) {
+                        unsigned char c = notes[desc + k];
+                        m_buildId += hex[c >> 4];
+                        m_buildId += hex[c & 15];
+                    }
+                    break;
+                }
+                pos = next;
+            }
+        }
+    }
+
+    // Section headers: look for main in the dynamic symbol table
+    vector<ElfW(Shdr)> shdrs;
+    if (ehdr.e_shentsize == sizeof(ElfW(Shdr)) && ehdr.e_shnum <= HEADERS_MAX)
+        readTable(fd, ehdr.e_shoff, ehdr.e_shnum, shdrs);
+
+    for (size_t i = 0; i < shdrs.size() && !m_exportsMain; ++i) {
+        if (shdrs[i].sh_type != SHT_DYNSYM || shdrs[i].sh_link >= shdrs.size())
+            continue;
+        const ElfW(Shdr) &strtab = shdrs[shdrs[i].sh_link];
+
+        vector<ElfW(Sym)> syms;
+        vector<char> strs;
+        if (!readTable(fd, shdrs[i].sh_offset, shdrs[i].sh_size / sizeof(ElfW(Sym)), syms) ||
+            !readTable(fd, strtab.sh_offset, strtab.sh_size, strs) ||
+            strs.back() != '\0')
+            continue;
+
+        for (size_t k = 0; k < syms.size(); ++k) {
+            // Symbol info macros are the same for both ELF classes
+            const ElfW(Sym) &sym = syms[k];
+            const int bind = ELF64_ST_BIND(sym.st_info);
+            const int visibility = ELF64_ST_VISIBILITY(sym.st_other);
+            if (sym.st_name < strs.size() &&
+                strcmp(&strs[sym.st_name], "main") == 0 &&
+                sym.st_shndx != SHN_UNDEF &&
+                ELF64_ST_TYPE(sym.st_info) == STT_FUNC &&
+                (bind == STB_GLOBAL || bind == STB_WEAK) &&
+                (visibility == STV_DEFAULT || visibility == STV_PROTECTED)) {
+                m_exportsMain = true;
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool ElfInfo::isDynamic() const
+{
+    return m_dynamic;
+}
+
+bool ElfInfo::isPie() const
+{
+    return m_pie;
+}
+
+bool ElfInfo::exportsMain() const
+{
+    return m_exportsMain;
+}
+
+const string & ElfInfo::interpreter() const
+{
+    return m_interpreter;
+}
+
+const string & ElfInfo::buildId() const
+{
+    return m_buildId;
+}
+
+ElfInfo::LaunchMode ElfInfo::launchMode() const
+{
+    if (m_valid && m_dynamic && m_exportsMain && (DLOPEN_PIE || !m_pie))
+        return LaunchDlopen;
+    return LaunchExec;
+}
+
+ElfInfo::LaunchMode ElfInfo::select(const string &path, Record *record)
+{
+    memset(record, 0, sizeof *record);
+
+    // Let dlopen() report errors as it did before
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1)
+        return LaunchDlopen;
+
+    // The launcher needs to know the file even if the decision is cached
+    record->dev = st.st_dev;
+    record->ino = st.st_ino;
+
+    Cache::const_iterator iter(m_cache.find(std::make_pair(st.st_dev, st.st_ino)));
+    if (iter != m_cache.end() &&
+        iter->second.size == st.st_size &&
+        iter->second.mtimeSec == st.st_mtim.tv_sec &&
+        iter->second.mtimeNsec == st.st_mtim.tv_nsec)
+        return static_cast<LaunchMode>(iter->second.mode);
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return LaunchDlopen;
+
+    ElfInfo info;
+    if (!info.inspect(fd))
+        Logger::logDebug("ElfInfo: %s is not a native ELF file", path.c_str());
+    close(fd);
+
+    const LaunchMode mode = info.launchMode();
+    Logger::logDebug("ElfInfo: %s: %s, dynamic=%d pie=%d main=%d interp='%s' build-id=%s",
+                     path.c_str(), modeName(mode), info.isDynamic(), info.isPie(),
+                     info.exportsMain(), info.interpreter().c_str(), info.buildId().c_str());
+
+    record->size = st.st_size;
+    record->mtimeSec = st.st_mtim.tv_sec;
+    record->mtimeNsec = st.st_mtim.tv_nsec;
+    record->mode = mode;
+    return mode;
+}
+
+void ElfInfo::remember(const Record &record)
+{
+    if (record.mode != LaunchDlopen && record.mode != LaunchExec)
+        return;
+
+    if (m_cache.size() >= CACHE_MAX)
+        m_cache.clear();
+    m_cache[std::make_pair(record.dev, record.ino)] = record;
+}
+
+const char *ElfInfo::modeName(LaunchMode mode)
+{
+    switch (mode) {
+    case LaunchDlopen:
+        return "dlopen";
+    case LaunchExec:
+        return "exec";
+    default:
+        return "unknown";
+    }
+}
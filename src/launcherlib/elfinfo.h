@@ -0,0 +1,115 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef ELFINFO_H
+#define ELFINFO_H
+
+#include "launcherlib.h"
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+using std::map;
+using std::pair;
+using std::string;
+
+/*!
+ * \class ElfInfo
+ * \brief ELF properties that decide how an application is launched.
+ *
+ * An application can be dlopen()ed into a booster, keeping everything
+ * the booster preloaded, only if it is a shared object or PIE with an
+ * exported main(). Anything else is exec()ed. The decision is cached
+ * by device, inode, size and mtime. Boosters report new decisions to
+ * the launcher, so that boosters forked later inherit them.
+ */
+class DECL_EXPORT ElfInfo
+{
+public:
+
+    //! How an application is started
+    enum LaunchMode
+    {
+        LaunchUnknown = 0, //!< Not decided
+        LaunchDlopen,      //!< Load into the booster and jump to main()
+        LaunchExec         //!< Replace the booster with exec()
+    };
+
+    //! Cached launch decision, also sent from a booster to the launcher
+    struct Record
+    {
+        dev_t    dev;
+        ino_t    ino;
+        off_t    size;
+        int64_t  mtimeSec;
+        int64_t  mtimeNsec;
+        int32_t  mode;     //!< LaunchMode, LaunchUnknown for an empty record
+    };
+
+    //! Constructor
+    ElfInfo();
+
+    /*! \brief Read the headers of an ELF file.
+     *  \param fd Open file
+     *  \return false if the file is not a readable native ELF file.
+     */
+    bool inspect(int fd);
+
+    //! True for ET_DYN files, i.e. shared objects and PIEs
+    bool isDynamic() const;
+
+    //! True if DF_1_PIE is set, such objects can't be dlopen()ed
+    bool isPie() const;
+
+    //! True if main is a defined, visible function in .dynsym
+    bool exportsMain() const;
+
+    //! Program interpreter, empty if there is none
+    const string & interpreter() const;
+
+    //! GNU build id as a hex string, empty if there is none
+    const string & buildId() const;
+
+    //! Launch mode these properties allow
+    LaunchMode launchMode() const;
+
+    /*! \brief Decide how to launch a file.
+     *  Uses the cache, inspects the file on a miss.
+     *  \param path File to be launched
+     *  \param record Set to the new decision on a cache miss. Only
+     *                dev and ino are set on a hit, mode is LaunchUnknown.
+     */
+    static LaunchMode select(const string &path, Record *record);
+
+    //! Add a decision to the cache
+    static void remember(const Record &record);
+
+    //! Return a name for a launch mode
+    static const char *modeName(LaunchMode mode);
+
+private:
+
+    bool   m_valid;
+    bool   m_dynamic;
+    bool   m_pie;
+    bool   m_exportsMain;
+    string m_interpreter;
+    string m_buildId;
+
+    typedef map<pair<dev_t, ino_t>, Record> Cache;
+    static Cache m_cache;
+};
+
+#endif // ELFINFO_H
@@ -0,0 +1,60 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "envbaseline.h"
+#include "atomicfile.h"
+#include "logger.h"
+#include "protocol.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+extern char ** environ;
+
+bool EnvBaseline::m_published = false;
+uint64_t EnvBaseline::m_digest = 0;
+
+bool EnvBaseline::publish(const string &path)
+{
+    m_published = false;
+
+    string data;
+    for (char **env = environ; *env; ++env) {
+        data += *env;
+        data += '\0';
+    }
+
+    if (data.size() > INVOKER_MSG_FRAME_MAX) {
+        Logger::logWarning("EnvBaseline: environment too large (%zu bytes)", data.size());
+        unlink(path.c_str());
+        return false;
+    }
+
+    // Invokers must never see a partial file
+    if (!AtomicFile::replace(path, data)) {
+        Logger::logWarning("EnvBaseline: can't write %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    m_digest = invoker_env_digest(data.data(), data.size());
+    m_published = true;
+    Logger::logDebug("EnvBaseline: %s: %zu bytes, digest %016llx",
+                     path.c_str(), data.size(), (unsigned long long)m_digest);
+    return true;
+}
+
+bool EnvBaseline::matches(uint64_t digest)
+{
+    return m_published && digest == m_digest;
+}
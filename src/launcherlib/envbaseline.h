@@ -0,0 +1,56 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef ENVBASELINE_H
+#define ENVBASELINE_H
+
+#include "launcherlib.h"
+#include <stdint.h>
+
+#include <string>
+
+using std::string;
+
+/*!
+ * \class EnvBaseline
+ * \brief Environment the boosters start from.
+ *
+ * The launcher writes its environment as NUL terminated NAME=VALUE
+ * strings next to the booster socket. The invoker reads the file and
+ * sends only the variables that differ from it, together with the
+ * digest of the file. Boosters inherit the digest from the launcher
+ * and use it to check that a delta was computed against the same
+ * environment they have.
+ */
+class DECL_EXPORT EnvBaseline
+{
+public:
+
+    /*! \brief Write the current environment to a file.
+     *  \param path File name, normally the socket path + ".env"
+     *  \return true on success.
+     */
+    static bool publish(const string &path);
+
+    //! Return true if digest matches the published environment
+    static bool matches(uint64_t digest);
+
+private:
+
+    //! True after a successful publish()
+    static bool m_published;
+
+    //! Digest of the published environment
+    static uint64_t m_digest;
+};
+
+#endif // ENVBASELINE_H
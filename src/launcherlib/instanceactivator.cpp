@@ -0,0 +1,307 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "instanceactivator.h"
+#include "launchtrace.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <dbus/dbus.h>
+
+static const char LIPSTICK_SERVICE[]   = "org.nemomobile.lipstick";
+static const char LIPSTICK_PATH[]      = "/WindowModel";
+static const char LIPSTICK_INTERFACE[] = "local.Lipstick.WindowModel";
+static const char LIPSTICK_METHOD[]    = "launchProcess";
+
+// Activations of the same application closer to each other than this (ms) are sent once
+static const unsigned int COALESCE_TIME = 500;
+
+// Minimum time (ms) between attempts to connect to the bus
+static const unsigned int RECONNECT_INTERVAL = 10000;
+
+static unsigned int timestampMs()
+{
+    return (unsigned int)(LaunchTrace::now() / 1000);
+}
+
+InstanceActivator::InstanceActivator() :
+    m_epollFd(epoll_create1(EPOLL_CLOEXEC)),
+    m_connection(NULL),
+    m_watches(),
+    m_watchedFds(),
+    m_pending(),
+    m_connectTime(0),
+    m_activated()
+{
+    if (m_epollFd == -1)
+        Logger::logWarning("InstanceActivator: can't create epoll instance: %s", strerror(errno));
+}
+
+InstanceActivator::~InstanceActivator()
+{
+    disconnect();
+    if (m_epollFd != -1)
+        close(m_epollFd);
+}
+
+int InstanceActivator::fd() const
+{
+    return m_epollFd;
+}
+
+void InstanceActivator::activate(const string &name, int replyFd)
+{
+    Activation activation = { name, replyFd };
+    m_pending.push_back(activation);
+}
+
+void InstanceActivator::flush()
+{
+    if (m_pending.empty())
+        return;
+
+    const unsigned int now = timestampMs();
+
+    // Forget activations that no longer suppress repeated ones
+    for (map<string, unsigned int>::iterator iter = m_activated.begin(); iter != m_activated.end();) {
+        if (now - iter->second >= COALESCE_TIME)
+            m_activated.erase(iter++);
+        else
+            ++iter;
+    }
+
+    // The handshake blocks, a bus that is not there is not asked again right away
+    if (!m_connection && now - m_connectTime >= RECONNECT_INTERVAL)
+        connect();
+
+    for (vector<Activation>::const_iterator iter = m_pending.begin(); iter != m_pending.end(); ++iter) {
+        bool sent = false;
+        if (m_activated.find(iter->name) != m_activated.end()) {
+            Logger::logDebug("InstanceActivator: %s was just activated", iter->name.c_str());
+            sent = true;
+        } else if (m_connection && send(iter->name)) {
+            m_activated[iter->name] = now;
+            sent = true;
+        }
+        reply(iter->replyFd, sent);
+    }
+    m_pending.clear();
+}
+
+void InstanceActivator::handleEvents()
+{
+    const int MAX_EVENTS = 4;
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(m_epollFd, events, MAX_EVENTS, 0);
+
+    for (int i = 0; i < count && m_connection; ++i) {
+        unsigned int flags = 0;
+        if (events[i].events & EPOLLIN)
+            flags |= DBUS_WATCH_READABLE;
+        if (events[i].events & EPOLLOUT)
+            flags |= DBUS_WATCH_WRITABLE;
+        if (events[i].events & EPOLLERR)
+            flags |= DBUS_WATCH_ERROR;
+        if (events[i].events & EPOLLHUP)
+            flags |= DBUS_WATCH_HANGUP;
+
+        // Read and write watches may share the socket
+        vector<DBusWatch *> watches;
+        for (vector<DBusWatch *>::const_iterator iter = m_watches.begin(); iter != m_watches.end(); ++iter) {
+            if (dbus_watch_get_unix_fd(*iter) == events[i].data.fd && dbus_watch_get_enabled(*iter))
+                watches.push_back(*iter);
+        }
+        for (vector<DBusWatch *>::const_iterator iter = watches.begin(); iter != watches.end(); ++iter) {
+            // Handling one may have removed the other
+            if (std::find(m_watches.begin(), m_watches.end(), *iter) == m_watches.end())
+                continue;
+            const unsigned int wanted = dbus_watch_get_flags(*iter) | DBUS_WATCH_ERROR | DBUS_WATCH_HANGUP;
+            if (flags & wanted)
+                dbus_watch_handle(*iter, flags & wanted);
+        }
+    }
+
+    // Replies and signals are not needed, just drop them
+    while (m_connection && dbus_connection_dispatch(m_connection) == DBUS_DISPATCH_DATA_REMAINS)
+        ;
+
+    if (m_connection && !dbus_connection_get_is_connected(m_connection)) {
+        Logger::logWarning("InstanceActivator: session bus connection closed");
+        disconnect();
+    }
+}
+
+void InstanceActivator::closeInChild()
+{
+    int socketFd = -1;
+    if (m_connection && dbus_connection_get_socket(m_connection, &socketFd))
+        close(socketFd);
+    if (m_epollFd != -1)
+        close(m_epollFd);
+    m_epollFd = -1;
+
+    for (vector<Activation>::const_iterator iter = m_pending.begin(); iter != m_pending.end(); ++iter) {
+        if (iter->replyFd != -1)
+            close(iter->replyFd);
+    }
+
+    // Leaked on purpose, the connection belongs to the launcher
+    m_connection = NULL;
+    m_watches.clear();
+    m_watchedFds.clear();
+    m_pending.clear();
+}
+
+bool InstanceActivator::connect()
+{
+    m_connectTime = timestampMs();
+    if (m_epollFd == -1 || m_connection)
+        return m_connection != NULL;
+
+    DBusError error;
+    dbus_error_init(&error);
+
+    // Private, so that the application never shares it
+    m_connection = dbus_bus_get_private(DBUS_BUS_SESSION, &error);
+    if (!m_connection) {
+        Logger::logWarning("InstanceActivator: can't connect to session bus: %s",
+                           error.message ? error.message : "unknown error");
+        dbus_error_free(&error);
+        return false;
+    }
+
+    dbus_connection_set_exit_on_disconnect(m_connection, FALSE);
+    if (!dbus_connection_set_watch_functions(m_connection, addWatch, removeWatch,
+                                             toggleWatch, this, NULL)) {
+        Logger::logWarning("InstanceActivator: can't watch session bus connection");
+        disconnect();
+        return false;
+    }
+
+    Logger::logDebug("InstanceActivator: connected to session bus");
+    return true;
+}
+
+void InstanceActivator::disconnect()
+{
+    if (!m_connection)
+        return;
+
+    // Closing removes the watches
+    dbus_connection_close(m_connection);
+    dbus_connection_unref(m_connection);
+    m_connection = NULL;
+}
+
+bool InstanceActivator::send(const string &name)
+{
+    DBusMessage *msg = dbus_message_new_method_call(LIPSTICK_SERVICE, LIPSTICK_PATH,
+                                                    LIPSTICK_INTERFACE, LIPSTICK_METHOD);
+    if (!msg) {
+        Logger::logWarning("InstanceActivator: can't allocate bus message");
+        return false;
+    }
+
+    const char *arg = name.c_str();
+    bool ok = dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID);
+    if (ok) {
+        // Queued and written as far as the socket takes it, the
+        // rest goes out when the socket becomes writable
+        dbus_message_set_no_reply(msg, TRUE);
+        ok = dbus_connection_send(m_connection, msg, NULL);
+    }
+    dbus_message_unref(msg);
+
+    if (ok)
+        Logger::logDebug("InstanceActivator: activating %s", name.c_str());
+    else
+        Logger::logWarning("InstanceActivator: can't send activation of %s", name.c_str());
+    return ok;
+}
+
+void InstanceActivator::reply(int replyFd, bool sent)
+{
+    if (replyFd == -1)
+        return;
+
+    // An empty socket takes the byte without blocking, a booster
+    // that has given up waiting is gone with its end
+    const char result = sent ? 1 : 0;
+    if (::send(replyFd, &result, sizeof result, MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof result)
+        Logger::logDebug("InstanceActivator: can't reply: %s", strerror(errno));
+    close(replyFd);
+}
+
+unsigned int InstanceActivator::addWatch(DBusWatch *watch, void *data)
+{
+    InstanceActivator *self = static_cast<InstanceActivator *>(data);
+    self->m_watches.push_back(watch);
+    self->syncWatches(dbus_watch_get_unix_fd(watch));
+    return TRUE;
+}
+
+void InstanceActivator::removeWatch(DBusWatch *watch, void *data)
+{
+    InstanceActivator *self = static_cast<InstanceActivator *>(data);
+    self->m_watches.erase(std::remove(self->m_watches.begin(), self->m_watches.end(), watch),
+                          self->m_watches.end());
+    self->syncWatches(dbus_watch_get_unix_fd(watch));
+}
+
+void InstanceActivator::toggleWatch(DBusWatch *watch, void *data)
+{
+    static_cast<InstanceActivator *>(data)->syncWatches(dbus_watch_get_unix_fd(watch));
+}
+
+void InstanceActivator::syncWatches(int fd)
+{
+    unsigned int events = 0;
+    for (vector<DBusWatch *>::const_iterator iter = m_watches.begin(); iter != m_watches.end(); ++iter) {
+        if (dbus_watch_get_unix_fd(*iter) != fd || !dbus_watch_get_enabled(*iter))
+            continue;
+        const unsigned int flags = dbus_watch_get_flags(*iter);
+        if (flags & DBUS_WATCH_READABLE)
+            events |= EPOLLIN;
+        if (flags & DBUS_WATCH_WRITABLE)
+            events |= EPOLLOUT;
+    }
+
+    map<int, unsigned int>::iterator watched = m_watchedFds.find(fd);
+    int op = EPOLL_CTL_MOD;
+    if (watched == m_watchedFds.end()) {
+        if (!events)
+            return;
+        op = EPOLL_CTL_ADD;
+    } else if (!events) {
+        op = EPOLL_CTL_DEL;
+    } else if (watched->second == events) {
+        return;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof event);
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epollFd, op, fd, op == EPOLL_CTL_DEL ? NULL : &event) == -1)
+        Logger::logWarning("InstanceActivator: can't watch fd=%d: %s", fd, strerror(errno));
+
+    if (op == EPOLL_CTL_DEL)
+        m_watchedFds.erase(watched);
+    else
+        m_watchedFds[fd] = events;
+}
@@ -0,0 +1,139 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef INSTANCEACTIVATOR_H
+#define INSTANCEACTIVATOR_H
+
+#include "launcherlib.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+struct DBusConnection;
+struct DBusWatch;
+
+/*!
+ * \class InstanceActivator
+ * \brief Raises the window of a running single-instance application.
+ *
+ * Asks lipstick to activate the application over a private session
+ * bus connection that the launcher keeps open, so that a repeated
+ * launch costs one message instead of a bus handshake. Messages are
+ * sent without waiting for a reply. Requests are queued by activate()
+ * and sent by flush(); repeated requests for the same application in
+ * between, or soon after it was activated, are sent only once.
+ *
+ * Each request comes with a descriptor that gets one byte telling
+ * whether the activation was sent, so that the booster can fall back to
+ * the single-instance plugin when it was not.
+ *
+ * The connection is opened by connect() before the launcher starts
+ * serving launches. The bus handshake blocks, so a connection that is
+ * lost or could not be opened is retried by flush() at most every few
+ * seconds, and activations in between fail at once. The bus socket is
+ * watched through fd(), which the launcher adds to its event loop.
+ */
+class DECL_EXPORT InstanceActivator
+{
+public:
+
+    //! Constructor
+    InstanceActivator();
+
+    //! Destructor
+    ~InstanceActivator();
+
+    //! Epoll fd that is readable when the bus connection needs attention
+    int fd() const;
+
+    //! Open the bus connection, return false on failure
+    bool connect();
+
+    /*!
+     * \brief Queue activation of an application
+     * \param name Application name
+     * \param replyFd Descriptor for the result, closed once it is written
+     */
+    void activate(const string &name, int replyFd);
+
+    //! Send queued activations and tell the requesters whether they were sent
+    void flush();
+
+    //! Read from / write to the bus as it allows, without blocking
+    void handleEvents();
+
+    //! Close file descriptors in a forked process without touching the bus
+    void closeInChild();
+
+private:
+
+    //! Disable copy-constructor
+    InstanceActivator(const InstanceActivator &r);
+
+    //! Disable assignment operator
+    InstanceActivator &operator=(const InstanceActivator &r);
+
+    //! Drop a connection that has been closed
+    void disconnect();
+
+    //! Send one activation, return false on failure
+    bool send(const string &name);
+
+    //! Write the result of an activation to replyFd and close it
+    static void reply(int replyFd, bool sent);
+
+    //! Bus watch callbacks
+    static unsigned int addWatch(DBusWatch *watch, void *data);
+    static void removeWatch(DBusWatch *watch, void *data);
+    static void toggleWatch(DBusWatch *watch, void *data);
+
+    //! Watch fd in m_epollFd for what its enabled bus watches need
+    void syncWatches(int fd);
+
+    //! Epoll instance holding the bus watches
+    int m_epollFd;
+
+    //! Private session bus connection, NULL if not connected
+    DBusConnection *m_connection;
+
+    //! Watches of the connection, reading and writing may share an fd
+    vector<DBusWatch *> m_watches;
+
+    //! Events each fd is watched for in m_epollFd
+    map<int, unsigned int> m_watchedFds;
+
+    //! Activation requested by a booster
+    struct Activation
+    {
+        //! Application name
+        string name;
+
+        //! Descriptor for the result, -1 if none
+        int replyFd;
+    };
+
+    //! Applications to be activated by the next flush()
+    vector<Activation> m_pending;
+
+    //! Timestamp (ms) of the latest connection attempt
+    unsigned int m_connectTime;
+
+    //! Timestamp (ms) of the latest activation per application
+    map<string, unsigned int> m_activated;
+};
+
+#endif // INSTANCEACTIVATOR_H
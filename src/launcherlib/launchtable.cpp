@@ -0,0 +1,168 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "launchtable.h"
+
+#include <stdint.h>
+
+// Slots at start, always a power of two
+static const size_t INITIAL_CAPACITY = 16;
+
+LaunchRecord::LaunchRecord() :
+    state(Free),
+    boosterPid(0),
+    pidFd(-1),
+    invokerPid(-1),
+    invokerFd(-1),
+    invokerPidFd(-1),
+    pool(-1),
+    forkTime(0),
+    launchTime(0),
+    progress(Forked),
+    progressTime(0),
+    bare(false),
+    trimmed(false),
+    appName()
+{
+}
+
+LaunchTable::LaunchTable() :
+    m_slots(INITIAL_CAPACITY),
+    m_count(0)
+{
+}
+
+LaunchRecord *LaunchTable::find(pid_t pid)
+{
+    size_t index = indexOf(pid);
+    return index < m_slots.size() ? &m_slots[index] : NULL;
+}
+
+const LaunchRecord *LaunchTable::find(pid_t pid) const
+{
+    size_t index = indexOf(pid);
+    return index < m_slots.size() ? &m_slots[index] : NULL;
+}
+
+LaunchRecord &LaunchTable::insert(pid_t pid)
+{
+    size_t index = indexOf(pid);
+    if (index < m_slots.size())
+        return m_slots[index];
+
+    // Keep at least half of the slots free so that probes stay short
+    if ((m_count + 1) * 2 > m_slots.size())
+        grow();
+
+    const size_t mask = m_slots.size() - 1;
+    for (index = home(pid); m_slots[index].state != LaunchRecord::Free; index = (index + 1) & mask)
+        ;
+
+    m_slots[index] = LaunchRecord();
+    m_slots[index].state = LaunchRecord::Pooled;
+    m_slots[index].boosterPid = pid;
+    m_count++;
+    return m_slots[index];
+}
+
+void LaunchTable::remove(pid_t pid)
+{
+    size_t hole = indexOf(pid);
+    if (hole >= m_slots.size())
+        return;
+
+    // Move back the records that would no longer be found past the hole
+    const size_t mask = m_slots.size() - 1;
+    for (size_t next = (hole + 1) & mask; m_slots[next].state != LaunchRecord::Free;
+         next = (next + 1) & mask) {
+        size_t want = home(m_slots[next].boosterPid);
+        bool stays = hole <= next ? (hole < want && want <= next)
+                                  : (hole < want || want <= next);
+        if (stays)
+            continue;
+        m_slots[hole] = m_slots[next];
+        hole = next;
+    }
+
+    m_slots[hole] = LaunchRecord();
+    m_count--;
+}
+
+void LaunchTable::clear()
+{
+    m_slots.assign(INITIAL_CAPACITY, LaunchRecord());
+    m_count = 0;
+}
+
+size_t LaunchTable::size() const
+{
+    return m_count;
+}
+
+size_t LaunchTable::capacity() const
+{
+    return m_slots.size();
+}
+
+LaunchRecord *LaunchTable::slot(size_t index)
+{
+    return m_slots[index].state != LaunchRecord::Free ? &m_slots[index] : NULL;
+}
+
+const LaunchRecord *LaunchTable::slot(size_t index) const
+{
+    return m_slots[index].state != LaunchRecord::Free ? &m_slots[index] : NULL;
+}
+
+vector<pid_t> LaunchTable::pids() const
+{
+    vector<pid_t> pids;
+    pids.reserve(m_count);
+    for (size_t index = 0; index < m_slots.size(); ++index) {
+        if (m_slots[index].state != LaunchRecord::Free)
+            pids.push_back(m_slots[index].boosterPid);
+    }
+    return pids;
+}
+
+size_t LaunchTable::home(pid_t pid) const
+{
+    // Multiplicative hash, consecutive pids land in different slots
+    return ((uint32_t)pid * 2654435761u) & (m_slots.size() - 1);
+}
+
+size_t LaunchTable::indexOf(pid_t pid) const
+{
+    const size_t mask = m_slots.size() - 1;
+    for (size_t index = home(pid); m_slots[index].state != LaunchRecord::Free; index = (index + 1) & mask) {
+        if (m_slots[index].boosterPid == pid)
+            return index;
+    }
+    return m_slots.size();
+}
+
+void LaunchTable::grow()
+{
+    vector<LaunchRecord> old;
+    old.swap(m_slots);
+    m_slots.resize(old.size() * 2);
+
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = 0; i < old.size(); ++i) {
+        if (old[i].state == LaunchRecord::Free)
+            continue;
+        size_t index = home(old[i].boosterPid);
+        while (m_slots[index].state != LaunchRecord::Free)
+            index = (index + 1) & mask;
+        m_slots[index] = old[i];
+    }
+}
@@ -0,0 +1,145 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef LAUNCHTABLE_H
+#define LAUNCHTABLE_H
+
+#include "launcherlib.h"
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+using std::string;
+using std::vector;
+
+//! Booster process of the launcher and the launch it serves
+struct LaunchRecord
+{
+    enum State
+    {
+        //! Unused slot
+        Free,
+        //! Waiting in a pool for a launch
+        Pooled,
+        //! Running an application
+        Launched
+    };
+
+    //! Progress reported by a booster waiting in a pool
+    enum Progress
+    {
+        Forked,     //!< Nothing reported yet
+        Preloading, //!< Preloading started
+        Preloaded,  //!< Preloading done, about to accept launches
+        Ready       //!< Launches are accepted
+    };
+
+    LaunchRecord();
+
+    State state;
+
+    //! Pid of the booster / application
+    pid_t boosterPid;
+
+    //! Pidfd of the booster, or -1
+    int pidFd;
+
+    //! Pid of the invoker waiting for the exit status, or -1
+    pid_t invokerPid;
+
+    //! Socket of the invoker, or -1
+    int invokerFd;
+
+    //! Pidfd of the invoker, or -1
+    int invokerPidFd;
+
+    //! Index of the pool the booster was forked for, or -1
+    int pool;
+
+    //! Timestamps (ms) of the fork and the launch
+    unsigned int forkTime;
+    unsigned int launchTime;
+
+    //! Progress of a Pooled booster and timestamp (ms) of its latest change
+    Progress progress;
+    unsigned int progressTime;
+
+    //! True if the booster does not preload
+    bool bare;
+
+    //! True if the booster has been asked to trim its memory
+    bool trimmed;
+
+    //! Name of the launched application
+    string appName;
+};
+
+/*!
+ * \class LaunchTable
+ * \brief Records of the booster processes, keyed by pid.
+ *
+ * Open addressing with linear probing in one flat array, so that a
+ * lookup touches one or two neighbouring records instead of a chain of
+ * tree nodes. Removal shifts the following records back instead of
+ * leaving tombstones. Pointers to records are valid until the next
+ * insert() or remove().
+ */
+class DECL_EXPORT LaunchTable
+{
+public:
+
+    //! Constructor
+    LaunchTable();
+
+    //! Return the record of pid, or NULL
+    LaunchRecord *find(pid_t pid);
+    const LaunchRecord *find(pid_t pid) const;
+
+    //! Add a record for pid in Pooled state, or return the existing one
+    LaunchRecord &insert(pid_t pid);
+
+    //! Remove the record of pid
+    void remove(pid_t pid);
+
+    //! Remove all records
+    void clear();
+
+    //! Number of records
+    size_t size() const;
+
+    //! Number of slots, for iterating with slot()
+    size_t capacity() const;
+
+    //! Return the record in a slot, or NULL if the slot is free
+    LaunchRecord *slot(size_t index);
+    const LaunchRecord *slot(size_t index) const;
+
+    //! Pids of all records, for loops that modify the table
+    vector<pid_t> pids() const;
+
+private:
+
+    //! Slot a pid hashes to
+    size_t home(pid_t pid) const;
+
+    //! Slot of pid, or capacity() if not found
+    size_t indexOf(pid_t pid) const;
+
+    //! Double the number of slots
+    void grow();
+
+    vector<LaunchRecord> m_slots;
+    size_t m_count;
+};
+
+#endif // LAUNCHTABLE_H
@@ -0,0 +1,158 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "launchtrace.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+string LaunchTrace::m_outputFile;
+
+static const char * const stageNames[LaunchTrace::StageCount] = {
+    "invoker_start",
+    "invoker_connect",
+    "accept",
+    "received",
+    "sent_to_parent",
+    "environment",
+    "dlopen",
+    "preinit",
+    "main",
+};
+
+LaunchTrace::LaunchTrace() :
+    m_id(0)
+{
+    memset(m_time, 0, sizeof m_time);
+}
+
+void LaunchTrace::setId(uint64_t id)
+{
+    m_id = id;
+}
+
+uint64_t LaunchTrace::id() const
+{
+    return m_id;
+}
+
+void LaunchTrace::mark(Stage stage)
+{
+    setTime(stage, now());
+}
+
+void LaunchTrace::setTime(Stage stage, uint64_t usec)
+{
+    if (stage >= 0 && stage < StageCount)
+        m_time[stage] = usec;
+}
+
+uint64_t LaunchTrace::time(Stage stage) const
+{
+    return (stage >= 0 && stage < StageCount) ? m_time[stage] : 0;
+}
+
+const char *LaunchTrace::stageName(Stage stage)
+{
+    return (stage >= 0 && stage < StageCount) ? stageNames[stage] : "unknown";
+}
+
+uint64_t LaunchTrace::now()
+{
+    struct timespec ts = { 0, 0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+void LaunchTrace::setOutputFile(const string &path)
+{
+    m_outputFile = path;
+}
+
+static void appendJsonString(string &out, const string &str)
+{
+    out += '"';
+    for (string::const_iterator iter = str.begin(); iter != str.end(); ++iter) {
+        unsigned char c = *iter;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof buf, "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+string LaunchTrace::toJson(const string &appName, const string &fileName) const
+{
+    // Stage times are relative to the first recorded stage
+    uint64_t origin = 0;
+    for (int i = 0; i < StageCount; ++i) {
+        if (m_time[i] && (!origin || m_time[i] < origin))
+            origin = m_time[i];
+    }
+
+    char buf[64];
+    string out;
+    snprintf(buf, sizeof buf, "{\"id\":\"%016llx\",\"pid\":%d,\"app\":",
+             (unsigned long long)m_id, (int)getpid());
+    out += buf;
+    appendJsonString(out, appName);
+    out += ",\"file\":";
+    appendJsonString(out, fileName);
+    snprintf(buf, sizeof buf, ",\"t0_us\":%llu,\"stages_us\":{", (unsigned long long)origin);
+    out += buf;
+
+    bool first = true;
+    for (int i = 0; i < StageCount; ++i) {
+        if (!m_time[i])
+            continue;
+        snprintf(buf, sizeof buf, "%s\"%s\":%llu", first ? "" : ",", stageNames[i],
+                 (unsigned long long)(m_time[i] - origin));
+        out += buf;
+        first = false;
+    }
+    out += "}}";
+
+    return out;
+}
+
+void LaunchTrace::dump(const string &appName, const string &fileName) const
+{
+    const string json = toJson(appName, fileName);
+    Logger::logDebug("LaunchTrace: %s", json.c_str());
+
+    if (m_outputFile.empty())
+        return;
+
+    // One write per line, so that concurrent launches do not interleave
+    int fd = open(m_outputFile.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        Logger::logWarning("LaunchTrace: can't open %s: %s", m_outputFile.c_str(), strerror(errno));
+        return;
+    }
+
+    const string line = json + "\n";
+    if (write(fd, line.data(), line.size()) != (ssize_t)line.size())
+        Logger::logWarning("LaunchTrace: can't write %s: %s", m_outputFile.c_str(), strerror(errno));
+    close(fd);
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef LAUNCHTRACE_H
+#define LAUNCHTRACE_H
+
+#include "launcherlib.h"
+#include <stdint.h>
+
+#include <string>
+
+using std::string;
+
+/*!
+ * \class LaunchTrace
+ * \brief Timeline of one application launch.
+ *
+ * Every launch gets an id from the invoker and a CLOCK_MONOTONIC
+ * timestamp (in microseconds) for each stage it passes through. The
+ * invoker stages are received over the invoker socket, the rest are
+ * marked by the booster. The timeline is written as one JSON line to
+ * the file set with setOutputFile() and to the debug log.
+ */
+class DECL_EXPORT LaunchTrace
+{
+public:
+
+    //! Launch stages in the order they happen
+    enum Stage
+    {
+        InvokerStart = 0, //!< Invoker process started
+        InvokerConnect,   //!< Invoker connected to the booster socket
+        Accept,           //!< Booster accepted the connection
+        Received,         //!< Booster received the launch request
+        SentToParent,     //!< Booster reported the launch to the daemon
+        Environment,      //!< Application environment was set up
+        Dlopen,           //!< Application binary was loaded
+        Preinit,          //!< Booster specific initialization was done
+        Main,             //!< Jump to main() / exec()
+        StageCount
+    };
+
+    //! Constructor
+    LaunchTrace();
+
+    //! Set launch id
+    void setId(uint64_t id);
+
+    //! Return launch id, 0 if invoker did not send one
+    uint64_t id() const;
+
+    //! Store current time for a stage
+    void mark(Stage stage);
+
+    //! Store time for a stage
+    void setTime(Stage stage, uint64_t usec);
+
+    //! Return time of a stage, 0 if it has not been reached
+    uint64_t time(Stage stage) const;
+
+    //! Return the timeline as a single line JSON object
+    string toJson(const string &appName, const string &fileName) const;
+
+    //! Write the timeline to the log and to the output file, if any
+    void dump(const string &appName, const string &fileName) const;
+
+    //! Return current CLOCK_MONOTONIC time in microseconds
+    static uint64_t now();
+
+    //! Return name of a stage as used in JSON output
+    static const char *stageName(Stage stage);
+
+    //! Set file the timelines are appended to, empty string disables
+    static void setOutputFile(const string &path);
+
+private:
+
+    //! Launch id
+    uint64_t m_id;
+
+    //! Stage timestamps
+    uint64_t m_time[StageCount];
+
+    //! File timelines are appended to
+    static string m_outputFile;
+};
+
+#endif // LAUNCHTRACE_H
@@ -0,0 +1,189 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "memorypressure.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+using std::string;
+
+static const char MEMORY_PRESSURE[] = "/proc/pressure/memory";
+
+// Stall (us) within a window (us) that triggers an event. Unprivileged
+// processes may only use windows that are multiples of two seconds.
+static const char MODERATE_TRIGGER[] = "some 150000 2000000";
+static const char SEVERE_TRIGGER[]   = "full 100000 2000000";
+
+MemoryPressure::MemoryPressure() :
+        m_someFd(-1),
+        m_fullFd(-1),
+        m_eventsFd(-1),
+        m_high(0),
+        m_max(0),
+        m_fds()
+{
+}
+
+MemoryPressure::~MemoryPressure()
+{
+    close();
+}
+
+bool MemoryPressure::open()
+{
+    close();
+
+    m_someFd = openTrigger(MODERATE_TRIGGER);
+    m_fullFd = openTrigger(SEVERE_TRIGGER);
+    if (m_someFd != -1 && m_fullFd != -1) {
+        m_fds.push_back(m_someFd);
+        m_fds.push_back(m_fullFd);
+        Logger::logDebug("MemoryPressure: watching %s", MEMORY_PRESSURE);
+        return true;
+    }
+    close();
+
+    // No PSI, follow the events of the memory controller
+    m_eventsFd = openCgroupEvents();
+    if (m_eventsFd != -1 && readCgroupEvents(m_high, m_max)) {
+        m_fds.push_back(m_eventsFd);
+        Logger::logDebug("MemoryPressure: watching cgroup memory.events");
+        return true;
+    }
+    close();
+
+    Logger::logDebug("MemoryPressure: no memory pressure information");
+    return false;
+}
+
+void MemoryPressure::close()
+{
+    if (m_someFd != -1)
+        ::close(m_someFd);
+    if (m_fullFd != -1)
+        ::close(m_fullFd);
+    if (m_eventsFd != -1)
+        ::close(m_eventsFd);
+    m_fds.clear();
+    m_someFd = m_fullFd = m_eventsFd = -1;
+}
+
+const vector<int> &MemoryPressure::fds() const
+{
+    return m_fds;
+}
+
+MemoryPressure::Level MemoryPressure::read(int fd)
+{
+    if (fd == m_fullFd)
+        return Severe;
+    if (fd == m_someFd)
+        return Moderate;
+    if (fd != m_eventsFd)
+        return None;
+
+    // Any change of memory.events wakes us up, see which counter grew
+    unsigned long high = 0;
+    unsigned long max = 0;
+    if (!readCgroupEvents(high, max))
+        return None;
+
+    Level level = None;
+    if (max != m_max)
+        level = Severe;
+    else if (high != m_high)
+        level = Moderate;
+    m_high = high;
+    m_max = max;
+    return level;
+}
+
+const char *MemoryPressure::levelName(Level level)
+{
+    switch (level) {
+    case Moderate:
+        return "moderate";
+    case Severe:
+        return "severe";
+    default:
+        return "none";
+    }
+}
+
+int MemoryPressure::openTrigger(const char *trigger)
+{
+    int fd = ::open(MEMORY_PRESSURE, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    // The trigger stays active for as long as the fd is open
+    if (write(fd, trigger, strlen(trigger) + 1) == -1) {
+        Logger::logDebug("MemoryPressure: can't set trigger '%s': %s", trigger, strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int MemoryPressure::openCgroupEvents()
+{
+    FILE *file = fopen("/proc/self/cgroup", "re");
+    if (!file)
+        return -1;
+
+    // 0::<path> is the unified (v2) hierarchy
+    char line[512];
+    string path;
+    while (fgets(line, sizeof line, file)) {
+        if (strncmp(line, "0::", 3))
+            continue;
+        path = line + 3;
+        path.erase(path.find_last_not_of('\n') + 1);
+        break;
+    }
+    fclose(file);
+    if (path.empty())
+        return -1;
+
+    path = "/sys/fs/cgroup" + (path == "/" ? string() : path) + "/memory.events";
+    return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+bool MemoryPressure::readCgroupEvents(unsigned long &high, unsigned long &max)
+{
+    char buf[512];
+    ssize_t size = pread(m_eventsFd, buf, sizeof buf - 1, 0);
+    if (size <= 0)
+        return false;
+    buf[size] = 0;
+
+    // low <n>\nhigh <n>\nmax <n>\noom <n>\noom_kill <n>
+    high = max = 0;
+    for (char *line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+        char name[32];
+        unsigned long value = 0;
+        if (sscanf(line, "%31s %lu", name, &value) != 2)
+            continue;
+        if (!strcmp(name, "high"))
+            high = value;
+        else if (!strcmp(name, "max") || !strcmp(name, "oom"))
+            max += value;
+    }
+    return true;
+}
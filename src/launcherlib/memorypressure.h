@@ -0,0 +1,95 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MEMORYPRESSURE_H
+#define MEMORYPRESSURE_H
+
+#include "launcherlib.h"
+
+#include <vector>
+
+using std::vector;
+
+/*!
+ * \class MemoryPressure
+ * \brief Notifies the launcher when the system runs short of memory.
+ *
+ * Subscribes to PSI triggers on /proc/pressure/memory: a stall of some
+ * tasks is moderate pressure, a stall of all tasks severe pressure.
+ * On kernels without PSI the high, max and oom counters of the
+ * memory.events file of the launcher's cgroup (v2) are used instead.
+ * The file descriptors report events as EPOLLPRI.
+ */
+class DECL_EXPORT MemoryPressure
+{
+public:
+
+    enum Level
+    {
+        None,
+        Moderate,
+        Severe
+    };
+
+    //! Constructor
+    MemoryPressure();
+
+    //! Destructor
+    ~MemoryPressure();
+
+    //! Subscribe to pressure events, return false if not supported
+    bool open();
+
+    //! Close the file descriptors, also in forked processes
+    void close();
+
+    //! File descriptors to be polled for EPOLLPRI
+    const vector<int> &fds() const;
+
+    //! Return the level of the event that made fd readable
+    Level read(int fd);
+
+    //! Return level name for logging
+    static const char *levelName(Level level);
+
+private:
+
+    //! Disable copy-constructor
+    MemoryPressure(const MemoryPressure &r);
+
+    //! Disable assignment operator
+    MemoryPressure &operator=(const MemoryPressure &r);
+
+    //! Open a PSI trigger, return the fd or -1
+    static int openTrigger(const char *trigger);
+
+    //! Open memory.events of the cgroup of this process, return the fd or -1
+    static int openCgroupEvents();
+
+    //! Read the counters of memory.events, return false on failure
+    bool readCgroupEvents(unsigned long &high, unsigned long &max);
+
+    //! PSI trigger fds, -1 if not used
+    int m_someFd;
+    int m_fullFd;
+
+    //! memory.events fd, -1 if not used
+    int m_eventsFd;
+
+    //! Counters (high, max + oom) of the previous memory.events read
+    unsigned long m_high;
+    unsigned long m_max;
+
+    vector<int> m_fds;
+};
+
+#endif // MEMORYPRESSURE_H
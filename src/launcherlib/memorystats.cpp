@@ -0,0 +1,186 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "memorystats.h"
+
+#include <cstdio>
+#include <cstring>
+#include <limits.h>
+
+MemoryStats::MemoryStats() :
+        m_rss(0),
+        m_pss(0),
+        m_sharedClean(0),
+        m_sharedDirty(0),
+        m_privateClean(0),
+        m_privateDirty(0),
+        m_swap(0),
+        m_librariesShared(0)
+{
+}
+
+static bool isLibrary(const char *path, const vector<string> &libraries)
+{
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    for (vector<string>::const_iterator iter = libraries.begin(); iter != libraries.end(); ++iter) {
+        if ((*iter)[0] == '/') {
+            if (*iter == path)
+                return true;
+            continue;
+        }
+
+        // libfoo.so.5 is mapped as libfoo.so.5.15.2
+        size_t length = iter->size();
+        if (!strncmp(name, iter->c_str(), length) && (name[length] == '\0' || name[length] == '.'))
+            return true;
+    }
+    return false;
+}
+
+bool MemoryStats::read(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/proc/%d/smaps_rollup", (int)pid);
+    FILE *file = fopen(path, "re");
+    if (!file)
+        return false;
+
+    // <first>-<last> ---p 00000000 00:00 0 [rollup]
+    // <Field>: <value> kB
+    MemoryStats stats;
+    bool found = false;
+    char line[256];
+    while (fgets(line, sizeof line, file)) {
+        char field[64];
+        unsigned long value = 0;
+        if (sscanf(line, "%63[^:]: %lu kB", field, &value) != 2)
+            continue;
+
+        if (!strcmp(field, "Rss"))
+            stats.m_rss = value, found = true;
+        else if (!strcmp(field, "Pss"))
+            stats.m_pss = value;
+        else if (!strcmp(field, "Shared_Clean"))
+            stats.m_sharedClean = value;
+        else if (!strcmp(field, "Shared_Dirty"))
+            stats.m_sharedDirty = value;
+        else if (!strcmp(field, "Private_Clean"))
+            stats.m_privateClean = value;
+        else if (!strcmp(field, "Private_Dirty"))
+            stats.m_privateDirty = value;
+        else if (!strcmp(field, "Swap"))
+            stats.m_swap = value;
+    }
+    fclose(file);
+
+    // A process that has exited has an empty rollup
+    if (found)
+        *this = stats;
+    return found;
+}
+
+bool MemoryStats::readLibraries(pid_t pid, const vector<string> &libraries)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/proc/%d/smaps", (int)pid);
+    FILE *file = fopen(path, "re");
+    if (!file)
+        return false;
+
+    // <first>-<last> <perms> <offset> <dev> <inode> <path>
+    // <Field>: <value> kB
+    unsigned long shared = 0;
+    bool library = false;
+    char line[PATH_MAX + 128];
+    while (fgets(line, sizeof line, file)) {
+        unsigned long first = 0, last = 0;
+        char perms[8];
+        int offset = 0;
+        if (sscanf(line, "%lx-%lx %7s %*s %*s %*s %n", &first, &last, perms, &offset) == 3 && offset) {
+            line[strcspn(line, "\n")] = '\0';
+            library = line[offset] == '/' && isLibrary(line + offset, libraries);
+            continue;
+        }
+
+        char field[64];
+        unsigned long value = 0;
+        if (library && sscanf(line, "%63[^:]: %lu kB", field, &value) == 2 &&
+            (!strcmp(field, "Shared_Clean") || !strcmp(field, "Shared_Dirty")))
+            shared += value;
+    }
+    fclose(file);
+
+    m_librariesShared = shared;
+    return true;
+}
+
+void MemoryStats::add(const MemoryStats &other)
+{
+    m_rss += other.m_rss;
+    m_pss += other.m_pss;
+    m_sharedClean += other.m_sharedClean;
+    m_sharedDirty += other.m_sharedDirty;
+    m_privateClean += other.m_privateClean;
+    m_privateDirty += other.m_privateDirty;
+    m_swap += other.m_swap;
+    m_librariesShared += other.m_librariesShared;
+}
+
+unsigned long MemoryStats::rss() const
+{
+    return m_rss;
+}
+
+unsigned long MemoryStats::pss() const
+{
+    return m_pss;
+}
+
+unsigned long MemoryStats::uss() const
+{
+    return m_privateClean + m_privateDirty;
+}
+
+unsigned long MemoryStats::shared() const
+{
+    return m_sharedClean + m_sharedDirty;
+}
+
+unsigned long MemoryStats::librariesShared() const
+{
+    return m_librariesShared;
+}
+
+unsigned long MemoryStats::sharedClean() const
+{
+    return m_sharedClean;
+}
+
+unsigned long MemoryStats::privateDirty() const
+{
+    return m_privateDirty;
+}
+
+unsigned long MemoryStats::swap() const
+{
+    return m_swap;
+}
+
+string MemoryStats::toString() const
+{
+    char buf[192];
+    snprintf(buf, sizeof buf,
+             "rss=%lu pss=%lu uss=%lu shared_clean=%lu private_dirty=%lu swap=%lu kB",
+             rss(), pss(), uss(), sharedClean(), privateDirty(), swap());
+    return buf;
+}
@@ -0,0 +1,91 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include "launcherlib.h"
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/*!
+ * \class MemoryStats
+ * \brief Memory use of a process, as summed up in /proc/<pid>/smaps_rollup.
+ *
+ * The launcher uses this for reporting what waiting boosters cost and
+ * how much of a launched application is still shared with other
+ * processes, such as the boosters that have preloaded the same
+ * libraries. Pages shared in the mappings of given libraries, such as
+ * the ones the boosters preload, can be read separately from
+ * /proc/<pid>/smaps. All values are in kB.
+ */
+class DECL_EXPORT MemoryStats
+{
+public:
+
+    //! Constructor, all values zero
+    MemoryStats();
+
+    //! Read /proc/<pid>/smaps_rollup, return false if it can't be read
+    bool read(pid_t pid);
+
+    /*! \brief Read the shared pages of libraries from /proc/<pid>/smaps.
+     *  A library is given as an absolute path, or as a file name as
+     *  passed to dlopen() that also matches the file name followed by
+     *  a version. Call after read(), which resets the value.
+     *  \return false if smaps can't be read.
+     */
+    bool readLibraries(pid_t pid, const vector<string> &libraries);
+
+    //! Add the values of another process
+    void add(const MemoryStats &other);
+
+    //! Resident set size
+    unsigned long rss() const;
+
+    //! Proportional set size, shared pages divided by the number of users
+    unsigned long pss() const;
+
+    //! Unique set size, pages that only this process maps
+    unsigned long uss() const;
+
+    //! Resident pages that are also mapped by other processes
+    unsigned long shared() const;
+
+    //! Part of shared() in the mappings of the libraries given to readLibraries()
+    unsigned long librariesShared() const;
+
+    unsigned long sharedClean() const;
+    unsigned long privateDirty() const;
+    unsigned long swap() const;
+
+    //! Return values formatted for logging
+    string toString() const;
+
+private:
+
+    unsigned long m_rss;
+    unsigned long m_pss;
+    unsigned long m_sharedClean;
+    unsigned long m_sharedDirty;
+    unsigned long m_privateClean;
+    unsigned long m_privateDirty;
+    unsigned long m_swap;
+    unsigned long m_librariesShared;
+};
+
+#endif // MEMORYSTATS_H
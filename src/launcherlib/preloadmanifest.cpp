@@ -0,0 +1,204 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "preloadmanifest.h"
+#include "atomicfile.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <dlfcn.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+string PreloadManifest::m_manifestFile;
+string PreloadManifest::m_reportFile;
+
+static const char * const kindNames[] = {
+    "library",
+    "plugin",
+    "qml-import",
+    "file",
+};
+
+static bool parseFlag(const string &word, int &flags)
+{
+    if (word == "now")
+        flags = (flags & ~RTLD_LAZY) | RTLD_NOW;
+    else if (word == "lazy")
+        flags = (flags & ~RTLD_NOW) | RTLD_LAZY;
+    else if (word == "global")
+        flags = (flags & ~RTLD_LOCAL) | RTLD_GLOBAL;
+    else if (word == "local")
+        flags = (flags & ~RTLD_GLOBAL) | RTLD_LOCAL;
+    else if (word == "deep")
+        flags |= RTLD_DEEPBIND;
+    else if (word == "nodelete")
+        flags |= RTLD_NODELETE;
+    else
+        return false;
+    return true;
+}
+
+PreloadManifest::PreloadManifest() :
+        m_path(),
+        m_items(),
+        m_results()
+{
+}
+
+bool PreloadManifest::load(const string &path)
+{
+    std::ifstream infile(path.c_str());
+    if (!infile)
+        return false;
+
+    m_path = path;
+    m_items.clear();
+
+    string line;
+    for (int lineNo = 1; std::getline(infile, line); ++lineNo) {
+        std::istringstream words(line);
+        string kind;
+        if (!(words >> kind) || kind[0] == '#')
+            continue;
+
+        Item item;
+        item.line = lineNo;
+        item.flags = 0;
+
+        bool ok = true;
+        if (kind == "library" || kind == "plugin") {
+            item.kind = kind == "library" ? Item::Library : Item::Plugin;
+            item.flags = RTLD_NOW | (item.kind == Item::Library ? RTLD_GLOBAL : RTLD_LOCAL);
+            words >> item.name;
+            string flag;
+            while (ok && words >> flag)
+                ok = parseFlag(flag, item.flags);
+        } else if (kind == "qml-import") {
+            // Module and version, as written after "import" in QML
+            item.kind = Item::QmlImport;
+            std::getline(words >> std::ws, item.name);
+            item.name.erase(item.name.find_last_not_of(" \t\r") + 1);
+        } else if (kind == "file") {
+            item.kind = Item::File;
+            string extra;
+            ok = (words >> item.name) && !(words >> extra);
+        } else {
+            ok = false;
+        }
+
+        if (!ok || item.name.empty()) {
+            Logger::logWarning("PreloadManifest: %s:%d: can't parse '%s'",
+                               path.c_str(), lineNo, line.c_str());
+            continue;
+        }
+        m_items.push_back(item);
+    }
+
+    Result none = { false, false, 0, string() };
+    m_results.assign(m_items.size(), none);
+    return true;
+}
+
+const vector<PreloadManifest::Item> & PreloadManifest::items() const
+{
+    return m_items;
+}
+
+void PreloadManifest::setResult(size_t index, bool ok, uint64_t usec, const string &error)
+{
+    if (index >= m_results.size())
+        return;
+
+    Result &result = m_results[index];
+    result.done = true;
+    result.ok = ok;
+    result.usec = usec;
+    result.error = error;
+
+    const Item &item = m_items[index];
+    if (ok)
+        Logger::logDebug("PreloadManifest: %s %s: %llu us", kindName(item.kind),
+                         item.name.c_str(), (unsigned long long)usec);
+    else
+        Logger::logWarning("PreloadManifest: %s %s failed: %s", kindName(item.kind),
+                           item.name.c_str(), error.c_str());
+}
+
+bool PreloadManifest::isDone(size_t index) const
+{
+    return index < m_results.size() && m_results[index].done;
+}
+
+void PreloadManifest::report(const string &boosterType) const
+{
+    unsigned failed = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < m_results.size(); ++i) {
+        if (m_results[i].done && !m_results[i].ok)
+            failed++;
+        total += m_results[i].usec;
+    }
+
+    Logger::logInfo("PreloadManifest: %s: %u items, %u failed, %llu us",
+                    m_path.c_str(), (unsigned)m_items.size(), failed,
+                    (unsigned long long)total);
+
+    if (m_reportFile.empty())
+        return;
+
+    std::ostringstream out;
+    out << "# booster " << boosterType << ", manifest " << m_path << ", "
+        << m_items.size() << " items, " << failed << " failed, " << total << " us\n"
+        << "# kind\tname\tresult\tus\terror\n";
+    for (size_t i = 0; i < m_items.size(); ++i) {
+        const Result &result = m_results[i];
+        out << kindName(m_items[i].kind) << '\t' << m_items[i].name << '\t'
+            << (!result.done ? "skipped" : result.ok ? "ok" : "failed") << '\t'
+            << result.usec << '\t' << result.error << '\n';
+    }
+
+    // Boosters preload in parallel, replace the report in one go
+    if (!AtomicFile::replace(m_reportFile, out.str(), 0666))
+        Logger::logWarning("PreloadManifest: can't write %s: %s",
+                           m_reportFile.c_str(), strerror(errno));
+}
+
+void PreloadManifest::setManifestFile(const string &path)
+{
+    m_manifestFile = path;
+}
+
+string PreloadManifest::manifestFile(const string &boosterType)
+{
+    if (!m_manifestFile.empty())
+        return m_manifestFile;
+    return string(PRELOAD_MANIFEST_DIR "/") + boosterType + ".conf";
+}
+
+string PreloadManifest::baseManifestFile()
+{
+    return PRELOAD_MANIFEST_DIR "/base.conf";
+}
+
+void PreloadManifest::setReportFile(const string &path)
+{
+    m_reportFile = path;
+}
+
+const char *PreloadManifest::kindName(Item::Kind kind)
+{
+    return kindNames[kind];
+}
@@ -0,0 +1,126 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef PRELOADMANIFEST_H
+#define PRELOADMANIFEST_H
+
+#include "launcherlib.h"
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// Default manifests are read from PRELOAD_MANIFEST_DIR/<booster type>.conf,
+// the base manifest of the zygote tree from PRELOAD_MANIFEST_DIR/base.conf
+#ifndef PRELOAD_MANIFEST_DIR
+#define PRELOAD_MANIFEST_DIR "/etc/pisces-appmotor/preload"
+#endif
+
+/*!
+ * \class PreloadManifest
+ * \brief List of things a booster loads before it waits for launches.
+ *
+ * The manifest is a text file with one item per line:
+ *
+ *   library    <path> [now|lazy] [global|local] [deep] [nodelete]
+ *   plugin     <path> [flags as for library]
+ *   qml-import <module> <version>
+ *   file       <path or glob pattern>
+ *
+ * Libraries default to RTLD_NOW | RTLD_GLOBAL and plugins to
+ * RTLD_NOW | RTLD_LOCAL, which is how Qt loads them. Files are read
+ * ahead into the page cache. Empty lines and lines starting with #
+ * are ignored.
+ *
+ * The time each item took and failures are logged and, if a report
+ * file is set, written there.
+ */
+class DECL_EXPORT PreloadManifest
+{
+public:
+
+    //! One line of the manifest
+    struct Item
+    {
+        enum Kind
+        {
+            Library,
+            Plugin,
+            QmlImport,
+            File
+        };
+
+        Kind   kind;
+        string name;
+        int    flags; //!< dlopen() flags for libraries and plugins
+        int    line;
+    };
+
+    //! Constructor
+    PreloadManifest();
+
+    /*! \brief Read a manifest file.
+     *  Lines that can't be parsed are logged and skipped.
+     *  \return false if the file can't be read.
+     */
+    bool load(const string &path);
+
+    //! Items in the order they are listed
+    const vector<Item> & items() const;
+
+    //! Record the outcome of preloading items()[index]
+    void setResult(size_t index, bool ok, uint64_t usec, const string &error);
+
+    //! Return true if the outcome of items()[index] has been recorded
+    bool isDone(size_t index) const;
+
+    //! Log a summary and write the report file, if one is set
+    void report(const string &boosterType) const;
+
+    //! Use path instead of the default manifest of the booster type
+    static void setManifestFile(const string &path);
+
+    //! Return the manifest file to be used for a booster type
+    static string manifestFile(const string &boosterType);
+
+    //! Return the manifest shared by all booster types, preloaded by the base zygote
+    static string baseManifestFile();
+
+    //! Write the results of every preload to path
+    static void setReportFile(const string &path);
+
+    //! Return the manifest name of an item kind
+    static const char *kindName(Item::Kind kind);
+
+private:
+
+    //! Outcome of one item
+    struct Result
+    {
+        bool     done;
+        bool     ok;
+        uint64_t usec;
+        string   error;
+    };
+
+    string         m_path;
+    vector<Item>   m_items;
+    vector<Result> m_results;
+
+    static string m_manifestFile;
+    static string m_reportFile;
+};
+
+#endif // PRELOADMANIFEST_H
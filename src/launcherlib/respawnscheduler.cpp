@@ -0,0 +1,158 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "respawnscheduler.h"
+#include "launchtrace.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+static const char CPU_PRESSURE[] = "/proc/pressure/cpu";
+static const char IO_PRESSURE[]  = "/proc/pressure/io";
+
+// Share (%) of time some task was stalled, below which there is room
+static const unsigned int CPU_PRESSURE_LIMIT = 10;
+static const unsigned int IO_PRESSURE_LIMIT  = 20;
+
+// Polling interval (ms), doubled every time the system is found busy
+static const unsigned int POLL_INTERVAL_MIN = 100;
+static const unsigned int POLL_INTERVAL_MAX = 800;
+
+RespawnScheduler::RespawnScheduler() :
+        m_waiting(false),
+        m_start(0),
+        m_minDelay(0),
+        m_maxDelay(0),
+        m_interval(POLL_INTERVAL_MIN),
+        m_psi(false),
+        m_cpuStall(0),
+        m_ioStall(0),
+        m_sampleTime(0)
+{
+}
+
+unsigned int RespawnScheduler::start(unsigned int minDelay, unsigned int maxDelay)
+{
+    m_waiting = true;
+    m_start = LaunchTrace::now();
+    m_minDelay = minDelay;
+    m_maxDelay = maxDelay < minDelay ? minDelay : maxDelay;
+    m_interval = POLL_INTERVAL_MIN;
+
+    m_psi = readStall(CPU_PRESSURE, m_cpuStall) && readStall(IO_PRESSURE, m_ioStall);
+    m_sampleTime = m_start;
+
+    unsigned int delay = minDelay > POLL_INTERVAL_MIN ? minDelay : POLL_INTERVAL_MIN;
+    return delay > m_maxDelay ? m_maxDelay : delay;
+}
+
+bool RespawnScheduler::isWaiting() const
+{
+    return m_waiting;
+}
+
+void RespawnScheduler::cancel()
+{
+    m_waiting = false;
+}
+
+bool RespawnScheduler::check(unsigned int &delay)
+{
+    const unsigned int waited = (LaunchTrace::now() - m_start) / 1000;
+    if (waited < m_minDelay) {
+        delay = m_minDelay - waited;
+        return false;
+    }
+
+    if (hasHeadroom(waited)) {
+        Logger::logInfo("RespawnScheduler: preloading after %u ms", waited);
+        m_waiting = false;
+        return true;
+    }
+    if (waited >= m_maxDelay) {
+        Logger::logInfo("RespawnScheduler: still busy after %u ms, preloading anyway", waited);
+        m_waiting = false;
+        return true;
+    }
+
+    // Back off while the system stays busy
+    delay = m_interval < m_maxDelay - waited ? m_interval : m_maxDelay - waited;
+    m_interval = m_interval * 2 > POLL_INTERVAL_MAX ? POLL_INTERVAL_MAX : m_interval * 2;
+    return false;
+}
+
+bool RespawnScheduler::hasHeadroom(uint64_t elapsed)
+{
+    uint64_t cpuStall = 0;
+    uint64_t ioStall = 0;
+    if (m_psi && readStall(CPU_PRESSURE, cpuStall) && readStall(IO_PRESSURE, ioStall)) {
+        const uint64_t now = LaunchTrace::now();
+        const uint64_t span = now > m_sampleTime ? now - m_sampleTime : 1;
+        const unsigned int cpu = (cpuStall - m_cpuStall) * 100 / span;
+        const unsigned int io = (ioStall - m_ioStall) * 100 / span;
+        m_cpuStall = cpuStall;
+        m_ioStall = ioStall;
+        m_sampleTime = now;
+
+        const bool room = cpu < CPU_PRESSURE_LIMIT && io < IO_PRESSURE_LIMIT;
+        Logger::logDebug("RespawnScheduler: %llu ms: cpu %u%% io %u%% stalled -> %s",
+                         (unsigned long long)elapsed, cpu, io, room ? "room" : "busy");
+        return room;
+    }
+    m_psi = false;
+
+    // No PSI, compare runnable tasks (including this one) to CPUs
+    const int runnable = readRunnable();
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (runnable < 0 || cpus < 1) {
+        // Nothing to go by, wait for the whole delay as before
+        Logger::logDebug("RespawnScheduler: %llu ms: no load information",
+                         (unsigned long long)elapsed);
+        return false;
+    }
+
+    const bool room = runnable - 1 < cpus;
+    Logger::logDebug("RespawnScheduler: %llu ms: %d runnable on %ld cpus -> %s",
+                     (unsigned long long)elapsed, runnable, cpus, room ? "room" : "busy");
+    return room;
+}
+
+bool RespawnScheduler::readStall(const char *path, uint64_t &total)
+{
+    FILE *file = fopen(path, "re");
+    if (!file)
+        return false;
+
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    unsigned long long value = 0;
+    const bool ok = fscanf(file, "some avg10=%*f avg60=%*f avg300=%*f total=%llu", &value) == 1;
+    fclose(file);
+    if (ok)
+        total = value;
+    return ok;
+}
+
+int RespawnScheduler::readRunnable()
+{
+    FILE *file = fopen("/proc/loadavg", "re");
+    if (!file)
+        return -1;
+
+    // 0.00 0.00 0.00 <runnable>/<total> <last pid>
+    int runnable = -1;
+    if (fscanf(file, "%*f %*f %*f %d/", &runnable) != 1)
+        runnable = -1;
+    fclose(file);
+    return runnable;
+}
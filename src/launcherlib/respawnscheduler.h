@@ -0,0 +1,90 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef RESPAWNSCHEDULER_H
+#define RESPAWNSCHEDULER_H
+
+#include "launcherlib.h"
+#include <stdint.h>
+
+/*!
+ * \class RespawnScheduler
+ * \brief Decides when a new booster may start preloading.
+ *
+ * A booster forked right after a launch should not compete with the
+ * application that is starting up. Instead of waiting for a fixed
+ * time, the launcher checks CPU and IO pressure (/proc/pressure/cpu and
+ * /proc/pressure/io, or the number of runnable tasks in /proc/loadavg
+ * on kernels without PSI) and forks as soon as the system has room.
+ * Checks are done less often while the system stays busy. Every
+ * decision is logged.
+ */
+class DECL_EXPORT RespawnScheduler
+{
+public:
+
+    //! Constructor
+    RespawnScheduler();
+
+    /*! \brief Start waiting for the system to have room for preloading.
+     *  \param minDelay Time (ms) to wait in any case
+     *  \param maxDelay Time (ms) after which to start even under pressure
+     *  \return Time (ms) until check() should be called
+     */
+    unsigned int start(unsigned int minDelay, unsigned int maxDelay);
+
+    //! True between start() and the check() that allows preloading
+    bool isWaiting() const;
+
+    //! Stop waiting
+    void cancel();
+
+    /*! \brief Check if preloading may start now.
+     *  \param delay Set to the time (ms) until the next check if not
+     *  \return true if preloading may start
+     */
+    bool check(unsigned int &delay);
+
+private:
+
+    //! Take a new sample, return true if there is room for preloading
+    bool hasHeadroom(uint64_t elapsed);
+
+    //! Read the "some" stall total (us) of a PSI file
+    static bool readStall(const char *path, uint64_t &total);
+
+    //! Read the number of runnable tasks from /proc/loadavg
+    static int readRunnable();
+
+    //! True while waiting
+    bool m_waiting;
+
+    //! Time (us) waiting started
+    uint64_t m_start;
+
+    //! Limits (ms) given to start()
+    unsigned int m_minDelay;
+    unsigned int m_maxDelay;
+
+    //! Time (ms) between checks, grows while the system is busy
+    unsigned int m_interval;
+
+    //! True if PSI files can be read
+    bool m_psi;
+
+    //! Stall totals (us) and time (us) of the previous sample
+    uint64_t m_cpuStall;
+    uint64_t m_ioStall;
+    uint64_t m_sampleTime;
+};
+
+#endif // RESPAWNSCHEDULER_H
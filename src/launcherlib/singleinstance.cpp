@@ -18,7 +18,163 @@
 ****************************************************************************/
 
 #include "singleinstance.h"
+#include "logger.h"
+
 #include <dlfcn.h>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+// Number of single-instance applications the registry holds
+static const int REGISTRY_SIZE = 64;
+
+// Longest application name kept in the registry
+static const size_t REGISTRY_NAME_MAX = 256;
+
+// 64-bit FNV-1a of the application name, to skip most string compares
+static uint64_t nameHash(const string &name)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+//! Registry entry, free if pid is 0
+struct SingleInstanceEntry
+{
+    pid_t pid;
+    uint64_t hash;
+    char name[REGISTRY_NAME_MAX];
+};
+
+//! Registry in memory shared by the launcher and its boosters
+struct SingleInstanceTable
+{
+    pthread_mutex_t mutex;
+    SingleInstanceEntry entries[REGISTRY_SIZE];
+};
+
+SingleInstance::SingleInstance() :
+    m_pluginEntry(),
+    m_table(NULL)
+{
+}
+
+SingleInstance::~SingleInstance()
+{
+    closeRegistry();
+}
+
+bool SingleInstance::initRegistry()
+{
+    if (m_table)
+        return true;
+
+    void *table = mmap(NULL, sizeof *m_table, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED)
+    {
+        Logger::logWarning("SingleInstance: can't map registry: %s", strerror(errno));
+        return false;
+    }
+    m_table = static_cast<SingleInstanceTable *>(table);
+
+    // Robust, so that a booster dying with the lock held does not
+    // lock out everyone else
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int rc = pthread_mutex_init(&m_table->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (rc != 0)
+    {
+        Logger::logWarning("SingleInstance: can't init registry lock: %s", strerror(rc));
+        munmap(m_table, sizeof *m_table);
+        m_table = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+bool SingleInstance::lockRegistry()
+{
+    if (!m_table)
+        return false;
+
+    int rc = pthread_mutex_lock(&m_table->mutex);
+    if (rc == EOWNERDEAD)
+    {
+        // Entries are written as a whole before pid is set
+        pthread_mutex_consistent(&m_table->mutex);
+        rc = 0;
+    }
+    if (rc != 0)
+        Logger::logWarning("SingleInstance: can't lock registry: %s", strerror(rc));
+    return rc == 0;
+}
+
+SingleInstance::ClaimResult SingleInstance::claim(const string &name, pid_t pid, pid_t *owner)
+{
+    if (name.empty() || name.size() >= REGISTRY_NAME_MAX || !lockRegistry())
+        return Unavailable;
+
+    const uint64_t hash = nameHash(name);
+    SingleInstanceEntry *free = NULL;
+    ClaimResult result = Unavailable;
+    for (int i = 0; i < REGISTRY_SIZE; i++)
+    {
+        SingleInstanceEntry &entry = m_table->entries[i];
+        if (!entry.pid)
+        {
+            if (!free)
+                free = &entry;
+        }
+        else if (entry.hash == hash && name == entry.name)
+        {
+            if (owner)
+                *owner = entry.pid;
+            result = Running;
+            break;
+        }
+    }
+
+    if (result != Running && free)
+    {
+        free->hash = hash;
+        memcpy(free->name, name.c_str(), name.size() + 1);
+        free->pid = pid;
+        result = Claimed;
+    }
+
+    pthread_mutex_unlock(&m_table->mutex);
+    return result;
+}
+
+void SingleInstance::release(pid_t pid)
+{
+    if (pid <= 0 || !lockRegistry())
+        return;
+
+    for (int i = 0; i < REGISTRY_SIZE; i++)
+    {
+        SingleInstanceEntry &entry = m_table->entries[i];
+        if (entry.pid == pid)
+        {
+            Logger::logDebug("SingleInstance: %s (pid=%d) has exited", entry.name, (int)pid);
+            entry.pid = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&m_table->mutex);
+}
 
 bool SingleInstance::validateAndRegisterPlugin(void * handle)
 {
@@ -64,6 +220,15 @@ bool SingleInstance::validateAndRegisterPlugin(void * handle)
     return true;
 }
 
+void SingleInstance::closeRegistry()
+{
+    if (m_table)
+    {
+        munmap(m_table, sizeof *m_table);
+        m_table = NULL;
+    }
+}
+
 SingleInstancePluginEntry * SingleInstance::pluginEntry() const
 {
     return m_pluginEntry.get();
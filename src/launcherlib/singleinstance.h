@@ -21,8 +21,12 @@
 #define SINGLEINSTANCE_H
 
 #include "launcherlib.h"
+#include <sys/types.h>
+#include <string>
 #include <tr1/memory>
 
+using std::string;
+
 using std::tr1::shared_ptr;
 
 // Function pointer type for lock()
@@ -50,11 +54,57 @@ struct SingleInstancePluginEntry
     void * handle;
 };
 
-//! Class that loads the single-instance binary as a plugin.
+struct SingleInstanceTable;
+
+/*!
+ * \class SingleInstance
+ * \brief Keeps track of running single-instance applications.
+ *
+ * The launcher keeps a registry of the single-instance applications its
+ * boosters have launched in memory shared with the boosters. A booster
+ * claims the application name before launching it, and the launcher
+ * releases the name when it reaps the application. A launch of an
+ * application this launcher is already running is thus noticed without
+ * touching the file system. The single-instance binary is loaded as a
+ * plugin for activating the running instance, and for the file locks
+ * shared with other launchers and the single-instance binary itself.
+ */
 class DECL_EXPORT SingleInstance
 {
 public:
 
+    //! Result of claim()
+    enum ClaimResult
+    {
+        Claimed,    //!< Name is now owned by the given pid
+        Running,    //!< Another process owns the name
+        Unavailable //!< No registry or no room, use the plugin lock
+    };
+
+    //! Constructor
+    SingleInstance();
+
+    //! Destructor
+    ~SingleInstance();
+
+    /*! Map the registry. Must be called before boosters are forked.
+     *  Returns true if succeeded.
+     */
+    bool initRegistry();
+
+    /*! \brief Claim application name for a process.
+     *  \param name Application name
+     *  \param pid Process that is going to run the application
+     *  \param owner Set to the pid owning the name if Running
+     */
+    ClaimResult claim(const string &name, pid_t pid, pid_t *owner);
+
+    //! Release the names owned by a process, e.g. one that has exited
+    void release(pid_t pid);
+
+    //! Unmap the registry in a booster that has been taken into use
+    void closeRegistry();
+
     /*! Validate given plugin library handle and register.
      *  Returns true if succeeded.
      */
@@ -68,8 +118,20 @@ public:
 
 private:
 
+    //! Disable copy-constructor
+    SingleInstance(const SingleInstance &r);
+
+    //! Disable assignment operator
+    SingleInstance &operator=(const SingleInstance &r);
+
+    //! Lock the registry, return false on failure
+    bool lockRegistry();
+
     //! The plugin entry
     shared_ptr<SingleInstancePluginEntry> m_pluginEntry;
+
+    //! Registry shared with boosters, NULL if not mapped
+    SingleInstanceTable *m_table;
 };
 
 #endif // SINGLEINSTANCE_H
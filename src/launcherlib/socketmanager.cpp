@@ -32,8 +32,16 @@
 #include <stdexcept>
 #include <errno.h>
 #include <sstream>
+#include <systemd/sd-daemon.h>
 
-SocketManager::SocketManager()
+// Listen backlog of sockets the launcher creates itself
+static const int DEFAULT_BACKLOG = 10;
+
+SocketManager::SocketManager() :
+    m_socketHash(),
+    m_socketRootPath(),
+    m_listenFds(),
+    m_backlog(-1)
 {
     const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
     if (!runtimeDir || !*runtimeDir)
@@ -48,6 +56,14 @@ SocketManager::SocketManager()
                              m_socketRootPath.c_str(), strerror(errno));
         }
     }
+
+    // Pick up sockets from systemd socket activation, boosters and
+    // applications must not see the variables
+    int count = sd_listen_fds(1);
+    if (count < 0)
+        Logger::logWarning("SocketManager: sd_listen_fds failed: %s", strerror(-count));
+    for (int i = 0; i < count; ++i)
+        m_listenFds.push_back(SD_LISTEN_FDS_START + i);
 }
 
 static string extractTail(string &work)
@@ -121,6 +137,22 @@ void SocketManager::initSocket(const string & socketId)
     // exist for that id / path.
     if (m_socketHash.find(socketId) == m_socketHash.end())
     {
+        // Adopt the socket if systemd already listens on the path
+        const string activatedPath = m_socketRootPath + '/' + socketId;
+        for (vector<int>::iterator iter = m_listenFds.begin(); iter != m_listenFds.end(); ++iter) {
+            if (sd_is_socket_unix(*iter, SOCK_STREAM, 1, activatedPath.c_str(), 0) <= 0)
+                continue;
+
+            Logger::logDebug("SocketManager: Using socket fd=%d from systemd at '%s'",
+                             *iter, activatedPath.c_str());
+            if (m_backlog >= 0 && listen(*iter, m_backlog) < 0)
+                Logger::logWarning("SocketManager: Failed to set backlog of %s: %s",
+                                   activatedPath.c_str(), strerror(errno));
+            m_socketHash[socketId] = *iter;
+            m_listenFds.erase(iter);
+            return;
+        }
+
         string socketPath = prepareSocket(socketId);
         if (socketPath.empty()) {
             string msg;
@@ -160,7 +192,7 @@ void SocketManager::initSocket(const string & socketId)
         }
 
         // Listen to the socket
-        if (listen(socketFd, 10) < 0)
+        if (listen(socketFd, m_backlog >= 0 ? m_backlog : DEFAULT_BACKLOG) < 0)
         {
             string msg;
             msg += "SocketManager: Failed to listen to socket ";
@@ -176,6 +208,20 @@ void SocketManager::initSocket(const string & socketId)
     }
 }
 
+void SocketManager::closeUnusedListenFds()
+{
+    for (vector<int>::iterator iter = m_listenFds.begin(); iter != m_listenFds.end(); ++iter) {
+        Logger::logWarning("SocketManager: Closing unexpected socket fd=%d from systemd", *iter);
+        ::close(*iter);
+    }
+    m_listenFds.clear();
+}
+
+void SocketManager::setBacklog(int backlog)
+{
+    m_backlog = backlog;
+}
+
 void SocketManager::closeSocket(const string & socketId)
 {
     SocketHash::iterator it(m_socketHash.find(socketId));
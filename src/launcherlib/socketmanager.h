@@ -25,15 +25,21 @@
 #include "launcherlib.h"
 #include <map>
 #include <string>
+#include <vector>
 
 using std::map;
 using std::string;
+using std::vector;
 
 /*!
  * \class SocketManager
  *
  * SocketManager Manages sockets that are used in the invoker <-> booster
  * communication.
+ *
+ * Sockets passed by systemd socket activation are adopted instead of
+ * creating new ones, so that invokers started before the launcher
+ * queue on the socket rather than falling back to a plain exec.
  */
 class DECL_EXPORT SocketManager
 {
@@ -43,10 +49,20 @@ public:
     string prepareSocket(const string &socketId) const;
 
     /*! \brief Initialize a file socket.
+     *  Adopts a socket passed by systemd if one is bound to the path.
      *  \param socketId Path to the socket file.
      */
     void initSocket(const string & socketId);
 
+    //! Close sockets passed by systemd that initSocket() did not adopt
+    void closeUnusedListenFds();
+
+    /*! \brief Set the listen backlog of booster sockets.
+     *  Also applied to adopted sockets, which otherwise keep the
+     *  backlog set in the socket unit.
+     */
+    void setBacklog(int backlog);
+
     /*! \brief Close a file socket.
      *  \param socketId Path to the socket file.
      */
@@ -85,6 +101,12 @@ private:
     //! Root path for booster sockets
     string m_socketRootPath;
 
+    //! Sockets passed by systemd and not adopted yet
+    vector<int> m_listenFds;
+
+    //! Listen backlog, or -1 for the default
+    int m_backlog;
+
 };
 
 #endif // SOCKETMANAGER_H
@@ -0,0 +1,204 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "usageprofile.h"
+#include "atomicfile.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+// Counts are halved after this many launches
+static const unsigned int MAX_LAUNCHES = 32;
+
+// Check if path names a shared library, i.e. has ".so" or ".so." in its basename
+static bool isSharedLibrary(const string &path)
+{
+    const size_t base = path.rfind('/') + 1;
+    for (size_t pos = path.find(".so", base); pos != string::npos; pos = path.find(".so", pos + 1)) {
+        if (pos + 3 == path.size() || path[pos + 3] == '.')
+            return true;
+    }
+    return false;
+}
+
+// Sort libraries by count, most used first
+static bool moreUsed(const std::pair<unsigned int, string> &a,
+                     const std::pair<unsigned int, string> &b)
+{
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+}
+
+UsageProfile::UsageProfile() :
+        m_path(),
+        m_launches(0),
+        m_counts()
+{
+}
+
+void UsageProfile::load(const string &path)
+{
+    m_path = path;
+    m_launches = 0;
+    m_counts.clear();
+
+    std::ifstream infile(path.c_str());
+    string line;
+    if (!infile || !std::getline(infile, line) ||
+        sscanf(line.c_str(), "launches %u", &m_launches) != 1) {
+        Logger::logDebug("UsageProfile: starting a new profile %s", path.c_str());
+        return;
+    }
+
+    while (std::getline(infile, line)) {
+        std::istringstream words(line);
+        unsigned int count = 0;
+        string library;
+        if (!(words >> count) || !std::getline(words >> std::ws, library) ||
+            library.empty() || library[0] != '/') {
+            Logger::logWarning("UsageProfile: %s: can't parse '%s'", path.c_str(), line.c_str());
+            continue;
+        }
+        m_counts[library] = std::min(count, m_launches);
+    }
+
+    Logger::logDebug("UsageProfile: %s: %u launches, %u libraries", path.c_str(),
+                     m_launches, (unsigned int)m_counts.size());
+}
+
+bool UsageProfile::save() const
+{
+    if (m_path.empty())
+        return false;
+
+    // Create the cache directories as needed
+    for (size_t pos = m_path.find('/', 1); pos != string::npos; pos = m_path.find('/', pos + 1)) {
+        if (mkdir(m_path.substr(0, pos).c_str(), 0700) == -1 && errno != EEXIST) {
+            Logger::logWarning("UsageProfile: can't create %s: %s",
+                               m_path.substr(0, pos).c_str(), strerror(errno));
+            return false;
+        }
+    }
+
+    std::ostringstream out;
+    out << "launches " << m_launches << '\n';
+    for (map<string, unsigned int>::const_iterator iter = m_counts.begin(); iter != m_counts.end(); ++iter)
+        out << iter->second << ' ' << iter->first << '\n';
+
+    // Replace the profile in one go
+    if (!AtomicFile::replace(m_path, out.str(), 0666)) {
+        Logger::logWarning("UsageProfile: can't write %s: %s", m_path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool UsageProfile::addSample(pid_t pid, dev_t dev, ino_t ino)
+{
+    std::ostringstream mapsPath;
+    mapsPath << "/proc/" << pid << "/maps";
+    std::ifstream maps(mapsPath.str().c_str());
+    if (!maps)
+        return false;
+
+    // address perms offset dev inode path
+    std::set<string> libraries;
+    string line;
+    while (std::getline(maps, line)) {
+        std::istringstream fields(line);
+        string address, perms, offset, path;
+        unsigned int devMajor = 0, devMinor = 0;
+        char colon = 0;
+        unsigned long inode = 0;
+        if (!(fields >> address >> perms >> offset >> std::hex >> devMajor >> colon >> devMinor
+              >> std::dec >> inode) || inode == 0 ||
+            perms.find('x') == string::npos || !std::getline(fields >> std::ws, path))
+            continue;
+
+        // The application binary itself must not be preloaded
+        if (inode == ino && makedev(devMajor, devMinor) == dev)
+            continue;
+        if (!path.empty() && path[0] == '/' && isSharedLibrary(path))
+            libraries.insert(path);
+    }
+
+    // A process that exited while being read has no mappings left
+    if (libraries.empty())
+        return false;
+
+    if (m_launches >= MAX_LAUNCHES)
+        decay();
+
+    m_launches++;
+    for (std::set<string>::const_iterator iter = libraries.begin(); iter != libraries.end(); ++iter)
+        m_counts[*iter]++;
+
+    Logger::logDebug("UsageProfile: pid=%d maps %u libraries, %u known from %u launches",
+                     pid, (unsigned int)libraries.size(), (unsigned int)m_counts.size(), m_launches);
+    return true;
+}
+
+unsigned int UsageProfile::launches() const
+{
+    return m_launches;
+}
+
+vector<string> UsageProfile::top(size_t count) const
+{
+    vector<std::pair<unsigned int, string> > used;
+    for (map<string, unsigned int>::const_iterator iter = m_counts.begin(); iter != m_counts.end(); ++iter) {
+        if (iter->second * 2 >= m_launches)
+            used.push_back(std::make_pair(iter->second, iter->first));
+    }
+    std::sort(used.begin(), used.end(), moreUsed);
+
+    vector<string> libraries;
+    for (size_t i = 0; i < used.size() && i < count; ++i)
+        libraries.push_back(used[i].second);
+    return libraries;
+}
+
+string UsageProfile::defaultFile(const string &application, const string &boosterType)
+{
+    string dir;
+    const char *cacheHome = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (cacheHome && *cacheHome == '/')
+        dir = cacheHome;
+    else if (home && *home == '/')
+        dir = string(home) + "/.cache";
+    else
+        return string();
+
+    return dir + "/mapplauncherd/" + application + "-" + boosterType + ".usage";
+}
+
+void UsageProfile::decay()
+{
+    m_launches /= 2;
+    for (map<string, unsigned int>::iterator iter = m_counts.begin(); iter != m_counts.end();) {
+        iter->second /= 2;
+        if (iter->second == 0)
+            m_counts.erase(iter++);
+        else
+            ++iter;
+    }
+}
@@ -0,0 +1,83 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef USAGEPROFILE_H
+#define USAGEPROFILE_H
+
+#include "launcherlib.h"
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+/*!
+ * \class UsageProfile
+ * \brief Shared libraries an application maps, counted over its launches.
+ *
+ * The launcher of an application specific booster samples
+ * /proc/<pid>/maps of every launched application a while after the
+ * launch. Libraries mapped in at least half of the sampled launches
+ * are preloaded by the boosters forked after that, most used first.
+ *
+ * Counts are halved every MAX_LAUNCHES samples, so that libraries the
+ * application no longer uses drop out. The profile is kept in a text
+ * file with one "<count> <path>" line per library.
+ */
+class DECL_EXPORT UsageProfile
+{
+public:
+
+    //! Constructor
+    UsageProfile();
+
+    //! Read the profile from path, start empty if it can't be read
+    void load(const string &path);
+
+    //! Write the profile back to the file it was loaded from
+    bool save() const;
+
+    /*! \brief Count the shared libraries a process has mapped.
+     *  \param pid Launched application
+     *  \param dev Device of the application binary
+     *  \param ino Inode of the application binary, which is not counted
+     *  \return false if the maps of the process can't be read.
+     */
+    bool addSample(pid_t pid, dev_t dev, ino_t ino);
+
+    //! Number of sampled launches
+    unsigned int launches() const;
+
+    //! Return at most count libraries used in at least half of the launches
+    vector<string> top(size_t count) const;
+
+    /*! \brief Return the default profile file of an application specific booster.
+     *  The file is in $XDG_CACHE_HOME/mapplauncherd, or ~/.cache/mapplauncherd.
+     *  \return empty string if neither is set.
+     */
+    static string defaultFile(const string &application, const string &boosterType);
+
+private:
+
+    //! Halve all counts, forgetting libraries that reach zero
+    void decay();
+
+    string                      m_path;
+    unsigned int                m_launches;
+    map<string, unsigned int>   m_counts;
+};
+
+#endif // USAGEPROFILE_H
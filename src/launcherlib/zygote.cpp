@@ -0,0 +1,206 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "zygote.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Time (us) a forked process sleeps between checks of its parent
+static const useconds_t REPARENT_POLL = 100;
+
+Zygote::Request Zygote::serve(int fd, pid_t launcherPid)
+{
+    if (!send(fd, MessageReady, getpid(), 0))
+        _exit(EXIT_FAILURE);
+
+    for (;;) {
+        Packet packet;
+        ssize_t size = recv(fd, &packet, sizeof packet, 0);
+        if (size == -1 && errno == EINTR)
+            continue;
+        if (size == 0) {
+            Logger::logDebug("Zygote: launcher closed the socket");
+            _exit(EXIT_SUCCESS);
+        }
+        if (size == -1) {
+            Logger::logError("Zygote: can't read from launcher: %s", strerror(errno));
+            _exit(EXIT_FAILURE);
+        }
+        if (size != sizeof packet ||
+            (packet.message != MessageFork && packet.message != MessageForkZygote)) {
+            Logger::logWarning("Zygote: unexpected message from launcher");
+            continue;
+        }
+
+        // A new zygote gets a socket of its own
+        const Message reply = packet.message == MessageForkZygote ? MessageForkedZygote : MessageForked;
+        int fds[2] = { -1, -1 };
+        if (packet.message == MessageForkZygote &&
+            socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1) {
+            Logger::logError("Zygote: can't create zygote socket: %s", strerror(errno));
+            send(fd, reply, -1, packet.index);
+            continue;
+        }
+
+        pid_t intermediatePid = fork();
+        if (intermediatePid == -1) {
+            Logger::logError("Zygote: can't fork: %s", strerror(errno));
+            send(fd, reply, -1, packet.index);
+        } else if (intermediatePid == 0) {
+            intermediatePid = getpid();
+            pid_t childPid = fork();
+            if (childPid == 0) {
+                close(fd);
+                if (fds[0] != -1)
+                    close(fds[0]);
+                waitForLauncher(intermediatePid, launcherPid);
+                Request request = { Message(packet.message), packet.index, fds[1] };
+                return request;
+            }
+
+            // The child is orphaned, and thus handed to the launcher, by exiting
+            if (childPid == -1)
+                Logger::logError("Zygote: can't fork: %s", strerror(errno));
+            const bool sent = send(fd, reply, childPid, packet.index,
+                                   childPid != -1 ? fds[0] : -1);
+            _exit(sent && childPid != -1 ? EXIT_SUCCESS : EXIT_FAILURE);
+        } else {
+            int status = 0;
+            while (waitpid(intermediatePid, &status, 0) == -1 && errno == EINTR)
+                ;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+                Logger::logWarning("Zygote: forking failed");
+        }
+
+        if (fds[0] != -1) {
+            close(fds[0]);
+            close(fds[1]);
+        }
+    }
+}
+
+bool Zygote::requestBooster(int fd, int index)
+{
+    return send(fd, MessageFork, 0, index);
+}
+
+bool Zygote::requestZygote(int fd, int index)
+{
+    return send(fd, MessageForkZygote, 0, index);
+}
+
+bool Zygote::readMessage(int fd, Message &message, pid_t &pid, int &index, int *attachedFd)
+{
+    message = Message(0);
+    if (attachedFd)
+        *attachedFd = -1;
+
+    Packet packet;
+    struct iovec iov;
+    iov.iov_base = &packet;
+    iov.iov_len = sizeof packet;
+
+    int receivedFd = -1;
+    char buf[CMSG_SPACE(sizeof receivedFd)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    memset(buf, 0, sizeof buf);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = buf;
+    msg.msg_controllen = sizeof buf;
+
+    ssize_t size = recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (size == -1 && (errno == EINTR || errno == EAGAIN))
+        return true;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); size > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len >= CMSG_LEN(sizeof receivedFd))
+            memcpy(&receivedFd, CMSG_DATA(cmsg), sizeof receivedFd);
+    }
+    if (receivedFd != -1 && (!attachedFd || size != sizeof packet)) {
+        close(receivedFd);
+        receivedFd = -1;
+    }
+
+    if (size != sizeof packet)
+        return false;
+
+    message = Message(packet.message);
+    pid = packet.pid;
+    index = packet.index;
+    if (attachedFd)
+        *attachedFd = receivedFd;
+    return true;
+}
+
+bool Zygote::send(int fd, Message message, pid_t pid, int index, int attachedFd)
+{
+    Packet packet;
+    memset(&packet, 0, sizeof packet);
+    packet.message = message;
+    packet.pid = pid;
+    packet.index = index;
+
+    struct iovec iov;
+    iov.iov_base = &packet;
+    iov.iov_len = sizeof packet;
+
+    char buf[CMSG_SPACE(sizeof attachedFd)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (attachedFd != -1) {
+        memset(buf, 0, sizeof buf);
+        msg.msg_control = buf;
+        msg.msg_controllen = sizeof buf;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof attachedFd);
+        memcpy(CMSG_DATA(cmsg), &attachedFd, sizeof attachedFd);
+    }
+
+    if (sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof packet) {
+        Logger::logError("Zygote: can't send message %d: %s", message, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void Zygote::waitForLauncher(pid_t intermediatePid, pid_t launcherPid)
+{
+    /* The parent death signal is about the launcher only once the
+     * process has been reparented, which takes the intermediate
+     * process a moment to exit.
+     */
+    pid_t parentPid;
+    while ((parentPid = getppid()) == intermediatePid)
+        usleep(REPARENT_POLL);
+
+    prctl(PR_SET_PDEATHSIG, SIGHUP);
+    if (parentPid != launcherPid || getppid() != launcherPid) {
+        Logger::logError("Zygote: launcher is gone, exiting");
+        _exit(EXIT_FAILURE);
+    }
+}
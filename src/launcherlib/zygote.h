@@ -0,0 +1,136 @@
+/***************************************************************************
+**
+** This file is part of applauncherd
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include "launcherlib.h"
+
+#include <cstddef>
+#include <sys/types.h>
+
+/*!
+ * \class Zygote
+ * \brief Forks preloaded boosters and zygotes on request of the launcher.
+ *
+ * A zygote is a process that does preloads once and then forks a
+ * booster whenever the launcher asks for one, so that respawning a
+ * booster does not repeat them. A zygote may also fork further zygotes
+ * that add preloads of their own, which makes a tree of them sharing
+ * the pages of the ones they were forked from, see Stage.
+ *
+ * Children are forked via a short-lived intermediate process: they get
+ * reparented to the launcher, which is a child subreaper, and the
+ * launcher reaps them and sees their exit status just like for
+ * processes it forked itself.
+ *
+ * The launcher and each zygote talk over a SOCK_SEQPACKET socket pair.
+ * Fork requests are not waited for: the launcher reads the replies with
+ * readMessage() from its event loop. The launcher end of the socket of
+ * a new zygote comes with the reply to the fork request. A zygote exits
+ * when the launcher closes its end.
+ */
+class DECL_EXPORT Zygote
+{
+public:
+
+    //! Messages on the zygote socket
+    enum Message
+    {
+        MessageReady = 1,   //!< Preloading done, fork requests are served
+        MessageFork,        //!< Launcher asks for a booster
+        MessageForkZygote,  //!< Launcher asks for a zygote
+        MessageForked,      //!< Pid of the new booster, -1 on failure
+        MessageForkedZygote //!< Pid of the new zygote with its socket attached, -1 on failure
+    };
+
+    //! Layers of the zygote tree, each forked from the one above
+    enum Stage
+    {
+        StageBase,       //!< Base manifest shared by all booster types
+        StageType,       //!< Manifest of one booster type
+        StageApplication //!< Learned preloads of one boosted application
+    };
+
+    //! What a forked process is for, see serve()
+    struct Request
+    {
+        //! MessageFork or MessageForkZygote
+        Message message;
+
+        //! Index given by the launcher with the request
+        int index;
+
+        //! Zygote end of the socket of a new zygote, -1 for a booster
+        int fd;
+    };
+
+    /*!
+     * \brief Serve fork requests, run in the zygote process.
+     * Tells the launcher that the zygote is ready and forks a process
+     * for every request. Returns in the forked processes only, once they
+     * are children of the launcher.
+     * \param fd Zygote end of the socket pair, closed in the forked processes
+     * \param launcherPid Pid of the launcher
+     * \return Request the process was forked for
+     */
+    static Request serve(int fd, pid_t launcherPid);
+
+    /*!
+     * \brief Ask the zygote for a booster, run in the launcher.
+     * The reply is a MessageForked with the same index.
+     * \param fd Launcher end of the socket pair
+     * \param index Passed to the booster in Request::index
+     * \return false if the request can't be sent
+     */
+    static bool requestBooster(int fd, int index);
+
+    /*!
+     * \brief Ask the zygote for a zygote, run in the launcher.
+     * The reply is a MessageForkedZygote with the same index.
+     * \param fd Launcher end of the socket pair
+     * \param index Passed to the new zygote in Request::index
+     * \return false if the request can't be sent
+     */
+    static bool requestZygote(int fd, int index);
+
+    /*!
+     * \brief Read a message from the zygote without blocking, run in the launcher.
+     * \param fd Launcher end of the socket pair
+     * \param message Set to the message, or 0 if there is none to read
+     * \param pid Set to the pid the message is about
+     * \param index Set to the index of the request replied to
+     * \param attachedFd Set to the fd that came with the message or -1,
+     *        if NULL such an fd is closed
+     * \return false if the zygote has closed the socket or it can't be read
+     */
+    static bool readMessage(int fd, Message &message, pid_t &pid, int &index,
+                            int *attachedFd = NULL);
+
+private:
+
+    //! Message, the pid and index it is about
+    struct Packet
+    {
+        int message;
+        pid_t pid;
+        int index;
+    };
+
+    //! Send a message without blocking, with fd attached if not -1
+    static bool send(int fd, Message message, pid_t pid, int index, int attachedFd = -1);
+
+    //! Wait in a forked process until the intermediate process is gone
+    static void waitForLauncher(pid_t intermediatePid, pid_t launcherPid);
+};
+
+#endif // ZYGOTE_H
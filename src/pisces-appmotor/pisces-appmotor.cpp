@@ -23,6 +23,8 @@
 #include <unistd.h>
 
 #include <QQuickView>
+#include <QQmlComponent>
+#include <QQmlEngine>
 #include <QtGlobal>
 #include <QApplication>
 #include <QDebug>
@@ -34,30 +36,6 @@ const string & PiscesBooster::boosterType() const
     return m_boosterType;
 }
 
-int PiscesBooster::launchProcess()
-{
-    Booster::setEnvironmentBeforeLaunch();
-
-    // Ensure a NULL-terminated argv
-    char ** dummyArgv = new char * [appData()->argc() + 1];
-    const int argc = appData()->argc();
-    for (int i = 0; i < argc; i++)
-        dummyArgv[i] = strdup(appData()->argv()[i]);
-
-    dummyArgv[argc] = NULL;
-
-    // Exec the binary (execv returns only in case of an error).
-    execv(appData()->fileName().c_str(), dummyArgv);
-
-    // Delete dummy argv if execv failed
-    for (int i = 0; i < argc; i++)
-        free(dummyArgv[i]);
-
-    delete [] dummyArgv;
-
-    return EXIT_FAILURE;
-}
-
 void PiscesBooster::initialize(int initialArgc, char **initialArgv, int boosterLauncherSocket,
                            int socketFd, SingleInstance *singleInstance, bool bootMode)
 {
@@ -65,19 +43,54 @@ void PiscesBooster::initialize(int initialArgc, char **initialArgv, int boosterL
     Booster::initialize(initialArgc, initialArgv, boosterLauncherSocket, socketFd, singleInstance, bootMode);
 }
 
+bool PiscesBooster::preloadItem(const PreloadManifest::Item &item, string &error)
+{
+    if (item.kind != PreloadManifest::Item::QmlImport)
+        return Booster::preloadItem(item, error);
+
+    // Loading the import registers its types and loads its plugins,
+    // both stay in place when the engine is gone
+    if (!m_qmlEngine)
+        m_qmlEngine = new QQmlEngine;
+
+    QQmlComponent component(m_qmlEngine);
+    component.setData(QByteArray("import QtQml 2.0\nimport ") + item.name.c_str() +
+                      "\nQtObject {}\n", QUrl());
+    if (component.isError()) {
+        error = component.errorString().simplified().toStdString();
+        return false;
+    }
+    return true;
+}
+
 bool PiscesBooster::preload()
 {
+    // Runs after the manifest, the engine used for QML imports is done
+    delete m_qmlEngine;
+    m_qmlEngine = nullptr;
+
     QQuickView window;
     window.create();
 
     return true;
 }
 
-int main(int argc, char **argv)
+void PiscesBooster::preinit()
 {
-    PiscesBooster *booster = new PiscesBooster;
+    // The application creates its own QApplication in main(),
+    // the loaded libraries and their caches stay in place
+    delete qApp;
+}
 
+int main(int argc, char **argv)
+{
     Daemon d(argc, argv);
-    d.run(booster);
+
+    // One booster per --application, all served by this launcher
+    const vector<string> applications(d.boostedApplications());
+    for (vector<string>::const_iterator iter = applications.begin(); iter != applications.end(); ++iter)
+        d.addBooster(new PiscesBooster, *iter);
+
+    d.run();
 }
 
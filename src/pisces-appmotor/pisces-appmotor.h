@@ -22,6 +22,8 @@
 
 #include "booster.h"
 
+class QQmlEngine;
+
 /*!
  * \class PiscesBooster.
  * \brief Qt-specific version of the Booster.
@@ -31,7 +33,7 @@ class PiscesBooster : public Booster
 public:
 
     //! Constructor.
-    PiscesBooster() {};
+    PiscesBooster() : m_qmlEngine(nullptr) {};
 
     //! Destructor.
     virtual ~PiscesBooster() {};
@@ -48,7 +50,11 @@ protected:
     //! \reimp
     virtual bool preload();
 
-    virtual int launchProcess();
+    //! \reimp
+    virtual void preinit();
+
+    //! \reimp
+    virtual bool preloadItem(const PreloadManifest::Item &item, string &error);
 
 private:
 
@@ -59,6 +65,9 @@ private:
     PiscesBooster & operator= (const PiscesBooster & r);
 
     static const string m_boosterType;
+
+    //! Engine for the QML imports of the preload manifest
+    QQmlEngine *m_qmlEngine;
 };
 
 #endif //QTBOOSTER_H
\ No newline at end of file